@@ -0,0 +1,683 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "BoundingVolumeHierarchy.h"
+#include <algorithm>
+
+namespace
+{
+    Vasnecov::BoundingBox unite(const Vasnecov::BoundingBox& first, const Vasnecov::BoundingBox& second)
+    {
+        Vasnecov::BoundingBox box(first);
+        box.add(second);
+        return box;
+    }
+}
+
+Vasnecov::BoundingVolumeHierarchy::BoundingVolumeHierarchy() :
+    m_nodes(),
+    m_root(-1),
+    m_freeNodes(-1),
+    m_items(),
+    m_elements(),
+    m_indices(),
+    m_dirty(),
+    m_commits(0),
+    m_inserted(0),
+    m_rebuildCost(0.0f)
+{}
+
+GLboolean Vasnecov::BoundingVolumeHierarchy::insert(VasnecovElement* element, GLuint type, const BoundingBox& box)
+{
+    if(!element || contains(element))
+        return false;
+
+    Item item;
+    item.element = element;
+    item.type = type;
+    item.box = box;
+    item.node = -1;
+
+    GLuint index(static_cast<GLuint>(m_items.size()));
+    m_items.push_back(item);
+    m_elements.push_back(element);
+    m_indices[element] = index;
+
+    if(box.isValid())
+    {
+        GLint leaf = allocateNode();
+        m_nodes[leaf].box = box;
+        m_nodes[leaf].item = index;
+        m_items[index].node = leaf;
+        insertLeaf(leaf);
+        ++m_inserted;
+    }
+    return true;
+}
+
+GLboolean Vasnecov::BoundingVolumeHierarchy::remove(VasnecovElement* element)
+{
+    auto found = m_indices.find(element);
+    if(found == m_indices.end())
+        return false;
+
+    GLuint index(found->second);
+    m_indices.erase(found);
+
+    if(m_items[index].node >= 0)
+    {
+        removeLeaf(m_items[index].node);
+        freeNode(m_items[index].node);
+    }
+
+    // Последний элемент переносится на место удалённого
+    GLuint last(static_cast<GLuint>(m_items.size()) - 1);
+    if(index != last)
+    {
+        m_items[index] = m_items[last];
+        m_elements[index] = m_elements[last];
+        m_indices[m_items[index].element] = index;
+        if(m_items[index].node >= 0)
+            m_nodes[m_items[index].node].item = index;
+    }
+    m_items.pop_back();
+    m_elements.pop_back();
+
+    return true;
+}
+
+GLboolean Vasnecov::BoundingVolumeHierarchy::update(VasnecovElement* element, const BoundingBox& box)
+{
+    auto found = m_indices.find(element);
+    if(found == m_indices.end())
+        return false;
+
+    Item& item(m_items[found->second]);
+    if(item.box == box)
+        return true;
+
+    item.box = box;
+    if(item.node >= 0)
+    {
+        if(box.isValid())
+        {
+            m_nodes[item.node].box = box;
+            m_dirty.push_back(item.node);
+        }
+        else
+        {
+            removeLeaf(item.node);
+            freeNode(item.node);
+            item.node = -1;
+        }
+    }
+    else if(box.isValid())
+    {
+        GLint leaf = allocateNode();
+        m_nodes[leaf].box = box;
+        m_nodes[leaf].item = found->second;
+        m_items[found->second].node = leaf;
+        insertLeaf(leaf);
+        ++m_inserted;
+    }
+    return true;
+}
+
+void Vasnecov::BoundingVolumeHierarchy::clear()
+{
+    m_nodes.clear();
+    m_root = -1;
+    m_freeNodes = -1;
+    m_items.clear();
+    m_elements.clear();
+    m_indices.clear();
+    m_dirty.clear();
+    m_commits = 0;
+    m_inserted = 0;
+    m_rebuildCost = 0.0f;
+}
+
+void Vasnecov::BoundingVolumeHierarchy::commit()
+{
+    if(!m_dirty.empty())
+    {
+        for(GLint leaf : m_dirty)
+        {
+            // Лист мог быть удалён, а его узел - переиспользован
+            const Node& node(m_nodes[leaf]);
+            if(node.item < 0 || m_items[node.item].node != leaf)
+                continue;
+
+            refitUpwards(node.parent);
+        }
+        m_dirty.clear();
+        ++m_commits;
+    }
+
+    // Много вставок портят дерево быстрее движения
+    if(m_inserted > std::max<GLuint>(16, size() / 2))
+    {
+        rebuild();
+    }
+    else if(m_commits >= cfg_bvhRebuildPeriod)
+    {
+        m_commits = 0;
+        if(cost() > m_rebuildCost * cfg_bvhRebuildRatio)
+            rebuild();
+    }
+}
+
+void Vasnecov::BoundingVolumeHierarchy::rebuild()
+{
+    std::vector<GLuint> items;
+    items.reserve(m_items.size());
+    for(GLuint i = 0; i < m_items.size(); ++i)
+    {
+        if(m_items[i].box.isValid())
+            items.push_back(i);
+        m_items[i].node = -1;
+    }
+
+    m_nodes.clear();
+    m_nodes.reserve(items.empty() ? 0 : items.size() * 2 - 1);
+    m_freeNodes = -1;
+    m_dirty.clear();
+
+    m_root = items.empty() ? -1 : buildRecursive(items, 0, items.size(), -1);
+
+    m_commits = 0;
+    m_inserted = 0;
+    m_rebuildCost = cost();
+}
+
+GLuint Vasnecov::BoundingVolumeHierarchy::type(VasnecovElement* element) const
+{
+    auto found = m_indices.find(element);
+    if(found == m_indices.end())
+        return 0;
+
+    return m_items[found->second].type;
+}
+
+Vasnecov::BoundingBox Vasnecov::BoundingVolumeHierarchy::box(VasnecovElement* element) const
+{
+    auto found = m_indices.find(element);
+    if(found == m_indices.end())
+        return BoundingBox();
+
+    return m_items[found->second].box;
+}
+
+void Vasnecov::BoundingVolumeHierarchy::queryFrustum(const Frustum& frustum, std::vector<VasnecovElement*>& result, GLuint types) const
+{
+    query([&frustum](const BoundingBox& box) {return frustum.intersects(box);},
+          [&frustum](const BoundingBox& box) {return frustum.contains(box);},
+          result, types);
+}
+
+void Vasnecov::BoundingVolumeHierarchy::queryBox(const BoundingBox& box, std::vector<VasnecovElement*>& result, GLuint types) const
+{
+    query([&box](const BoundingBox& nodeBox) {return box.intersects(nodeBox);},
+          [&box](const BoundingBox& nodeBox) {return box.contains(nodeBox);},
+          result, types);
+}
+
+void Vasnecov::BoundingVolumeHierarchy::querySphere(const QVector3D& center, GLfloat radius,
+                                                    std::vector<VasnecovElement*>& result, GLuint types) const
+{
+    query([&center, radius](const BoundingBox& box) {return box.intersectsSphere(center, radius);},
+          [](const BoundingBox&) {return false;},
+          result, types);
+}
+
+void Vasnecov::BoundingVolumeHierarchy::queryRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                                 std::vector<RayHit>& result, GLuint types) const
+{
+    size_t first(result.size());
+    traverseRay(origin, direction, maxDistance, types,
+                [&result, maxDistance](VasnecovElement* element, GLuint type, GLfloat distance) -> GLfloat
+    {
+        RayHit hit;
+        hit.element = element;
+        hit.type = type;
+        hit.distance = distance;
+        result.push_back(hit);
+        return maxDistance;
+    });
+
+    std::sort(result.begin() + first, result.end(),
+              [](const RayHit& a, const RayHit& b) {return a.distance < b.distance;});
+}
+
+void Vasnecov::BoundingVolumeHierarchy::collect(GLint node, std::vector<VasnecovElement*>& result, GLuint types) const
+{
+    std::vector<GLint> stack;
+    stack.push_back(node);
+
+    while(!stack.empty())
+    {
+        const Node& current(m_nodes[stack.back()]);
+        stack.pop_back();
+
+        if(current.isLeaf())
+        {
+            const Item& item(m_items[current.item]);
+            if(item.type & types)
+                result.push_back(item.element);
+        }
+        else
+        {
+            stack.push_back(current.left);
+            stack.push_back(current.right);
+        }
+    }
+}
+
+GLint Vasnecov::BoundingVolumeHierarchy::allocateNode()
+{
+    GLint index;
+    if(m_freeNodes >= 0)
+    {
+        index = m_freeNodes;
+        m_freeNodes = m_nodes[index].parent;
+        m_nodes[index] = Node();
+    }
+    else
+    {
+        index = static_cast<GLint>(m_nodes.size());
+        m_nodes.push_back(Node());
+    }
+    return index;
+}
+
+void Vasnecov::BoundingVolumeHierarchy::freeNode(GLint node)
+{
+    m_nodes[node] = Node();
+    m_nodes[node].parent = m_freeNodes;
+    m_freeNodes = node;
+}
+
+void Vasnecov::BoundingVolumeHierarchy::insertLeaf(GLint leaf)
+{
+    if(m_root < 0)
+    {
+        m_root = leaf;
+        m_nodes[leaf].parent = -1;
+        return;
+    }
+
+    // Спуск по наименьшему приросту площади поверхности
+    const BoundingBox box(m_nodes[leaf].box);
+    GLint index(m_root);
+    while(!m_nodes[index].isLeaf())
+    {
+        const Node& node(m_nodes[index]);
+
+        GLfloat area = node.box.surfaceArea();
+        GLfloat combinedArea = unite(node.box, box).surfaceArea();
+
+        GLfloat cost = 2.0f * combinedArea; // Новый родитель для этого узла и листа
+        GLfloat inheritance = 2.0f * (combinedArea - area); // Прирост у всех предков при спуске
+
+        auto childCost = [this, &box, inheritance](GLint child) -> GLfloat
+        {
+            const Node& childNode(m_nodes[child]);
+            GLfloat united = unite(childNode.box, box).surfaceArea();
+            if(childNode.isLeaf())
+                return united + inheritance;
+            return united - childNode.box.surfaceArea() + inheritance;
+        };
+
+        GLfloat costLeft = childCost(node.left);
+        GLfloat costRight = childCost(node.right);
+
+        if(cost < costLeft && cost < costRight)
+            break;
+
+        index = costLeft < costRight ? node.left : node.right;
+    }
+
+    GLint sibling(index);
+    GLint oldParent(m_nodes[sibling].parent);
+    GLint newParent = allocateNode();
+
+    m_nodes[newParent].parent = oldParent;
+    m_nodes[newParent].box = unite(m_nodes[sibling].box, box);
+    m_nodes[newParent].height = m_nodes[sibling].height + 1;
+    m_nodes[newParent].left = sibling;
+    m_nodes[newParent].right = leaf;
+    m_nodes[sibling].parent = newParent;
+    m_nodes[leaf].parent = newParent;
+
+    if(oldParent >= 0)
+    {
+        if(m_nodes[oldParent].left == sibling)
+            m_nodes[oldParent].left = newParent;
+        else
+            m_nodes[oldParent].right = newParent;
+
+        refitUpwards(oldParent);
+    }
+    else
+    {
+        m_root = newParent;
+    }
+}
+
+void Vasnecov::BoundingVolumeHierarchy::removeLeaf(GLint leaf)
+{
+    if(leaf == m_root)
+    {
+        m_root = -1;
+        return;
+    }
+
+    GLint parent(m_nodes[leaf].parent);
+    GLint grandParent(m_nodes[parent].parent);
+    GLint sibling(m_nodes[parent].left == leaf ? m_nodes[parent].right : m_nodes[parent].left);
+
+    if(grandParent >= 0)
+    {
+        if(m_nodes[grandParent].left == parent)
+            m_nodes[grandParent].left = sibling;
+        else
+            m_nodes[grandParent].right = sibling;
+
+        m_nodes[sibling].parent = grandParent;
+        freeNode(parent);
+        refitUpwards(grandParent);
+    }
+    else
+    {
+        m_root = sibling;
+        m_nodes[sibling].parent = -1;
+        freeNode(parent);
+    }
+    m_nodes[leaf].parent = -1;
+}
+
+void Vasnecov::BoundingVolumeHierarchy::refitUpwards(GLint node)
+{
+    while(node >= 0)
+    {
+        Node& current(m_nodes[node]);
+        const Node& left(m_nodes[current.left]);
+        const Node& right(m_nodes[current.right]);
+
+        BoundingBox box(unite(left.box, right.box));
+        GLuint height(std::max(left.height, right.height) + 1);
+
+        // Выше изменения не распространяются
+        if(box == current.box && height == current.height)
+            break;
+
+        current.box = box;
+        current.height = height;
+        node = current.parent;
+    }
+}
+
+GLint Vasnecov::BoundingVolumeHierarchy::buildRecursive(std::vector<GLuint>& items, size_t begin, size_t end, GLint parent)
+{
+    GLint index = allocateNode();
+    m_nodes[index].parent = parent;
+
+    if(end - begin == 1)
+    {
+        GLuint item(items[begin]);
+        m_nodes[index].box = m_items[item].box;
+        m_nodes[index].item = item;
+        m_items[item].node = index;
+        return index;
+    }
+
+    // Деление по медиане центров вдоль самой длинной оси
+    BoundingBox centers;
+    for(size_t i = begin; i < end; ++i)
+        centers.add(m_items[items[i]].box.center());
+
+    QVector3D size(centers.maximum() - centers.minimum());
+    int axis(0);
+    if(size.y() > size[axis])
+        axis = 1;
+    if(size.z() > size[axis])
+        axis = 2;
+
+    size_t middle = begin + (end - begin) / 2;
+    std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end,
+                     [this, axis](GLuint a, GLuint b)
+    {
+        return m_items[a].box.center()[axis] < m_items[b].box.center()[axis];
+    });
+
+    GLint left = buildRecursive(items, begin, middle, index);
+    GLint right = buildRecursive(items, middle, end, index);
+
+    // Вектор узлов мог перевыделиться
+    Node& node(m_nodes[index]);
+    node.left = left;
+    node.right = right;
+    node.box = unite(m_nodes[left].box, m_nodes[right].box);
+    node.height = std::max(m_nodes[left].height, m_nodes[right].height) + 1;
+
+    return index;
+}
+
+GLfloat Vasnecov::BoundingVolumeHierarchy::cost() const
+{
+    if(m_root < 0 || m_nodes[m_root].isLeaf())
+        return 0.0f;
+
+    GLfloat rootArea(m_nodes[m_root].box.surfaceArea());
+    if(rootArea <= 0.0f)
+        return 0.0f;
+
+    // Сумма площадей внутренних узлов относительно корня (SAH без учёта листьев)
+    GLfloat res(0.0f);
+    std::vector<GLint> stack;
+    stack.push_back(m_root);
+    while(!stack.empty())
+    {
+        const Node& node(m_nodes[stack.back()]);
+        stack.pop_back();
+        if(node.isLeaf())
+            continue;
+
+        res += node.box.surfaceArea();
+        stack.push_back(node.left);
+        stack.push_back(node.right);
+    }
+    return res / rootArea;
+}
+
+Vasnecov::TriangleHierarchy::TriangleHierarchy() :
+    m_nodes(),
+    m_vertices()
+{}
+
+void Vasnecov::TriangleHierarchy::build(const std::vector<QVector3D>& vertices, const std::vector<GLuint>& indices)
+{
+    clear();
+
+    std::vector<GLuint> triangles;
+    std::vector<QVector3D> centroids;
+    triangles.reserve(indices.size() / 3);
+    centroids.reserve(indices.size() / 3);
+    for(size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        if(indices[i] >= vertices.size() || indices[i + 1] >= vertices.size() || indices[i + 2] >= vertices.size())
+            continue;
+
+        triangles.push_back(static_cast<GLuint>(i));
+        centroids.push_back((vertices[indices[i]] + vertices[indices[i + 1]] + vertices[indices[i + 2]]) / 3.0f);
+    }
+    if(triangles.empty())
+        return;
+
+    // Вершины копируются в порядке листьев, чтобы обход не прыгал по памяти
+    std::vector<GLuint> order(triangles.size());
+    for(GLuint i = 0; i < order.size(); ++i)
+        order[i] = i;
+
+    m_nodes.reserve(2 * triangles.size() / cfg_triangleLeafSize + 1);
+    buildRecursive(order, centroids, 0, order.size());
+
+    m_vertices.reserve(order.size() * 3);
+    for(GLuint triangle : order)
+    {
+        const GLuint first(triangles[triangle]);
+        m_vertices.push_back(vertices[indices[first]]);
+        m_vertices.push_back(vertices[indices[first + 1]]);
+        m_vertices.push_back(vertices[indices[first + 2]]);
+    }
+
+    // Потомки всегда правее родителя, поэтому боксы собираются обратным проходом
+    for(size_t i = m_nodes.size(); i-- > 0;)
+    {
+        Node& node(m_nodes[i]);
+        if(node.count > 0)
+        {
+            for(GLuint v = node.first * 3; v < (node.first + node.count) * 3; ++v)
+                node.box.add(m_vertices[v]);
+        }
+        else
+        {
+            node.box = unite(m_nodes[i + 1].box, m_nodes[node.right].box);
+        }
+    }
+}
+
+void Vasnecov::TriangleHierarchy::clear()
+{
+    m_nodes.clear();
+    m_vertices.clear();
+}
+
+GLuint Vasnecov::TriangleHierarchy::buildRecursive(std::vector<GLuint>& triangles, std::vector<QVector3D>& centroids,
+                                                  size_t begin, size_t end)
+{
+    GLuint index(static_cast<GLuint>(m_nodes.size()));
+    m_nodes.push_back(Node());
+
+    if(end - begin <= cfg_triangleLeafSize)
+    {
+        m_nodes[index].first = static_cast<GLuint>(begin);
+        m_nodes[index].count = static_cast<GLuint>(end - begin);
+        m_nodes[index].right = 0;
+        return index;
+    }
+
+    // Боксы узлов заполняются после раскладки вершин, здесь нужны только центры
+    BoundingBox centers;
+    for(size_t i = begin; i < end; ++i)
+        centers.add(centroids[triangles[i]]);
+
+    QVector3D size(centers.maximum() - centers.minimum());
+    int axis(0);
+    if(size.y() > size[axis])
+        axis = 1;
+    if(size.z() > size[axis])
+        axis = 2;
+
+    size_t middle = begin + (end - begin) / 2;
+    std::nth_element(triangles.begin() + begin, triangles.begin() + middle, triangles.begin() + end,
+                     [&centroids, axis](GLuint a, GLuint b)
+    {
+        return centroids[a][axis] < centroids[b][axis];
+    });
+
+    buildRecursive(triangles, centroids, begin, middle);
+    GLuint right = buildRecursive(triangles, centroids, middle, end);
+
+    m_nodes[index].first = 0;
+    m_nodes[index].count = 0;
+    m_nodes[index].right = right;
+    return index;
+}
+
+GLboolean Vasnecov::TriangleHierarchy::intersectRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                                    GLfloat& distance, QVector3D& normal) const
+{
+    if(m_nodes.empty())
+        return false;
+
+    const QVector3D inverse(BoundingBox::inverseDirection(direction));
+    GLboolean found(false);
+
+    struct Entry
+    {
+        GLuint node;
+        GLfloat distance;
+    };
+    std::vector<Entry> stack;
+    stack.reserve(64);
+
+    GLfloat entry(0.0f);
+    if(!m_nodes[0].box.intersectsRay(origin, inverse, maxDistance, entry))
+        return false;
+    stack.push_back({0, entry});
+
+    while(!stack.empty())
+    {
+        Entry current(stack.back());
+        stack.pop_back();
+        if(current.distance > maxDistance)
+            continue;
+
+        const Node& node(m_nodes[current.node]);
+        if(node.count > 0)
+        {
+            for(GLuint i = node.first; i < node.first + node.count; ++i)
+            {
+                const QVector3D& a(m_vertices[i * 3]);
+                const QVector3D& b(m_vertices[i * 3 + 1]);
+                const QVector3D& c(m_vertices[i * 3 + 2]);
+
+                GLfloat t(0.0f);
+                if(intersectTriangle(origin, direction, a, b, c, t) && t <= maxDistance)
+                {
+                    maxDistance = t;
+                    distance = t;
+                    normal = QVector3D::crossProduct(b - a, c - a);
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        GLuint leftIndex(current.node + 1);
+        GLfloat leftEntry(0.0f), rightEntry(0.0f);
+        GLboolean left = m_nodes[leftIndex].box.intersectsRay(origin, inverse, maxDistance, leftEntry);
+        GLboolean right = m_nodes[node.right].box.intersectsRay(origin, inverse, maxDistance, rightEntry);
+
+        if(left && right)
+        {
+            if(leftEntry <= rightEntry)
+            {
+                stack.push_back({node.right, rightEntry});
+                stack.push_back({leftIndex, leftEntry});
+            }
+            else
+            {
+                stack.push_back({leftIndex, leftEntry});
+                stack.push_back({node.right, rightEntry});
+            }
+        }
+        else if(left)
+        {
+            stack.push_back({leftIndex, leftEntry});
+        }
+        else if(right)
+        {
+            stack.push_back({node.right, rightEntry});
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Динамическое дерево ограничивающих боксов элементов мира
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "Geometry.h"
+
+class VasnecovElement;
+
+namespace Vasnecov
+{
+    const GLuint cfg_bvhRebuildPeriod = 64; // Проверка качества дерева раз в столько обновлений с движением
+    const GLfloat cfg_bvhRebuildRatio = 1.5f; // Перестроение при росте стоимости дерева во столько раз
+    const GLuint cfg_triangleLeafSize = 4; // Треугольников в листе дерева мешей
+
+    enum SpatialTypes
+    {
+        SpatialTypeProduct  = 0x01,
+        SpatialTypeFigure   = 0x02,
+        SpatialTypeTerrain  = 0x04,
+        SpatialTypeLabel    = 0x08,
+        SpatialTypeAll      = 0x0F
+    };
+
+    // Дерево хранит мировые боксы элементов. Движение элементов обрабатывается подгонкой
+    // боксов предков, а при заметном ухудшении дерево перестраивается целиком.
+    class BoundingVolumeHierarchy
+    {
+        struct Node
+        {
+            BoundingBox box;
+            GLint parent;
+            GLint left, right; // Для листа -1
+            GLint item; // Для внутреннего узла -1
+            GLuint height;
+
+            Node() : box(), parent(-1), left(-1), right(-1), item(-1), height(0) {}
+            GLboolean isLeaf() const {return left < 0;}
+        };
+        struct Item
+        {
+            VasnecovElement* element;
+            GLuint type;
+            BoundingBox box;
+            GLint node; // -1, если у элемента нет бокса
+        };
+
+    public:
+        struct RayHit
+        {
+            VasnecovElement* element;
+            GLuint type;
+            GLfloat distance; // До входа в бокс, в длинах направления
+
+            RayHit() : element(nullptr), type(0), distance(0.0f) {}
+        };
+
+        BoundingVolumeHierarchy();
+
+        GLboolean insert(VasnecovElement* element, GLuint type, const BoundingBox& box);
+        GLboolean remove(VasnecovElement* element);
+        GLboolean update(VasnecovElement* element, const BoundingBox& box);
+        GLboolean contains(VasnecovElement* element) const;
+        void clear();
+
+        // Подгонка боксов после обновлений и периодическое перестроение
+        void commit();
+        void rebuild();
+
+        GLuint size() const;
+        GLuint height() const;
+        BoundingBox bounds() const;
+        const std::vector<VasnecovElement*>& elements() const;
+        GLuint type(VasnecovElement* element) const; // 0, если элемента нет
+        BoundingBox box(VasnecovElement* element) const; // Пустой, если элемента нет
+
+        void queryFrustum(const Frustum& frustum, std::vector<VasnecovElement*>& result, GLuint types = SpatialTypeAll) const;
+        void queryBox(const BoundingBox& box, std::vector<VasnecovElement*>& result, GLuint types = SpatialTypeAll) const;
+        void querySphere(const QVector3D& center, GLfloat radius, std::vector<VasnecovElement*>& result, GLuint types = SpatialTypeAll) const;
+        // Результат отсортирован по расстоянию
+        void queryRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                      std::vector<RayHit>& result, GLuint types = SpatialTypeAll) const;
+
+        // Обход в порядке удаления от начала луча. fun(element, type, entry) возвращает новое
+        // максимальное расстояние (например, до найденного попадания), что отсекает дальние узлы.
+        // padding расширяет боксы узлов (для поиска линий и точек с допуском)
+        template <typename F>
+        void traverseRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                         GLuint types, F fun, GLfloat padding = 0.0f) const;
+
+    private:
+        // Обход узлов, бокс которых проходит test. Для узлов, целиком проходящих inside, проверка потомков не нужна
+        template <typename Test, typename Inside>
+        void query(Test test, Inside inside, std::vector<VasnecovElement*>& result, GLuint types) const;
+        void collect(GLint node, std::vector<VasnecovElement*>& result, GLuint types) const;
+
+        GLint allocateNode();
+        void freeNode(GLint node);
+        void insertLeaf(GLint leaf);
+        void removeLeaf(GLint leaf);
+        void refitUpwards(GLint node);
+        GLint buildRecursive(std::vector<GLuint>& items, size_t begin, size_t end, GLint parent);
+        GLfloat cost() const;
+
+    private:
+        std::vector<Node> m_nodes;
+        GLint m_root;
+        GLint m_freeNodes; // Список свободных узлов через parent
+
+        std::vector<Item> m_items;
+        std::vector<VasnecovElement*> m_elements; // Параллельно m_items
+        std::unordered_map<const VasnecovElement*, GLuint> m_indices;
+
+        std::vector<GLint> m_dirty; // Листья с изменёнными боксами
+        GLuint m_commits; // Обновлений с движением после последнего перестроения
+        GLuint m_inserted; // Вставок после последнего перестроения
+        GLfloat m_rebuildCost; // Стоимость дерева после перестроения
+
+        Q_DISABLE_COPY(BoundingVolumeHierarchy)
+    };
+
+    // Статическое дерево треугольников неизменяемой геометрии (меши, поверхности) для пересечения с лучом
+    class TriangleHierarchy
+    {
+        struct Node
+        {
+            BoundingBox box;
+            GLuint first; // Первый треугольник листа
+            GLuint count; // Для внутреннего узла 0
+            GLuint right; // Левый потомок идёт следующим за узлом
+
+            Node() : box(), first(0), count(0), right(0) {}
+        };
+
+    public:
+        TriangleHierarchy();
+
+        // indices - тройки индексов вершин
+        void build(const std::vector<QVector3D>& vertices, const std::vector<GLuint>& indices);
+        void clear();
+        GLboolean isEmpty() const;
+        GLuint trianglesAmount() const;
+
+        // distance - в длинах direction, normal - ненормированная нормаль треугольника
+        GLboolean intersectRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                               GLfloat& distance, QVector3D& normal) const;
+
+    private:
+        GLuint buildRecursive(std::vector<GLuint>& triangles, std::vector<QVector3D>& centroids,
+                              size_t begin, size_t end);
+
+    private:
+        std::vector<Node> m_nodes;
+        std::vector<QVector3D> m_vertices; // По три вершины на треугольник в порядке листьев
+
+        Q_DISABLE_COPY(TriangleHierarchy)
+    };
+
+    inline GLuint BoundingVolumeHierarchy::size() const
+    {
+        return static_cast<GLuint>(m_items.size());
+    }
+    inline GLuint BoundingVolumeHierarchy::height() const
+    {
+        return m_root < 0 ? 0 : m_nodes[m_root].height;
+    }
+    inline BoundingBox BoundingVolumeHierarchy::bounds() const
+    {
+        return m_root < 0 ? BoundingBox() : m_nodes[m_root].box;
+    }
+    inline const std::vector<VasnecovElement*>& BoundingVolumeHierarchy::elements() const
+    {
+        return m_elements;
+    }
+    inline GLboolean BoundingVolumeHierarchy::contains(VasnecovElement* element) const
+    {
+        return m_indices.find(element) != m_indices.end();
+    }
+
+    inline GLboolean TriangleHierarchy::isEmpty() const
+    {
+        return m_nodes.empty();
+    }
+    inline GLuint TriangleHierarchy::trianglesAmount() const
+    {
+        return static_cast<GLuint>(m_vertices.size() / 3);
+    }
+
+    template <typename Test, typename Inside>
+    void BoundingVolumeHierarchy::query(Test test, Inside inside, std::vector<VasnecovElement*>& result, GLuint types) const
+    {
+        if(m_root < 0)
+            return;
+
+        std::vector<GLint> stack;
+        stack.reserve(64);
+        stack.push_back(m_root);
+
+        while(!stack.empty())
+        {
+            const Node& node(m_nodes[stack.back()]);
+            stack.pop_back();
+            if(!test(node.box))
+                continue;
+
+            if(node.isLeaf())
+            {
+                const Item& item(m_items[node.item]);
+                if(item.type & types)
+                    result.push_back(item.element);
+            }
+            else if(inside(node.box))
+            {
+                collect(node.left, result, types);
+                collect(node.right, result, types);
+            }
+            else
+            {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+    template <typename F>
+    void BoundingVolumeHierarchy::traverseRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                              GLuint types, F fun, GLfloat padding) const
+    {
+        if(m_root < 0)
+            return;
+
+        const QVector3D inverse(BoundingBox::inverseDirection(direction));
+        const QVector3D pad(padding, padding, padding);
+        auto intersects = [&](const BoundingBox& box, GLfloat& entry) -> GLboolean
+        {
+            if(padding <= 0.0f)
+                return box.intersectsRay(origin, inverse, maxDistance, entry);
+            if(!box.isValid())
+                return false;
+            return BoundingBox(box.minimum() - pad, box.maximum() + pad).intersectsRay(origin, inverse, maxDistance, entry);
+        };
+
+        struct Entry
+        {
+            GLint node;
+            GLfloat distance;
+        };
+        std::vector<Entry> stack;
+        stack.reserve(64);
+
+        GLfloat entry(0.0f);
+        if(!intersects(m_nodes[m_root].box, entry))
+            return;
+        stack.push_back({m_root, entry});
+
+        while(!stack.empty())
+        {
+            Entry current(stack.back());
+            stack.pop_back();
+            if(current.distance > maxDistance)
+                continue;
+
+            const Node& node(m_nodes[current.node]);
+            if(node.isLeaf())
+            {
+                const Item& item(m_items[node.item]);
+                if(item.type & types)
+                    maxDistance = fun(item.element, item.type, current.distance);
+                continue;
+            }
+
+            GLfloat leftEntry(0.0f), rightEntry(0.0f);
+            GLboolean left = intersects(m_nodes[node.left].box, leftEntry);
+            GLboolean right = intersects(m_nodes[node.right].box, rightEntry);
+
+            // Ближний потомок кладётся последним, чтобы обойти его первым
+            if(left && right)
+            {
+                if(leftEntry <= rightEntry)
+                {
+                    stack.push_back({node.right, rightEntry});
+                    stack.push_back({node.left, leftEntry});
+                }
+                else
+                {
+                    stack.push_back({node.left, leftEntry});
+                    stack.push_back({node.right, rightEntry});
+                }
+            }
+            else if(left)
+            {
+                stack.push_back({node.left, leftEntry});
+            }
+            else if(right)
+            {
+                stack.push_back({node.right, rightEntry});
+            }
+        }
+    }
+}
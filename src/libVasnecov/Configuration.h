@@ -34,9 +34,13 @@ namespace Vasnecov
     const GLboolean cfg_readFromMTL = 1; // Читать имя текстуры из мтл-библиотеки, указанной в обж
     const GLboolean cfg_sortTransparency = true;
     const GLuint cfg_elementMaxLevel = 16; // Количество максимальных уровней для ВЭлемента
+    const GLuint cfg_elementPoolBlock = 64; // Элементов одного типа в блоке пула
 
     const GLuint cfg_lampsCountMax = 8;
 
+    const GLint cfg_parallelUpdateMin = 1024; // С этого количества элементы обновляются параллельно
+    const GLint cfg_parallelUpdateChunk = 256; // Элементов на порцию потока
+
     inline timespec timeDefault() // Типа, конструктор для timespec
     {
         timespec td;
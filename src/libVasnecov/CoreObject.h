@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <QColor>
 #include "Types.h"
 #include "VasnecovPipeline.h"
 
@@ -22,13 +23,13 @@ namespace Vasnecov
     class MutualData
     {
     public:
-        MutualData(GLenum &wasUpdated, const GLenum flag) :
+        MutualData(UpdateFlags &wasUpdated, const GLenum flag) :
             m_raw(),
             m_pure(),
             m_flag(flag),
             m_wasUpdated(wasUpdated)
         {}
-        MutualData(GLenum &wasUpdated, const GLenum flag, const T &data) :
+        MutualData(UpdateFlags &wasUpdated, const GLenum flag, const T &data) :
             m_raw(data),
             m_pure(data),
             m_flag(flag),
@@ -88,24 +89,50 @@ namespace Vasnecov
         T m_raw; // Грязные данные - из внешнего потока
         T m_pure; // Чистые - для рендеринга
         const GLenum m_flag; // Флаг. Идентификатор, выдаваемый результатом синхронизации update()
-        GLenum &m_wasUpdated; // Ссылка на общий флаг обновлений
+        UpdateFlags &m_wasUpdated; // Ссылка на общий флаг обновлений
     };
 
 }
 
 class VasnecovPipeline;
+class VasnecovUniverse;
 
 namespace Vasnecov
 {
+    // Всё, что рендер читает у объекта при каждом кадре, в одной записи без ссылок.
+    // Заполняется из сырых данных при синхронизации (renderUpdateData), данные только для
+    // внешнего потока (имя, исходный цвет) в ней не хранятся
+    struct RenderState
+    {
+        enum Flags
+        {
+            Hidden      = 0x01,
+            Transparent = 0x02,
+            Scaled      = 0x04 // Масштаб отличается от 1
+        };
+
+        GLubyte color[4]; // RGBA, как для glColor4ubv
+        GLfloat scale;
+        GLuint flags;
+
+        RenderState();
+
+        GLboolean has(GLuint flag) const;
+        void assign(GLuint flag, GLboolean value);
+        void setColor(const QColor& value);
+        static GLboolean isTranslucent(const QColor& value); // По альфе упакованного цвета
+    };
+
     class CoreObject
     {
     public:
         CoreObject(VasnecovPipeline* pipeline,
                    const QString& name = QString()) :
             raw_wasUpdated(false),
+            pure_state(),
 
-            m_name(raw_wasUpdated, Name, name),
-            m_isHidden(raw_wasUpdated, Flags, false),
+            raw_name(name),
+            raw_isHidden(false),
 
             pure_pipeline(pipeline)
         {}
@@ -127,6 +154,12 @@ namespace Vasnecov
     protected:
         // Методы без мьютексов, вызываемые методами, защищенными своими мьютексами. Префикс designer
         GLboolean designerIsVisible() const;
+        // Очередь вселенной, в которую объект попадает при изменении данных
+        void designerSetUpdateQueue(UpdateQueue* queue);
+        void designerSetHidden(GLboolean hidden);
+        // Изменение сырого значения с пометкой для синхронизации. false - значение не изменилось
+        template <typename T>
+        GLboolean designerSet(T& raw, const T& value, GLenum flag);
 
     protected:
         // Методы, вызываемые на этапе обнолвения данных. Т.е. могут трогать любые данные
@@ -138,20 +171,21 @@ namespace Vasnecov
         void updaterSetUpdateFlag(GLenum flag);
         void updaterClearUpdateFlag();
         void updaterRemoveUpdateFlag(GLenum flag);
+        void updaterEnqueue(); // Обработать в ближайшем обновлении, даже без изменений
+        void updaterReleaseQueue(); // Объект обработан рендерером
 
     protected:
         // Методы, вызываемые рендерером (прямое обращение к основным данным без мьютексов). Префикс render
         // Для их сокрытия методы объявлены protected, а класс Рендерера сделан friend
-        const QString& renderName() const;
-
         GLboolean renderIsVisible() const;
         GLboolean renderIsHidden() const;
 
     protected:
-        GLenum raw_wasUpdated;
+        UpdateFlags raw_wasUpdated;
+        RenderState pure_state; // Рядом с указателем таблицы виртуальных функций, в той же строке кэша
 
-        MutualData<QString> m_name; // Наименование
-        MutualData<GLboolean> m_isHidden; // Флаг на отрисовку
+        QString raw_name; // Наименование
+        GLboolean raw_isHidden; // Флаг на отрисовку
 
         VasnecovPipeline* const pure_pipeline; // Указатель конвейера, через который ведётся отрисовка
 
@@ -160,24 +194,56 @@ namespace Vasnecov
             Flags		= 0x0001,
             Name		= 0x0002
         };
+
+        friend class ::VasnecovUniverse;
+
     private:
         Q_DISABLE_COPY(CoreObject)
     };
 
 
+    inline RenderState::RenderState() :
+        color{255, 255, 255, 255},
+        scale(1.0f),
+        flags(0)
+    {}
+    inline GLboolean RenderState::has(GLuint flag) const
+    {
+        return (flags & flag) != 0;
+    }
+    inline void RenderState::assign(GLuint flag, GLboolean value)
+    {
+        if(value)
+            flags |= flag;
+        else
+            flags &= ~flag;
+    }
+    inline void RenderState::setColor(const QColor& value)
+    {
+        QRgb rgba(value.rgba());
+        color[0] = static_cast<GLubyte>(qRed(rgba));
+        color[1] = static_cast<GLubyte>(qGreen(rgba));
+        color[2] = static_cast<GLubyte>(qBlue(rgba));
+        color[3] = static_cast<GLubyte>(qAlpha(rgba));
+    }
+    inline GLboolean RenderState::isTranslucent(const QColor& value)
+    {
+        return qAlpha(value.rgba()) < 255;
+    }
+
     inline void CoreObject::setName(const QString& name)
     {
-        m_name.set(name);
+        designerSet(raw_name, name, Name);
     }
     inline QString CoreObject::name() const
     {
-        QString name(m_name.raw());
+        QString name(raw_name);
         return name;
     }
 
     inline void CoreObject::setVisible(GLboolean visible)
     {
-        m_isHidden.set(!visible);
+        designerSetHidden(!visible);
     }
     inline void CoreObject::setHidden(GLboolean hidden)
     {
@@ -193,7 +259,7 @@ namespace Vasnecov
     }
     inline GLboolean CoreObject::isVisible() const
     {
-        GLboolean visible(!m_isHidden.raw());
+        GLboolean visible(!raw_isHidden);
         return visible;
     }
     inline GLboolean CoreObject::isHidden() const
@@ -203,7 +269,27 @@ namespace Vasnecov
 
     inline GLboolean CoreObject::designerIsVisible() const
     {
-        return !m_isHidden.raw();
+        return !raw_isHidden;
+    }
+
+    inline void CoreObject::designerSetUpdateQueue(UpdateQueue* queue)
+    {
+        raw_wasUpdated.attach(queue, this);
+    }
+    inline void CoreObject::designerSetHidden(GLboolean hidden)
+    {
+        designerSet(raw_isHidden, hidden, Flags);
+    }
+    template <typename T>
+    inline GLboolean CoreObject::designerSet(T& raw, const T& value, GLenum flag)
+    {
+        if(raw != value)
+        {
+            raw = value;
+            raw_wasUpdated |= flag;
+            return true;
+        }
+        return false;
     }
 
     inline GLenum CoreObject::renderUpdateData()
@@ -213,8 +299,8 @@ namespace Vasnecov
         if(raw_wasUpdated)
         {
             // Копирование сырых данных в основные
-            m_name.update();
-            m_isHidden.update();
+            if(raw_wasUpdated & Flags)
+                pure_state.assign(RenderState::Hidden, raw_isHidden);
 
             raw_wasUpdated = 0;
             pure_pipeline->setSomethingWasUpdated();
@@ -239,17 +325,21 @@ namespace Vasnecov
     {
         raw_wasUpdated = raw_wasUpdated &~ flag;
     }
-
-    inline const QString& CoreObject::renderName() const
+    inline void CoreObject::updaterEnqueue()
+    {
+        raw_wasUpdated.enqueue();
+    }
+    inline void CoreObject::updaterReleaseQueue()
     {
-        return m_name.pure();
+        raw_wasUpdated.release();
     }
+
     inline GLboolean CoreObject::renderIsVisible() const
     {
-        return !m_isHidden.pure();
+        return !pure_state.has(RenderState::Hidden);
     }
     inline GLboolean CoreObject::renderIsHidden() const
     {
-        return m_isHidden.pure();
+        return pure_state.has(RenderState::Hidden);
     }
 }
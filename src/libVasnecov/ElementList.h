@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <unordered_map>
 #include <vector>
 #include "Technologist.h"
 #include "VasnecovLamp.h"
@@ -26,10 +27,38 @@ class VasnecovMaterial;
 
 namespace Vasnecov
 {
-    // Обёртка контейнера списков указателей на элементы
+    // Устойчивый идентификатор элемента в контейнере. Поколение отличает удалённый элемент
+    // от занявшего его ячейку позже
+    struct ElementHandle
+    {
+        GLuint index;
+        GLuint generation;
+
+        ElementHandle() : index(0), generation(0) {}
+        ElementHandle(GLuint i, GLuint g) : index(i), generation(g) {}
+        GLboolean isValid() const {return generation != 0;}
+        bool operator==(const ElementHandle& other) const {return index == other.index && generation == other.generation;}
+        bool operator!=(const ElementHandle& other) const {return !(*this == other);}
+    };
+
+    // Обёртка контейнера списков указателей на элементы.
+    // Элементы лежат плотным массивом (удаление переносит последний на место удалённого),
+    // ячейки с поколениями дают устойчивые идентификаторы. Чистый список обновляется
+    // повтором журнала изменений, а не копированием грязного
     template <typename T>
     class ElementBox
     {
+        struct Slot
+        {
+            GLint dense; // Индекс в _raw, для свободной ячейки - следующая свободная (-1 в конце)
+            GLuint generation; // Чётное - ячейка свободна
+        };
+        struct Change
+        {
+            T* element; // Добавленный элемент, для удаления nullptr
+            GLuint index; // Индекс удалённого элемента
+        };
+
     public:
         ElementBox();
         virtual ~ElementBox(){}
@@ -37,13 +66,16 @@ namespace Vasnecov
         virtual GLboolean synchronize(); // Синхронизация чистых данных с грязными
 
         T* findElement(T* element) const;
-        virtual GLboolean addElement(T* element, GLboolean check = false);
+        T* findElement(ElementHandle handle) const;
+        ElementHandle handle(T* element) const; // Недействительный, если элемента нет
+        virtual GLboolean addElement(T* element, GLboolean check = false); // check оставлен для совместимости, дубликаты проверяются всегда
         virtual GLboolean removeElement(T* element);
         GLuint removeElements(const std::vector<T*>& deletingList);
         const std::vector<T*>& raw() const;
         const std::vector<T*>& pure() const;
         GLboolean hasPure() const;
         GLuint rawCount() const;
+        GLboolean wasUpdated() const; // Есть изменения до синхронизации
 
         template <typename F>
         void forEachPure(F fun) const
@@ -52,40 +84,69 @@ namespace Vasnecov
         }
 
     protected:
-        std::vector<T*>     _raw, _buffer, _pure;
+        std::vector<T*>     _raw, _pure;
         GLboolean           _wasUpdated;
         const GLenum        _flag; // Флаг обновления
 
     private:
+        std::vector<GLuint> m_rawSlots; // Ячейки элементов, параллельно _raw
+        std::vector<Slot> m_slots;
+        GLint m_freeSlot; // Начало списка свободных ячеек, -1 - пуст
+        std::unordered_map<const T*, GLuint> m_indices; // Ячейки по элементам
+
+        std::vector<Change> m_changes; // Журнал с последней синхронизации
+        GLboolean m_rebuildPure; // Журнал длиннее списка, проще скопировать
+
         Q_DISABLE_COPY(ElementBox)
     };
 
 
     template <typename T>
     ElementBox<T>::ElementBox() :
-        _raw(), _buffer(), _pure(),
+        _raw(), _pure(),
         _wasUpdated(false),
-        _flag()
+        _flag(),
+        m_rawSlots(),
+        m_slots(),
+        m_freeSlot(-1),
+        m_indices(),
+        m_changes(),
+        m_rebuildPure(false)
     {}
 
     template <typename T>
-    GLboolean ElementBox<T>::addElement(T *element, GLboolean check)
+    GLboolean ElementBox<T>::addElement(T *element, GLboolean /*check*/)
     {
         if(element)
         {
-            GLboolean added(true);
-            if(check)
+            // Дубликаты отсекаются всегда: поиск совмещён со вставкой в индекс
+            auto inserted(m_indices.emplace(element, 0));
+            if(inserted.second)
             {
-                // Поиск дубликатов
-                if(_raw.end() != find(_raw.begin(), _raw.end(), element))
+                GLuint slot(0);
+                if(m_freeSlot >= 0)
                 {
-                    added = false;
+                    slot = static_cast<GLuint>(m_freeSlot);
+                    m_freeSlot = m_slots[slot].dense;
                 }
-            }
-            if(added)
-            {
+                else
+                {
+                    slot = static_cast<GLuint>(m_slots.size());
+                    Slot empty = {0, 0};
+                    m_slots.push_back(empty);
+                }
+                m_slots[slot].dense = static_cast<GLint>(_raw.size());
+                ++m_slots[slot].generation;
+
                 _raw.push_back(element);
-                _buffer = _raw;
+                m_rawSlots.push_back(slot);
+                inserted.first->second = slot;
+
+                if(!m_rebuildPure)
+                {
+                    Change change = {element, 0};
+                    m_changes.push_back(change);
+                }
                 _wasUpdated = true;
                 return true;
             }
@@ -99,7 +160,28 @@ namespace Vasnecov
     {
         if(_wasUpdated)
         {
-            _pure.swap(_buffer);
+            if(m_rebuildPure)
+            {
+                _pure = _raw;
+            }
+            else
+            {
+                // Те же операции в том же порядке дают тот же плотный массив
+                for(const auto& change : m_changes)
+                {
+                    if(change.element)
+                    {
+                        _pure.push_back(change.element);
+                    }
+                    else
+                    {
+                        _pure[change.index] = _pure.back();
+                        _pure.pop_back();
+                    }
+                }
+            }
+            m_changes.clear();
+            m_rebuildPure = false;
             _wasUpdated = false;
             return true;
         }
@@ -117,6 +199,11 @@ namespace Vasnecov
         return _pure;
     }
     template <typename T>
+    GLboolean ElementBox<T>::wasUpdated() const
+    {
+        return _wasUpdated;
+    }
+    template <typename T>
     GLboolean ElementBox<T>::hasPure() const
     {
         return !_pure.empty();
@@ -132,29 +219,73 @@ namespace Vasnecov
     {
         if(element)
         {
-            if(find(_raw.begin(), _raw.end(), element) != _raw.end())
+            if(m_indices.find(element) != m_indices.end())
             {
                 return element;
             }
         }
         return nullptr;
     }
+    template <typename T>
+    T *ElementBox<T>::findElement(ElementHandle handle) const
+    {
+        if(handle.index < m_slots.size())
+        {
+            const Slot& slot(m_slots[handle.index]);
+            if(slot.generation == handle.generation && (slot.generation & 1))
+            {
+                return _raw[slot.dense];
+            }
+        }
+        return nullptr;
+    }
+    template <typename T>
+    ElementHandle ElementBox<T>::handle(T *element) const
+    {
+        typename std::unordered_map<const T*, GLuint>::const_iterator iit = m_indices.find(element);
+        if(iit != m_indices.end())
+        {
+            return ElementHandle(iit->second, m_slots[iit->second].generation);
+        }
+        return ElementHandle();
+    }
 
     template <typename T>
     GLboolean ElementBox<T>::removeElement(T *element)
     {
         if(element)
         {
-            for(typename std::vector<T *>::iterator eit = _raw.begin();
-                eit != _raw.end(); ++eit)
+            typename std::unordered_map<const T*, GLuint>::iterator iit = m_indices.find(element);
+            if(iit != m_indices.end())
             {
-                if((*eit) == element)
+                GLuint slot(iit->second);
+                GLuint index(static_cast<GLuint>(m_slots[slot].dense));
+                m_indices.erase(iit);
+
+                // Последний элемент переносится на место удалённого
+                GLuint last(m_rawSlots.back());
+                _raw[index] = _raw.back();
+                _raw.pop_back();
+                m_rawSlots[index] = last;
+                m_rawSlots.pop_back();
+                m_slots[last].dense = static_cast<GLint>(index);
+
+                ++m_slots[slot].generation;
+                m_slots[slot].dense = m_freeSlot;
+                m_freeSlot = static_cast<GLint>(slot);
+
+                if(!m_rebuildPure)
                 {
-                    _raw.erase(eit);
-                    _buffer = _raw;
-                    _wasUpdated = true;
-                    return true;
+                    Change change = {nullptr, index};
+                    m_changes.push_back(change);
+                    if(m_changes.size() > _raw.size())
+                    {
+                        m_changes.clear();
+                        m_rebuildPure = true;
+                    }
                 }
+                _wasUpdated = true;
+                return true;
             }
         }
 
@@ -206,6 +337,18 @@ namespace Vasnecov
         VasnecovTerrain* findRawElement(VasnecovTerrain* element) const {return _terrains.findElement(element);}
         VasnecovLabel* findRawElement(VasnecovLabel* element) const     {return _labels.findElement(element);}
 
+        Vasnecov::ElementHandle handle(VasnecovLamp* element) const       {return _lamps.handle(element);}
+        Vasnecov::ElementHandle handle(VasnecovProduct* element) const    {return _products.handle(element);}
+        Vasnecov::ElementHandle handle(VasnecovFigure* element) const     {return _figures.handle(element);}
+        Vasnecov::ElementHandle handle(VasnecovTerrain* element) const    {return _terrains.handle(element);}
+        Vasnecov::ElementHandle handle(VasnecovLabel* element) const      {return _labels.handle(element);}
+
+        VasnecovLamp* rawLamp(Vasnecov::ElementHandle handle) const         {return _lamps.findElement(handle);}
+        VasnecovProduct* rawProduct(Vasnecov::ElementHandle handle) const   {return _products.findElement(handle);}
+        VasnecovFigure* rawFigure(Vasnecov::ElementHandle handle) const     {return _figures.findElement(handle);}
+        VasnecovTerrain* rawTerrain(Vasnecov::ElementHandle handle) const   {return _terrains.findElement(handle);}
+        VasnecovLabel* rawLabel(Vasnecov::ElementHandle handle) const       {return _labels.findElement(handle);}
+
         GLboolean addElement(VasnecovLamp* element, GLboolean check = false)    {return _lamps.addElement(element, check);}
         GLboolean addElement(VasnecovProduct* element, GLboolean check = false) {return _products.addElement(element, check);}
         GLboolean addElement(VasnecovFigure* element, GLboolean check = false)  {return _figures.addElement(element, check);}
@@ -277,6 +420,14 @@ namespace Vasnecov
 
             return res;
         }
+        virtual GLboolean wasUpdated() const
+        {
+            return _lamps.wasUpdated() ||
+                   _products.wasUpdated() ||
+                   _figures.wasUpdated() ||
+                   _terrains.wasUpdated() ||
+                   _labels.wasUpdated();
+        }
 
     protected:
         C<ELamp>    _lamps;
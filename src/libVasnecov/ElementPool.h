@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Размещение элементов одного типа блоками
+#pragma once
+
+#include <map>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Configuration.h"
+
+namespace Vasnecov
+{
+    // Пул объектов одного (точного) типа. Объекты размещаются подряд в блоках по blockSize штук,
+    // поэтому созданные вместе лежат рядом. Освобождённые ячейки занимаются повторно. Опустевший блок
+    // возвращается системе, один пустой блок остаётся в запасе
+    template <typename T>
+    class ElementPool
+    {
+        union Slot
+        {
+            Slot* next; // Для свободной ячейки - следующая свободная
+            typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        };
+        struct Block
+        {
+            std::unique_ptr<Slot[]> memory;
+            GLuint used; // Занятые когда-либо ячейки
+            GLuint live;
+            Slot* free;
+            GLuint partial; // Индекс в m_partial, если есть свободные ячейки
+        };
+
+    public:
+        explicit ElementPool(GLuint blockSize = cfg_elementPoolBlock);
+        ~ElementPool(); // Живые объекты к этому моменту уничтожены владельцем
+
+        template <typename... Args>
+        T* create(Args&&... args);
+        void destroy(T* object); // Объект должен быть создан этим пулом
+
+        GLuint liveCount() const;
+        GLuint capacity() const;
+
+    private:
+        void* allocate();
+        void release(typename std::map<const Slot*, std::unique_ptr<Block>>::iterator block);
+
+    private:
+        const GLuint m_blockSize;
+        std::map<const Slot*, std::unique_ptr<Block>> m_blocks; // По началу блока
+        std::vector<Block*> m_partial; // Блоки со свободными ячейками
+        Block* m_spare; // Пустой блок в запасе
+        GLuint m_live;
+
+        Q_DISABLE_COPY(ElementPool)
+    };
+
+
+    template <typename T>
+    ElementPool<T>::ElementPool(GLuint blockSize) :
+        m_blockSize(blockSize > 0 ? blockSize : 1),
+        m_blocks(),
+        m_partial(),
+        m_spare(nullptr),
+        m_live(0)
+    {}
+
+    template <typename T>
+    ElementPool<T>::~ElementPool()
+    {
+    }
+
+    template <typename T>
+    template <typename... Args>
+    T* ElementPool<T>::create(Args&&... args)
+    {
+        void* memory(allocate());
+        ++m_live;
+        return new(memory) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    void ElementPool<T>::destroy(T* object)
+    {
+        if(!object)
+            return;
+
+        object->~T();
+        --m_live;
+
+        // Блок ячейки - последний, начинающийся не дальше неё
+        Slot* slot(reinterpret_cast<Slot*>(object));
+        auto it(m_blocks.upper_bound(slot));
+        --it;
+        Block* block(it->second.get());
+
+        if(block->live == m_blockSize)
+        {
+            block->partial = static_cast<GLuint>(m_partial.size());
+            m_partial.push_back(block);
+        }
+        slot->next = block->free;
+        block->free = slot;
+
+        if(--block->live == 0)
+        {
+            if(m_spare)
+            {
+                release(it);
+                return;
+            }
+            // Следующие объекты снова лягут подряд
+            block->used = 0;
+            block->free = nullptr;
+            m_spare = block;
+        }
+    }
+
+    template <typename T>
+    inline GLuint ElementPool<T>::liveCount() const
+    {
+        return m_live;
+    }
+    template <typename T>
+    inline GLuint ElementPool<T>::capacity() const
+    {
+        return static_cast<GLuint>(m_blocks.size()) * m_blockSize;
+    }
+
+    template <typename T>
+    void* ElementPool<T>::allocate()
+    {
+        if(m_partial.empty())
+        {
+            std::unique_ptr<Block> block(new Block());
+            block->memory.reset(new Slot[m_blockSize]);
+            block->used = 0;
+            block->live = 0;
+            block->free = nullptr;
+            block->partial = 0;
+            m_partial.push_back(block.get());
+            m_blocks.emplace(block->memory.get(), std::move(block));
+        }
+
+        Block* block(m_partial.back());
+        Slot* slot(block->free);
+        if(slot)
+            block->free = slot->next;
+        else
+            slot = &block->memory[block->used++];
+
+        if(++block->live == m_blockSize)
+            m_partial.pop_back();
+        if(block == m_spare)
+            m_spare = nullptr;
+
+        return &slot->storage;
+    }
+
+    template <typename T>
+    void ElementPool<T>::release(typename std::map<const Slot*, std::unique_ptr<Block>>::iterator block)
+    {
+        // Пустой блок всегда в m_partial: перестановка последнего на его место
+        Block* last(m_partial.back());
+        last->partial = block->second->partial;
+        m_partial[last->partial] = last;
+        m_partial.pop_back();
+
+        m_blocks.erase(block);
+    }
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "FrameCapture.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "Technologist.h"
+#include "Tracer.h"
+
+Vasnecov::CapturedFramesQueue::CapturedFramesQueue() :
+    m_frames(cfg_captureQueueSize + 1),
+    m_head(0),
+    m_tail(0)
+{}
+
+GLboolean Vasnecov::CapturedFramesQueue::push(CapturedFrame& frame, GLuint limit)
+{
+    if(size() >= std::min(limit, cfg_captureQueueSize))
+        return false;
+
+    GLuint head = m_head.load(std::memory_order_relaxed);
+    m_frames[head] = std::move(frame);
+    m_head.store((head + 1) % m_frames.size(), std::memory_order_release);
+    return true;
+}
+
+GLboolean Vasnecov::CapturedFramesQueue::pop(CapturedFrame& frame)
+{
+    GLuint tail = m_tail.load(std::memory_order_relaxed);
+    if(tail == m_head.load(std::memory_order_acquire))
+        return false;
+
+    frame = std::move(m_frames[tail]);
+    m_frames[tail] = CapturedFrame();
+    m_tail.store((tail + 1) % m_frames.size(), std::memory_order_release);
+    return true;
+}
+
+GLuint Vasnecov::CapturedFramesQueue::size() const
+{
+    GLuint head = m_head.load(std::memory_order_acquire);
+    GLuint tail = m_tail.load(std::memory_order_acquire);
+    return (head + m_frames.size() - tail) % m_frames.size();
+}
+
+Vasnecov::FrameCapture::FrameCapture() :
+    m_parameters(),
+    m_slots(),
+    m_width(0),
+    m_height(0),
+    m_frame(0),
+    m_supported(true),
+    m_queue(),
+    m_dropped(0)
+{}
+
+Vasnecov::FrameCapture::~FrameCapture()
+{
+}
+
+void Vasnecov::FrameCapture::setParameters(const CaptureParameters& parameters)
+{
+    m_parameters = parameters;
+    if(m_parameters.downscale < 1)
+        m_parameters.downscale = 1;
+    if(m_parameters.queueSize < 1)
+        m_parameters.queueSize = 1;
+}
+
+void Vasnecov::FrameCapture::renderCapture(GLsizei width, GLsizei height)
+{
+    if(!m_parameters.enabled)
+    {
+        if(!m_slots.empty())
+        {
+            // Последние кадры захвата ещё в буферах
+            renderDrain();
+            renderRelease();
+        }
+        return;
+    }
+    if(!m_supported || width <= 0 || height <= 0)
+        return;
+
+    VASNECOV_TRACE("capture", "render");
+
+    if(m_slots.empty() || width != m_width || height != m_height)
+    {
+        renderDrain();
+        renderRelease();
+        if(!renderAllocate(width, height))
+        {
+            Vasnecov::problem("Can't create pixel buffers for frame capture");
+            m_supported = false;
+            return;
+        }
+    }
+
+    // Чтение кадра, отправленного cfg_captureRingSize кадров назад. К этому времени он уже готов.
+    Slot& slot(m_slots[m_frame % m_slots.size()]);
+    if(slot.pending)
+        renderCollect(slot);
+
+    // Если очередь не разбирают, новые кадры даже не читаются
+    if(!m_parameters.callback)
+    {
+        GLuint pending(0);
+        for(const auto& s : m_slots)
+            pending += s.pending;
+
+        if(m_queue.size() + pending >= std::min(m_parameters.queueSize, cfg_captureQueueSize))
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            ++m_frame;
+            return;
+        }
+    }
+
+    slot.buffer.bind();
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, m_width, m_height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, nullptr);
+    slot.buffer.release();
+
+    slot.pending = true;
+    slot.frame = m_frame;
+    slot.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch()).count();
+    ++m_frame;
+}
+
+GLboolean Vasnecov::FrameCapture::take(CapturedFrame& frame)
+{
+    return m_queue.pop(frame);
+}
+
+GLboolean Vasnecov::FrameCapture::renderAllocate(GLsizei width, GLsizei height)
+{
+    m_width = width;
+    m_height = height;
+    m_slots.resize(cfg_captureRingSize);
+
+    for(auto& slot : m_slots)
+    {
+        if(!slot.buffer.create())
+        {
+            m_slots.clear();
+            return false;
+        }
+        slot.buffer.setUsagePattern(QOpenGLBuffer::StreamRead);
+        slot.buffer.bind();
+        slot.buffer.allocate(width * height * 4);
+        slot.buffer.release();
+    }
+    return true;
+}
+
+void Vasnecov::FrameCapture::renderRelease()
+{
+    for(auto& slot : m_slots)
+    {
+        if(slot.pending)
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        slot.buffer.destroy();
+    }
+    m_slots.clear();
+}
+
+void Vasnecov::FrameCapture::renderDrain()
+{
+    // Самый старый кадр - в ячейке следующего
+    for(size_t i = 0; i < m_slots.size(); ++i)
+    {
+        Slot& slot(m_slots[(m_frame + i) % m_slots.size()]);
+        if(slot.pending)
+            renderCollect(slot);
+    }
+}
+
+void Vasnecov::FrameCapture::renderCollect(Slot& slot)
+{
+    slot.pending = false;
+
+    slot.buffer.bind();
+    const uchar* data = static_cast<const uchar*>(slot.buffer.map(QOpenGLBuffer::ReadOnly));
+    if(!data)
+    {
+        slot.buffer.release();
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const GLuint scale(m_parameters.downscale);
+    const GLsizei width(m_width / scale);
+    const GLsizei height(m_height / scale);
+    const size_t srcLine(static_cast<size_t>(m_width) * 4);
+
+    CapturedFrame frame;
+    frame.frame = slot.frame;
+    frame.timestamp = slot.timestamp;
+    frame.image = QImage(std::max(width, 1), std::max(height, 1), QImage::Format_RGB32);
+
+    // Строки OpenGL идут снизу вверх
+    if(scale == 1)
+    {
+        for(GLsizei y = 0; y < height; ++y)
+        {
+            QRgb* dst = reinterpret_cast<QRgb*>(frame.image.scanLine(y));
+            std::memcpy(dst, data + (m_height - 1 - y) * srcLine, srcLine);
+            for(GLsizei x = 0; x < width; ++x)
+                dst[x] |= 0xFF000000;
+        }
+    }
+    else
+    {
+        const GLuint area(scale * scale);
+        for(GLsizei y = 0; y < height; ++y)
+        {
+            QRgb* dst = reinterpret_cast<QRgb*>(frame.image.scanLine(y));
+            for(GLsizei x = 0; x < width; ++x)
+            {
+                GLuint sum[3] = {0, 0, 0};
+                for(GLuint sy = 0; sy < scale; ++sy)
+                {
+                    const uchar* src = data + (m_height - 1 - (y * scale + sy)) * srcLine + x * scale * 4;
+                    for(GLuint sx = 0; sx < scale; ++sx, src += 4)
+                    {
+                        sum[0] += src[0];
+                        sum[1] += src[1];
+                        sum[2] += src[2];
+                    }
+                }
+                dst[x] = 0xFF000000 | ((sum[2] / area) << 16) | ((sum[1] / area) << 8) | (sum[0] / area);
+            }
+        }
+    }
+
+    slot.buffer.unmap();
+    slot.buffer.release();
+
+    deliver(frame);
+}
+
+void Vasnecov::FrameCapture::deliver(CapturedFrame& frame)
+{
+    if(m_parameters.callback)
+    {
+        m_parameters.callback(frame);
+    }
+    else if(!m_queue.push(frame, m_parameters.queueSize))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Асинхронный захват кадров через кольцо PBO
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <QImage>
+#include <QOpenGLBuffer>
+#include "Types.h"
+
+namespace Vasnecov
+{
+    const GLuint cfg_captureRingSize = 3; // Количество PBO (задержка чтения в кадрах)
+    const GLuint cfg_captureQueueSize = 8; // Максимальная ёмкость очереди готовых кадров
+
+    struct CapturedFrame
+    {
+        quint64 frame; // Номер захваченного кадра
+        qint64 timestamp; // Время отрисовки, нс (монотонные часы)
+        QImage image;
+
+        CapturedFrame() : frame(0), timestamp(0), image() {}
+    };
+
+    struct CaptureParameters
+    {
+        GLboolean enabled;
+        GLuint downscale; // Уменьшение в downscale раз (усреднение блоков)
+        GLuint queueSize; // Не больше cfg_captureQueueSize
+        // Вызывается в потоке отрисовки вместо помещения в очередь
+        std::function<void(const CapturedFrame&)> callback;
+
+        CaptureParameters() :
+            enabled(false),
+            downscale(1),
+            queueSize(cfg_captureQueueSize),
+            callback()
+        {}
+    };
+
+    // Очередь без блокировок: один писатель (поток отрисовки), один читатель
+    class CapturedFramesQueue
+    {
+    public:
+        CapturedFramesQueue();
+
+        GLboolean push(CapturedFrame& frame, GLuint limit);
+        GLboolean pop(CapturedFrame& frame);
+        GLuint size() const;
+
+    private:
+        std::vector<CapturedFrame> m_frames;
+        std::atomic<GLuint> m_head; // Позиция записи
+        std::atomic<GLuint> m_tail; // Позиция чтения
+
+        Q_DISABLE_COPY(CapturedFramesQueue)
+    };
+
+    class FrameCapture
+    {
+        struct Slot
+        {
+            QOpenGLBuffer buffer;
+            GLboolean pending;
+            quint64 frame;
+            qint64 timestamp;
+
+            Slot() : buffer(QOpenGLBuffer::PixelPackBuffer), pending(false), frame(0), timestamp(0) {}
+        };
+
+    public:
+        FrameCapture();
+        ~FrameCapture();
+
+        void setParameters(const CaptureParameters& parameters);
+        GLboolean isEnabled() const;
+
+        // Вызывается в потоке отрисовки после отрисовки кадра
+        void renderCapture(GLsizei width, GLsizei height);
+
+        GLboolean take(CapturedFrame& frame);
+        quint64 droppedFrames() const;
+
+    private:
+        GLboolean renderAllocate(GLsizei width, GLsizei height);
+        void renderRelease(); // Неразобранные кадры считаются потерянными
+        void renderDrain(); // Чтение всех отправленных кадров по порядку
+        void renderCollect(Slot& slot);
+        void deliver(CapturedFrame& frame);
+
+    private:
+        CaptureParameters m_parameters;
+        std::vector<Slot> m_slots;
+        GLsizei m_width;
+        GLsizei m_height;
+        quint64 m_frame;
+        GLboolean m_supported;
+
+        CapturedFramesQueue m_queue;
+        std::atomic<quint64> m_dropped;
+
+        Q_DISABLE_COPY(FrameCapture)
+    };
+
+    inline GLboolean FrameCapture::isEnabled() const
+    {
+        return m_parameters.enabled;
+    }
+    inline quint64 FrameCapture::droppedFrames() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+}
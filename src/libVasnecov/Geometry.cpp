@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "Geometry.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+Vasnecov::BoundingBox::BoundingBox() :
+    m_min(),
+    m_max(),
+    m_valid(false)
+{}
+
+Vasnecov::BoundingBox::BoundingBox(const QVector3D& minimum, const QVector3D& maximum) :
+    m_min(minimum),
+    m_max(maximum),
+    m_valid(true)
+{}
+
+void Vasnecov::BoundingBox::add(const QVector3D& point)
+{
+    if(!m_valid)
+    {
+        m_min = point;
+        m_max = point;
+        m_valid = true;
+        return;
+    }
+
+    m_min.setX(std::min(m_min.x(), point.x()));
+    m_min.setY(std::min(m_min.y(), point.y()));
+    m_min.setZ(std::min(m_min.z(), point.z()));
+    m_max.setX(std::max(m_max.x(), point.x()));
+    m_max.setY(std::max(m_max.y(), point.y()));
+    m_max.setZ(std::max(m_max.z(), point.z()));
+}
+
+void Vasnecov::BoundingBox::add(const BoundingBox& box)
+{
+    if(!box.m_valid)
+        return;
+
+    add(box.m_min);
+    add(box.m_max);
+}
+
+void Vasnecov::BoundingBox::add(const std::vector<QVector3D>& points)
+{
+    for(const auto& point : points)
+        add(point);
+}
+
+Vasnecov::BoundingBox Vasnecov::BoundingBox::transformed(const QMatrix4x4& matrix) const
+{
+    if(!m_valid)
+        return BoundingBox();
+
+    // Центр переносится матрицей, полуразмеры - модулями элементов поворотной части
+    const QVector3D c(center());
+    const QVector3D e(extents());
+
+    QVector3D newCenter, newExtents;
+    for(int i = 0; i < 3; ++i)
+    {
+        newCenter[i] = matrix(i, 0) * c.x() + matrix(i, 1) * c.y() + matrix(i, 2) * c.z() + matrix(i, 3);
+        newExtents[i] = std::abs(matrix(i, 0)) * e.x() + std::abs(matrix(i, 1)) * e.y() + std::abs(matrix(i, 2)) * e.z();
+    }
+
+    return BoundingBox(newCenter - newExtents, newCenter + newExtents);
+}
+
+GLboolean Vasnecov::BoundingBox::contains(const QVector3D& point) const
+{
+    return m_valid &&
+           point.x() >= m_min.x() && point.x() <= m_max.x() &&
+           point.y() >= m_min.y() && point.y() <= m_max.y() &&
+           point.z() >= m_min.z() && point.z() <= m_max.z();
+}
+
+GLboolean Vasnecov::BoundingBox::contains(const BoundingBox& other) const
+{
+    return m_valid && other.m_valid &&
+           other.m_min.x() >= m_min.x() && other.m_max.x() <= m_max.x() &&
+           other.m_min.y() >= m_min.y() && other.m_max.y() <= m_max.y() &&
+           other.m_min.z() >= m_min.z() && other.m_max.z() <= m_max.z();
+}
+
+GLboolean Vasnecov::BoundingBox::intersects(const BoundingBox& other) const
+{
+    return m_valid && other.m_valid &&
+           m_min.x() <= other.m_max.x() && m_max.x() >= other.m_min.x() &&
+           m_min.y() <= other.m_max.y() && m_max.y() >= other.m_min.y() &&
+           m_min.z() <= other.m_max.z() && m_max.z() >= other.m_min.z();
+}
+
+GLboolean Vasnecov::BoundingBox::intersectsSphere(const QVector3D& center, GLfloat radius) const
+{
+    if(!m_valid)
+        return false;
+
+    // Квадрат расстояния от центра сферы до ближайшей точки бокса
+    GLfloat distance(0.0f);
+    for(int i = 0; i < 3; ++i)
+    {
+        GLfloat value(center[i]);
+        if(value < m_min[i])
+            distance += (m_min[i] - value) * (m_min[i] - value);
+        else if(value > m_max[i])
+            distance += (value - m_max[i]) * (value - m_max[i]);
+    }
+    return distance <= radius * radius;
+}
+
+GLboolean Vasnecov::BoundingBox::intersectsRay(const QVector3D& origin, const QVector3D& inverseDirection,
+                                               GLfloat maxDistance, GLfloat& entry) const
+{
+    if(!m_valid)
+        return false;
+
+    // Метод плит
+    GLfloat tMin(0.0f), tMax(maxDistance);
+    for(int i = 0; i < 3; ++i)
+    {
+        GLfloat t1 = (m_min[i] - origin[i]) * inverseDirection[i];
+        GLfloat t2 = (m_max[i] - origin[i]) * inverseDirection[i];
+        if(t1 > t2)
+            std::swap(t1, t2);
+
+        // NaN (0 * inf) не сужает интервал
+        if(t1 > tMin)
+            tMin = t1;
+        if(t2 < tMax)
+            tMax = t2;
+        if(tMin > tMax)
+            return false;
+    }
+
+    entry = tMin;
+    return true;
+}
+
+QVector3D Vasnecov::BoundingBox::inverseDirection(const QVector3D& direction)
+{
+    const GLfloat infinity(std::numeric_limits<GLfloat>::infinity());
+    return QVector3D(direction.x() != 0.0f ? 1.0f / direction.x() : infinity,
+                     direction.y() != 0.0f ? 1.0f / direction.y() : infinity,
+                     direction.z() != 0.0f ? 1.0f / direction.z() : infinity);
+}
+
+GLboolean Vasnecov::intersectTriangle(const QVector3D& origin, const QVector3D& direction,
+                                      const QVector3D& a, const QVector3D& b, const QVector3D& c,
+                                      GLfloat& distance)
+{
+    // Möller, Trumbore
+    const QVector3D edge1(b - a);
+    const QVector3D edge2(c - a);
+    const QVector3D p(QVector3D::crossProduct(direction, edge2));
+    const GLfloat det(QVector3D::dotProduct(edge1, p));
+    if(std::abs(det) < std::numeric_limits<GLfloat>::min())
+        return false;
+
+    const GLfloat invDet(1.0f / det);
+    const QVector3D s(origin - a);
+    const GLfloat u(QVector3D::dotProduct(s, p) * invDet);
+    if(u < 0.0f || u > 1.0f)
+        return false;
+
+    const QVector3D q(QVector3D::crossProduct(s, edge1));
+    const GLfloat v(QVector3D::dotProduct(direction, q) * invDet);
+    if(v < 0.0f || u + v > 1.0f)
+        return false;
+
+    distance = QVector3D::dotProduct(edge2, q) * invDet;
+    return distance >= 0.0f;
+}
+
+GLfloat Vasnecov::closestToSegment(const QVector3D& origin, const QVector3D& direction,
+                                   const QVector3D& a, const QVector3D& b,
+                                   GLfloat& rayParameter, QVector3D& segmentPoint)
+{
+    const QVector3D segment(b - a);
+    const QVector3D r(origin - a);
+    const GLfloat dd(QVector3D::dotProduct(direction, direction));
+    const GLfloat ss(QVector3D::dotProduct(segment, segment));
+    const GLfloat ds(QVector3D::dotProduct(direction, segment));
+    const GLfloat dr(QVector3D::dotProduct(direction, r));
+    const GLfloat sr(QVector3D::dotProduct(segment, r));
+
+    auto clamp = [](GLfloat value) -> GLfloat
+    {
+        return std::min(1.0f, std::max(0.0f, value));
+    };
+
+    GLfloat t(0.0f), s(0.0f);
+    if(ss <= std::numeric_limits<GLfloat>::min()) // Отрезок вырожден в точку
+    {
+        t = dd > 0.0f ? clamp(-dr / dd) : 0.0f;
+    }
+    else
+    {
+        GLfloat denominator(dd * ss - ds * ds);
+        t = denominator > 0.0f ? clamp((ds * sr - dr * ss) / denominator) : 0.0f;
+        s = clamp((ds * t + sr) / ss);
+        // Уточнение параметра луча после ограничения отрезка
+        t = dd > 0.0f ? clamp((ds * s - dr) / dd) : 0.0f;
+    }
+
+    rayParameter = t;
+    segmentPoint = a + segment * s;
+    QVector3D difference(origin + direction * t - segmentPoint);
+    return QVector3D::dotProduct(difference, difference);
+}
+
+void Vasnecov::projectBoxes(const QMatrix4x4& matrixPV, const std::vector<BoundingBox>& boxes,
+                            std::vector<ProjectedBounds>& result)
+{
+    const size_t amount(boxes.size());
+    result.resize(amount);
+    if(amount == 0)
+        return;
+
+    // Углы раскладываются по отдельным массивам координат
+    const size_t corners(amount * 8);
+    std::vector<GLfloat> xs(corners), ys(corners), zs(corners);
+    for(size_t i = 0; i < amount; ++i)
+    {
+        const QVector3D& lo(boxes[i].minimum());
+        const QVector3D& hi(boxes[i].maximum());
+        for(size_t c = 0; c < 8; ++c)
+        {
+            xs[i * 8 + c] = (c & 1) ? hi.x() : lo.x();
+            ys[i * 8 + c] = (c & 2) ? hi.y() : lo.y();
+            zs[i * 8 + c] = (c & 4) ? hi.z() : lo.z();
+        }
+    }
+
+    const GLfloat m00(matrixPV(0, 0)), m01(matrixPV(0, 1)), m02(matrixPV(0, 2)), m03(matrixPV(0, 3));
+    const GLfloat m10(matrixPV(1, 0)), m11(matrixPV(1, 1)), m12(matrixPV(1, 2)), m13(matrixPV(1, 3));
+    const GLfloat m30(matrixPV(3, 0)), m31(matrixPV(3, 1)), m32(matrixPV(3, 2)), m33(matrixPV(3, 3));
+
+    std::vector<GLfloat> px(corners), py(corners), pw(corners);
+    const GLfloat* x(xs.data());
+    const GLfloat* y(ys.data());
+    const GLfloat* z(zs.data());
+    GLfloat* outX(px.data());
+    GLfloat* outY(py.data());
+    GLfloat* outW(pw.data());
+
+#pragma omp simd
+    for(size_t i = 0; i < corners; ++i)
+    {
+        GLfloat w = m30 * x[i] + m31 * y[i] + m32 * z[i] + m33;
+        // max(w, eps) без ветвления, иначе цикл не векторизуется
+        GLfloat clamped = 0.5f * (w + cfg_projectionEpsilon + std::fabs(w - cfg_projectionEpsilon));
+        GLfloat inverse = 1.0f / clamped;
+        outX[i] = (m00 * x[i] + m01 * y[i] + m02 * z[i] + m03) * inverse;
+        outY[i] = (m10 * x[i] + m11 * y[i] + m12 * z[i] + m13) * inverse;
+        outW[i] = w;
+    }
+
+    for(size_t i = 0; i < amount; ++i)
+    {
+        ProjectedBounds& bounds(result[i]);
+        bounds.minX = bounds.minY = std::numeric_limits<GLfloat>::max();
+        bounds.maxX = bounds.maxY = -std::numeric_limits<GLfloat>::max();
+        bounds.clipped = !boxes[i].isValid();
+
+        for(size_t c = i * 8; c < i * 8 + 8; ++c)
+        {
+            bounds.minX = std::min(bounds.minX, px[c]);
+            bounds.maxX = std::max(bounds.maxX, px[c]);
+            bounds.minY = std::min(bounds.minY, py[c]);
+            bounds.maxY = std::max(bounds.maxY, py[c]);
+            if(pw[c] <= cfg_projectionEpsilon)
+                bounds.clipped = true;
+        }
+    }
+}
+
+Vasnecov::Frustum::Frustum() :
+    m_planes()
+{}
+
+Vasnecov::Frustum::Frustum(const QMatrix4x4& matrixPV) :
+    m_planes()
+{
+    set(matrixPV);
+}
+
+void Vasnecov::Frustum::set(const QMatrix4x4& matrixPV)
+{
+    // Плоскости отсечения извлекаются из строк матрицы (Gribb, Hartmann)
+    const QVector4D r0(matrixPV.row(0));
+    const QVector4D r1(matrixPV.row(1));
+    const QVector4D r2(matrixPV.row(2));
+    const QVector4D r3(matrixPV.row(3));
+
+    m_planes[PlaneLeft]   = r3 + r0;
+    m_planes[PlaneRight]  = r3 - r0;
+    m_planes[PlaneBottom] = r3 + r1;
+    m_planes[PlaneTop]    = r3 - r1;
+    m_planes[PlaneNear]   = r3 + r2;
+    m_planes[PlaneFar]    = r3 - r2;
+
+    for(auto& plane : m_planes)
+    {
+        GLfloat length = plane.toVector3D().length();
+        if(length > 0.0f)
+            plane /= length;
+    }
+}
+
+GLboolean Vasnecov::Frustum::contains(const QVector3D& point) const
+{
+    for(const auto& plane : m_planes)
+    {
+        if(plane.x() * point.x() + plane.y() * point.y() + plane.z() * point.z() + plane.w() < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+GLboolean Vasnecov::Frustum::contains(const BoundingBox& box) const
+{
+    if(!box.isValid())
+        return false;
+
+    const QVector3D c(box.center());
+    const QVector3D e(box.extents());
+
+    for(const auto& plane : m_planes)
+    {
+        GLfloat distance = plane.x() * c.x() + plane.y() * c.y() + plane.z() * c.z() + plane.w();
+        GLfloat radius = std::abs(plane.x()) * e.x() + std::abs(plane.y()) * e.y() + std::abs(plane.z()) * e.z();
+        if(distance - radius < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+GLboolean Vasnecov::Frustum::intersects(const BoundingBox& box) const
+{
+    if(!box.isValid())
+        return false;
+
+    const QVector3D c(box.center());
+    const QVector3D e(box.extents());
+
+    // Бокс снаружи, если он целиком позади хотя бы одной плоскости.
+    // Консервативно: бокс у ребра пирамиды может пройти проверку, не попадая в неё.
+    for(const auto& plane : m_planes)
+    {
+        GLfloat distance = plane.x() * c.x() + plane.y() * c.y() + plane.z() * c.z() + plane.w();
+        GLfloat radius = std::abs(plane.x()) * e.x() + std::abs(plane.y()) * e.y() + std::abs(plane.z()) * e.z();
+        if(distance + radius < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+void Vasnecov::PoseArrays::resize(size_t size)
+{
+    px.resize(size);
+    py.resize(size);
+    pz.resize(size);
+    qx.resize(size);
+    qy.resize(size);
+    qz.resize(size);
+    qw.resize(size);
+    for(auto& row : rotation)
+        row.resize(size);
+}
+
+void Vasnecov::PoseArrays::set(size_t index, const QVector3D& position, const QQuaternion& orientation)
+{
+    px[index] = position.x();
+    py[index] = position.y();
+    pz[index] = position.z();
+    qx[index] = orientation.x();
+    qy[index] = orientation.y();
+    qz[index] = orientation.z();
+    qw[index] = orientation.scalar();
+}
+
+QMatrix4x4 Vasnecov::PoseArrays::matrix(size_t index) const
+{
+    return QMatrix4x4(rotation[0][index], rotation[1][index], rotation[2][index], px[index],
+                      rotation[3][index], rotation[4][index], rotation[5][index], py[index],
+                      rotation[6][index], rotation[7][index], rotation[8][index], pz[index],
+                      0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+void Vasnecov::composeRotations(PoseArrays& poses, size_t count)
+{
+    const GLfloat* x(poses.qx.data());
+    const GLfloat* y(poses.qy.data());
+    const GLfloat* z(poses.qz.data());
+    const GLfloat* w(poses.qw.data());
+    GLfloat* r[9];
+    for(size_t i = 0; i < 9; ++i)
+        r[i] = poses.rotation[i].data();
+
+#pragma omp simd
+    for(size_t i = 0; i < count; ++i)
+    {
+        GLfloat norm = x[i] * x[i] + y[i] * y[i] + z[i] * z[i] + w[i] * w[i];
+        // Без ветвления: нулевой кватернион даёт нулевые произведения
+        GLfloat s = 2.0f / (norm + std::numeric_limits<GLfloat>::min());
+
+        GLfloat xx = x[i] * x[i] * s, yy = y[i] * y[i] * s, zz = z[i] * z[i] * s;
+        GLfloat xy = x[i] * y[i] * s, xz = x[i] * z[i] * s, yz = y[i] * z[i] * s;
+        GLfloat wx = w[i] * x[i] * s, wy = w[i] * y[i] * s, wz = w[i] * z[i] * s;
+
+        r[0][i] = 1.0f - (yy + zz);
+        r[1][i] = xy - wz;
+        r[2][i] = xz + wy;
+        r[3][i] = xy + wz;
+        r[4][i] = 1.0f - (xx + zz);
+        r[5][i] = yz - wx;
+        r[6][i] = xz - wy;
+        r[7][i] = yz + wx;
+        r[8][i] = 1.0f - (xx + yy);
+    }
+}
+
+QVector3D Vasnecov::anglesFromOrientation(const QQuaternion& orientation)
+{
+    QQuaternion q(orientation.normalized());
+    const GLfloat x(q.x()), y(q.y()), z(q.z()), w(q.scalar());
+
+    const GLfloat m00 = 1.0f - 2.0f * (y * y + z * z);
+    const GLfloat m02 = 2.0f * (x * z + w * y);
+    const GLfloat m10 = 2.0f * (x * y + w * z);
+    const GLfloat m12 = 2.0f * (y * z - w * x);
+    const GLfloat m20 = 2.0f * (x * z - w * y);
+    const GLfloat m21 = 2.0f * (y * z + w * x);
+    const GLfloat m22 = 1.0f - 2.0f * (x * x + y * y);
+
+    // R = Rz * Rx * Ry: m21 = sin(ax), m20 = -cos(ax)sin(ay), m22 = cos(ax)cos(ay).
+    // Угол Z берётся из R * Ry(-ay) = Rz * Rx, что устойчиво и при cos(ax), близком к нулю
+    GLfloat ax = std::atan2(m21, std::sqrt(m20 * m20 + m22 * m22));
+    GLfloat ay = std::atan2(-m20, m22);
+    GLfloat cy = std::cos(ay), sy = std::sin(ay);
+    GLfloat az = std::atan2(m10 * cy + m12 * sy, m00 * cy + m02 * sy);
+
+    return QVector3D(ax, ay, az) * c_radToDeg;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Геометрические примитивы для отсечения и поиска: ограничивающий бокс и пирамида видимости
+#pragma once
+
+#include <vector>
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include <QVector3D>
+#include <QVector4D>
+#include "Types.h"
+
+namespace Vasnecov
+{
+    const GLfloat cfg_projectionEpsilon = 1.0e-6f; // Минимальная w для деления перспективы
+
+    // Ограничивающий бокс, выровненный по осям
+    class BoundingBox
+    {
+    public:
+        BoundingBox();
+        BoundingBox(const QVector3D& minimum, const QVector3D& maximum);
+
+        bool operator==(const BoundingBox& other) const;
+        bool operator!=(const BoundingBox& other) const;
+
+        GLboolean isValid() const;
+        const QVector3D& minimum() const;
+        const QVector3D& maximum() const;
+        QVector3D center() const;
+        QVector3D extents() const; // Половина размеров
+        GLfloat surfaceArea() const;
+
+        void add(const QVector3D& point);
+        void add(const BoundingBox& box);
+        void add(const std::vector<QVector3D>& points);
+
+        // Бокс, описанный вокруг бокса, преобразованного аффинной матрицей
+        BoundingBox transformed(const QMatrix4x4& matrix) const;
+
+        GLboolean contains(const QVector3D& point) const;
+        GLboolean contains(const BoundingBox& other) const;
+        GLboolean intersects(const BoundingBox& other) const;
+        GLboolean intersectsSphere(const QVector3D& center, GLfloat radius) const;
+        // Пересечение с лучом. inverseDirection - покомпонентно обратное направление,
+        // entry - расстояние (в длинах направления) до входа в бокс
+        GLboolean intersectsRay(const QVector3D& origin, const QVector3D& inverseDirection,
+                                GLfloat maxDistance, GLfloat& entry) const;
+
+        static QVector3D inverseDirection(const QVector3D& direction);
+
+    private:
+        QVector3D m_min;
+        QVector3D m_max;
+        GLboolean m_valid;
+    };
+
+    // Пирамида видимости, построенная по матрице проекции (вместе с видовой)
+    class Frustum
+    {
+    public:
+        enum Planes
+        {
+            PlaneLeft = 0,
+            PlaneRight,
+            PlaneBottom,
+            PlaneTop,
+            PlaneNear,
+            PlaneFar,
+            PlanesAmount
+        };
+
+        Frustum();
+        explicit Frustum(const QMatrix4x4& matrixPV);
+
+        void set(const QMatrix4x4& matrixPV);
+        const QVector4D& plane(Planes index) const; // Нормаль внутрь, (a, b, c, d)
+
+        GLboolean contains(const QVector3D& point) const;
+        GLboolean contains(const BoundingBox& box) const; // Бокс целиком внутри
+        GLboolean intersects(const BoundingBox& box) const;
+
+    private:
+        QVector4D m_planes[PlanesAmount];
+    };
+
+    // Прямоугольник проекции бокса в нормализованных координатах устройства.
+    // Если часть бокса позади камеры, проекция не ограничена (clipped)
+    struct ProjectedBounds
+    {
+        GLfloat minX, minY, maxX, maxY;
+        GLboolean clipped;
+    };
+    // Проекция набора боксов матрицей matrixPV. Углы обрабатываются одним плоским проходом,
+    // который векторизуется компилятором
+    void projectBoxes(const QMatrix4x4& matrixPV, const std::vector<BoundingBox>& boxes,
+                      std::vector<ProjectedBounds>& result);
+
+    // Положения и ориентации набора элементов в виде отдельных массивов компонент
+    struct PoseArrays
+    {
+        std::vector<GLfloat> px, py, pz;
+        std::vector<GLfloat> qx, qy, qz, qw;
+        std::vector<GLfloat> rotation[9]; // Матрицы поворота по строкам
+
+        void resize(size_t size);
+        void set(size_t index, const QVector3D& position, const QQuaternion& orientation);
+        QMatrix4x4 matrix(size_t index) const; // Сдвиг и поворот
+    };
+    // Матрицы поворота по кватернионам (ненормированные нормируются) одним плоским проходом,
+    // который векторизуется компилятором
+    void composeRotations(PoseArrays& poses, size_t count);
+    // Углы в градусах, дающие ориентацию в порядке элементов: сначала Z, далее X-Y
+    QVector3D anglesFromOrientation(const QQuaternion& orientation);
+
+    // Пересечение луча с треугольником (с обеих сторон). distance - в длинах direction
+    GLboolean intersectTriangle(const QVector3D& origin, const QVector3D& direction,
+                                const QVector3D& a, const QVector3D& b, const QVector3D& c,
+                                GLfloat& distance);
+    // Ближайшие точки луча origin + t * direction (t в [0; 1]) и отрезка [a; b].
+    // Возвращает квадрат расстояния между ними
+    GLfloat closestToSegment(const QVector3D& origin, const QVector3D& direction,
+                             const QVector3D& a, const QVector3D& b,
+                             GLfloat& rayParameter, QVector3D& segmentPoint);
+
+    inline bool BoundingBox::operator==(const BoundingBox& other) const
+    {
+        if(m_valid != other.m_valid)
+            return false;
+        return !m_valid || (m_min == other.m_min && m_max == other.m_max);
+    }
+    inline bool BoundingBox::operator!=(const BoundingBox& other) const
+    {
+        return !(*this == other);
+    }
+    inline GLboolean BoundingBox::isValid() const
+    {
+        return m_valid;
+    }
+    inline const QVector3D& BoundingBox::minimum() const
+    {
+        return m_min;
+    }
+    inline const QVector3D& BoundingBox::maximum() const
+    {
+        return m_max;
+    }
+    inline QVector3D BoundingBox::center() const
+    {
+        return (m_min + m_max) * 0.5f;
+    }
+    inline QVector3D BoundingBox::extents() const
+    {
+        return (m_max - m_min) * 0.5f;
+    }
+    inline GLfloat BoundingBox::surfaceArea() const
+    {
+        if(!m_valid)
+            return 0.0f;
+
+        QVector3D size(m_max - m_min);
+        return 2.0f * (size.x() * size.y() + size.y() * size.z() + size.z() * size.x());
+    }
+
+    inline const QVector4D& Frustum::plane(Planes index) const
+    {
+        return m_planes[index];
+    }
+}
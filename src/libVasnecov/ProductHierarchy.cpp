@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "ProductHierarchy.h"
+#include <algorithm>
+#include "Technologist.h"
+#include "Transform.h"
+#include "VasnecovProduct.h"
+
+namespace
+{
+    const GLfloat c_identity[16] = {1.0f, 0.0f, 0.0f, 0.0f,
+                                    0.0f, 1.0f, 0.0f, 0.0f,
+                                    0.0f, 0.0f, 1.0f, 0.0f,
+                                    0.0f, 0.0f, 0.0f, 1.0f};
+}
+
+Vasnecov::ProductHierarchy::ProductHierarchy() :
+    m_products(),
+    m_parents(),
+    m_sizes(),
+    m_locals(),
+    m_worlds(),
+    m_flags(),
+    m_dirtyFrom(c_clean),
+    m_version(0)
+{}
+
+GLboolean Vasnecov::ProductHierarchy::attach(VasnecovProduct* product, VasnecovProduct* parent)
+{
+    if(!product)
+        return false;
+
+    const GLint parentNode(node(parent));
+    if(parent && parentNode < 0)
+    {
+        Vasnecov::problem("Parent product is out of hierarchy");
+        return false;
+    }
+
+    Subtree subtree;
+    const GLint current(node(product));
+    if(current < 0)
+    {
+        subtree.products.push_back(product);
+        subtree.parents.push_back(-1);
+        subtree.sizes.push_back(1);
+        subtree.locals.assign(c_identity, c_identity + 16);
+        subtree.worlds.assign(c_identity, c_identity + 16);
+        subtree.flags.push_back(LocalChanged);
+    }
+    else
+    {
+        if(m_parents[current] == parentNode)
+            return true;
+
+        if(parentNode >= current && parentNode < current + static_cast<GLint>(m_sizes[current]))
+        {
+            Vasnecov::problem("Product can't be moved into own subtree");
+            return false;
+        }
+
+        extract(static_cast<GLuint>(current), subtree);
+        // Мировая матрица корня считается от нового родителя
+        subtree.flags[0] |= LocalChanged;
+    }
+
+    // Индекс родителя мог сдвинуться при извлечении
+    place(node(parent), subtree);
+    ++m_version;
+
+    return true;
+}
+
+GLuint Vasnecov::ProductHierarchy::detach(const std::unordered_set<const VasnecovProduct*>& products)
+{
+    const GLuint count(size());
+    GLuint first(count);
+
+    // Предки уменьшаются на верхние удаляемые поддеревья, вложенные удаляются вместе с ними
+    for(auto product : products)
+    {
+        const GLint current(node(product));
+        if(current < 0)
+            continue;
+        first = std::min(first, static_cast<GLuint>(current));
+
+        GLint ancestor(m_parents[current]);
+        while(ancestor >= 0 && !products.count(m_products[ancestor]))
+            ancestor = m_parents[ancestor];
+        if(ancestor < 0)
+            resizeAncestors(m_parents[current], -static_cast<GLint>(m_sizes[current]));
+    }
+    if(first == count)
+        return 0;
+
+    // Уплотнение на месте от первого удаляемого: порядок обхода сохраняется, потомки удалённого узла удаляются вместе с ним
+    std::vector<GLint> remap(count - first, -1);
+    GLuint kept(first);
+
+    for(GLuint i = first; i < count; ++i)
+    {
+        const GLint parent(m_parents[i]);
+        const GLint moved(parent >= static_cast<GLint>(first) ? remap[parent - first] : parent);
+        if(products.count(m_products[i]) || (parent >= 0 && moved < 0))
+        {
+            m_products[i]->raw_node = -1;
+            continue;
+        }
+
+        remap[i - first] = static_cast<GLint>(kept);
+        if(kept != i)
+        {
+            m_products[kept] = m_products[i];
+            m_products[kept]->raw_node = static_cast<GLint>(kept);
+            m_sizes[kept] = m_sizes[i];
+            std::copy(&m_locals[i * 16], &m_locals[i * 16] + 16, &m_locals[kept * 16]);
+            std::copy(&m_worlds[i * 16], &m_worlds[i * 16] + 16, &m_worlds[kept * 16]);
+            m_flags[kept] = m_flags[i];
+        }
+        m_parents[kept] = moved;
+        ++kept;
+    }
+
+    m_products.resize(kept);
+    m_parents.resize(kept);
+    m_sizes.resize(kept);
+    m_locals.resize(kept * 16);
+    m_worlds.resize(kept * 16);
+    m_flags.resize(kept);
+
+    if(isDirty() && m_dirtyFrom > first)
+        m_dirtyFrom = first;
+    ++m_version;
+
+    return count - kept;
+}
+
+GLint Vasnecov::ProductHierarchy::node(const VasnecovProduct* product) const
+{
+    return product ? product->raw_node : -1;
+}
+
+std::vector<VasnecovProduct*> Vasnecov::ProductHierarchy::subtree(const VasnecovProduct* product) const
+{
+    const GLint root(node(product));
+    if(root < 0)
+        return std::vector<VasnecovProduct*>();
+
+    return std::vector<VasnecovProduct*>(m_products.begin() + root + 1, m_products.begin() + root + m_sizes[root]);
+}
+
+void Vasnecov::ProductHierarchy::setLocal(const VasnecovProduct* product, const GLfloat* matrix)
+{
+    const GLint current(node(product));
+    if(current < 0)
+        return;
+
+    std::copy(matrix, matrix + 16, &m_locals[current * 16]);
+    m_flags[current] |= LocalChanged;
+    markDirty(static_cast<GLuint>(current));
+}
+
+void Vasnecov::ProductHierarchy::setWorld(const VasnecovProduct* product, const GLfloat* matrix)
+{
+    const GLint current(node(product));
+    if(current < 0)
+        return;
+
+    // Свой узел при проходе не пересчитывается (до изменения локальной матрицы), потомки - пересчитываются
+    std::copy(matrix, matrix + 16, &m_worlds[current * 16]);
+    m_flags[current] = WorldChanged;
+    markDirty(static_cast<GLuint>(current));
+}
+
+void Vasnecov::ProductHierarchy::propagate()
+{
+    if(!isDirty())
+        return;
+
+    const GLuint count(size());
+    const GLuint from(std::min(m_dirtyFrom, count));
+
+    // Родитель лежит раньше потомков, поэтому к моменту обработки узла его мировая матрица готова
+    for(GLuint i = from; i < count; ++i)
+    {
+        const GLint parent(m_parents[i]);
+        if(!(m_flags[i] & LocalChanged) && (parent < 0 || !(m_flags[parent] & WorldChanged)))
+            continue;
+
+        GLfloat* world(&m_worlds[i * 16]);
+        const GLfloat* local(&m_locals[i * 16]);
+        if(parent >= 0)
+            Vasnecov::multiplyAffine(&m_worlds[parent * 16], local, world);
+        else
+            std::copy(local, local + 16, world);
+
+        m_flags[i] = WorldChanged;
+        m_products[i]->designerSetWorldMatrix(world);
+    }
+
+    std::fill(m_flags.begin() + from, m_flags.end(), 0);
+    m_dirtyFrom = c_clean;
+}
+
+void Vasnecov::ProductHierarchy::extract(GLuint node, Subtree& subtree)
+{
+    const GLuint count(m_sizes[node]);
+    const GLuint end(node + count);
+
+    subtree.products.assign(m_products.begin() + node, m_products.begin() + end);
+    subtree.parents.resize(count);
+    for(GLuint i = 0; i < count; ++i)
+        subtree.parents[i] = i ? m_parents[node + i] - static_cast<GLint>(node) : -1;
+    subtree.sizes.assign(m_sizes.begin() + node, m_sizes.begin() + end);
+    subtree.locals.assign(m_locals.begin() + node * 16, m_locals.begin() + end * 16);
+    subtree.worlds.assign(m_worlds.begin() + node * 16, m_worlds.begin() + end * 16);
+    subtree.flags.assign(m_flags.begin() + node, m_flags.begin() + end);
+
+    resizeAncestors(m_parents[node], -static_cast<GLint>(count));
+
+    m_products.erase(m_products.begin() + node, m_products.begin() + end);
+    m_parents.erase(m_parents.begin() + node, m_parents.begin() + end);
+    m_sizes.erase(m_sizes.begin() + node, m_sizes.begin() + end);
+    m_locals.erase(m_locals.begin() + node * 16, m_locals.begin() + end * 16);
+    m_worlds.erase(m_worlds.begin() + node * 16, m_worlds.begin() + end * 16);
+    m_flags.erase(m_flags.begin() + node, m_flags.begin() + end);
+
+    // Хвост сдвигается к началу
+    for(GLuint i = node; i < size(); ++i)
+    {
+        m_products[i]->raw_node = static_cast<GLint>(i);
+        if(m_parents[i] >= static_cast<GLint>(end))
+            m_parents[i] -= static_cast<GLint>(count);
+    }
+    for(auto product : subtree.products)
+        product->raw_node = -1;
+
+    if(isDirty() && m_dirtyFrom > node)
+        m_dirtyFrom = node;
+}
+
+void Vasnecov::ProductHierarchy::place(GLint parent, Subtree& subtree)
+{
+    const GLuint count(static_cast<GLuint>(subtree.products.size()));
+    const GLuint at(parent >= 0 ? static_cast<GLuint>(parent) + m_sizes[parent] : size());
+
+    m_products.insert(m_products.begin() + at, subtree.products.begin(), subtree.products.end());
+    m_parents.insert(m_parents.begin() + at, subtree.parents.begin(), subtree.parents.end());
+    m_sizes.insert(m_sizes.begin() + at, subtree.sizes.begin(), subtree.sizes.end());
+    m_locals.insert(m_locals.begin() + at * 16, subtree.locals.begin(), subtree.locals.end());
+    m_worlds.insert(m_worlds.begin() + at * 16, subtree.worlds.begin(), subtree.worlds.end());
+    m_flags.insert(m_flags.begin() + at, subtree.flags.begin(), subtree.flags.end());
+
+    // Хвост сдвигается к концу
+    for(GLuint i = at + count; i < size(); ++i)
+    {
+        m_products[i]->raw_node = static_cast<GLint>(i);
+        if(m_parents[i] >= static_cast<GLint>(at))
+            m_parents[i] += static_cast<GLint>(count);
+    }
+    for(GLuint i = at; i < at + count; ++i)
+    {
+        m_products[i]->raw_node = static_cast<GLint>(i);
+        m_parents[i] = i > at ? m_parents[i] + static_cast<GLint>(at) : parent;
+    }
+
+    resizeAncestors(parent, static_cast<GLint>(count));
+    markDirty(at);
+}
+
+void Vasnecov::ProductHierarchy::resizeAncestors(GLint node, GLint delta)
+{
+    while(node >= 0)
+    {
+        m_sizes[node] = static_cast<GLuint>(static_cast<GLint>(m_sizes[node]) + delta);
+        node = m_parents[node];
+    }
+}
+
+void Vasnecov::ProductHierarchy::markDirty(GLuint node)
+{
+    if(node < m_dirtyFrom)
+        m_dirtyFrom = node;
+}
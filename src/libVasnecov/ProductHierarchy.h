@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Плоское дерево изделий вселенной для пересчёта матриц одним проходом
+#pragma once
+
+#include <limits>
+#include <unordered_set>
+#include <vector>
+#include "Types.h"
+
+class VasnecovProduct;
+
+namespace Vasnecov
+{
+    // Узлы лежат в параллельных массивах в порядке обхода в глубину: родитель раньше потомков,
+    // поддерево узла - отрезок [узел; узел + размер). Поэтому мировые матрицы считаются одним
+    // проходом по возрастанию индексов, а перенос и удаление поддеревьев сдвигают только хвост.
+    // Матрицы хранятся по 16 чисел на узел, по столбцам (как QMatrix4x4::data())
+    class ProductHierarchy
+    {
+    public:
+        ProductHierarchy();
+
+        // Изделие ставится последним потомком parent (nullptr - корень).
+        // Изделие, уже бывшее в дереве, переносится вместе с поддеревом
+        GLboolean attach(VasnecovProduct* product, VasnecovProduct* parent);
+        // Удаление изделий вместе с поддеревьями одним проходом
+        GLuint detach(const std::unordered_set<const VasnecovProduct*>& products);
+
+        GLboolean contains(const VasnecovProduct* product) const;
+        GLint node(const VasnecovProduct* product) const; // -1, если изделия нет в дереве
+        std::vector<VasnecovProduct*> subtree(const VasnecovProduct* product) const; // Потомки в порядке обхода
+
+        void setLocal(const VasnecovProduct* product, const GLfloat* matrix); // Матрица относительно родителя
+        void setWorld(const VasnecovProduct* product, const GLfloat* matrix); // Мировая, до изменения своей или предков
+        GLboolean isDirty() const;
+        void propagate(); // Мировые матрицы изменённых узлов и их поддеревьев передаются изделиям
+
+        GLuint size() const;
+        GLuint version() const; // Меняется вместе с порядком узлов
+
+    private:
+        enum Flags
+        {
+            LocalChanged = 0x01,
+            WorldChanged = 0x02
+        };
+        static const GLuint c_clean = std::numeric_limits<GLuint>::max();
+
+        // Поддерево, вынутое для переноса. Родители - относительно корня поддерева
+        struct Subtree
+        {
+            std::vector<VasnecovProduct*> products;
+            std::vector<GLint> parents;
+            std::vector<GLuint> sizes;
+            std::vector<GLfloat> locals;
+            std::vector<GLfloat> worlds;
+            std::vector<GLubyte> flags;
+        };
+
+        void extract(GLuint node, Subtree& subtree);
+        void place(GLint parent, Subtree& subtree);
+        void resizeAncestors(GLint node, GLint delta);
+        void markDirty(GLuint node);
+
+    private:
+        std::vector<VasnecovProduct*> m_products;
+        std::vector<GLint> m_parents; // -1 у корней
+        std::vector<GLuint> m_sizes; // Размер поддерева вместе с узлом
+        std::vector<GLfloat> m_locals;
+        std::vector<GLfloat> m_worlds;
+        std::vector<GLubyte> m_flags;
+        GLuint m_dirtyFrom; // Первый изменённый узел
+        GLuint m_version;
+
+        Q_DISABLE_COPY(ProductHierarchy)
+    };
+
+    inline GLboolean ProductHierarchy::contains(const VasnecovProduct* product) const
+    {
+        return node(product) >= 0;
+    }
+    inline GLboolean ProductHierarchy::isDirty() const
+    {
+        return m_dirtyFrom != c_clean;
+    }
+    inline GLuint ProductHierarchy::size() const
+    {
+        return static_cast<GLuint>(m_products.size());
+    }
+    inline GLuint ProductHierarchy::version() const
+    {
+        return m_version;
+    }
+}
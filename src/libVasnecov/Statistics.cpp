@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "Statistics.h"
+#include <QOpenGLContext>
+#include <QOpenGLTimerQuery>
+#include "Technologist.h"
+#include "Tracer.h"
+
+namespace
+{
+    const char* const passNames[Vasnecov::RenderPassesAmount] =
+    {
+        "setup",
+        "terrains",
+        "figures",
+        "products",
+        "transparent",
+        "labels"
+    };
+}
+
+QString Vasnecov::renderPassName(RenderPasses pass)
+{
+    if(pass < RenderPassesAmount)
+        return passNames[pass];
+
+    return QString();
+}
+
+Vasnecov::WorldStatistics::WorldStatistics() :
+    name(),
+    culled(0)
+{
+    for(GLuint i = 0; i < RenderPassesAmount; ++i)
+    {
+        cpuTime[i] = 0.0f;
+        gpuTime[i] = -1.0f;
+    }
+}
+
+GLfloat Vasnecov::WorldStatistics::cpuTotal() const
+{
+    GLfloat res(0.0f);
+    for(GLuint i = 0; i < RenderPassesAmount; ++i)
+        res += cpuTime[i];
+    return res;
+}
+
+GLfloat Vasnecov::WorldStatistics::gpuTotal() const
+{
+    GLfloat res(-1.0f);
+    for(GLuint i = 0; i < RenderPassesAmount; ++i)
+    {
+        if(gpuTime[i] >= 0.0f)
+            res = (res < 0.0f ? 0.0f : res) + gpuTime[i];
+    }
+    return res;
+}
+
+Vasnecov::FrameStatistics::FrameStatistics() :
+    frame(0),
+    updateTime(0.0f),
+    drawTime(0.0f),
+    gpuTimersAvailable(false),
+    worlds()
+{}
+
+QString Vasnecov::FrameStatistics::toString() const
+{
+    auto time = [](GLfloat ms) -> QString
+    {
+        if(ms < 0.0f)
+            return "-";
+        return QString::number(ms, 'f', 3);
+    };
+
+    QString res = QString("Frame %1: update %2 ms, draw %3 ms (CPU / GPU%4)\n")
+                  .arg(frame)
+                  .arg(time(updateTime))
+                  .arg(time(drawTime))
+                  .arg(gpuTimersAvailable ? "" : " unavailable");
+
+    for(const auto& world : worlds)
+    {
+        res += QString("  World \"%1\": %2 / %3 ms, culled %4\n")
+               .arg(world.name)
+               .arg(time(world.cpuTotal()))
+               .arg(time(world.gpuTotal()))
+               .arg(world.culled);
+        for(GLuint i = 0; i < RenderPassesAmount; ++i)
+        {
+            res += QString("    %1: %2 / %3\n")
+                   .arg(renderPassName(static_cast<RenderPasses>(i)))
+                   .arg(time(world.cpuTime[i]))
+                   .arg(time(world.gpuTime[i]));
+        }
+    }
+
+    return res;
+}
+
+Vasnecov::RenderProfiler::RenderProfiler() :
+    m_enabled(false),
+    m_gpuSupport(-1),
+    m_slots(cfg_gpuTimersLatency),
+    m_frame(0),
+    m_current(nullptr),
+    m_pass(-1),
+    m_query(),
+    m_frameTimer(),
+    m_passTimer(),
+    m_statistics(),
+    m_hasNew(false),
+    m_tracedWorld(false),
+    m_tracedPass(false)
+{}
+
+Vasnecov::RenderProfiler::~RenderProfiler()
+{
+    for(auto& slot : m_slots)
+    {
+        for(auto timer : slot.pool)
+            delete timer;
+    }
+}
+
+void Vasnecov::RenderProfiler::startFrame()
+{
+    m_current = nullptr;
+    if(!m_enabled)
+        return;
+
+    if(m_gpuSupport < 0 && QOpenGLContext::currentContext())
+    {
+        QOpenGLTimerQuery test;
+        m_gpuSupport = test.create() ? 1 : 0;
+        if(!m_gpuSupport)
+            Vasnecov::problem("GPU timer queries are not supported");
+    }
+
+    m_current = &m_slots[m_frame % m_slots.size()];
+    if(m_current->pending)
+        collect(*m_current);
+
+    m_current->statistics = FrameStatistics();
+    m_current->statistics.frame = m_frame;
+    m_current->statistics.gpuTimersAvailable = (m_gpuSupport > 0);
+    m_current->queries.clear();
+    m_current->used = 0;
+
+    m_pass = -1;
+    m_frameTimer.start();
+}
+
+void Vasnecov::RenderProfiler::stopUpdate()
+{
+    if(!m_current)
+        return;
+
+    m_current->statistics.updateTime = m_frameTimer.nsecsElapsed() * 1e-6f;
+}
+
+void Vasnecov::RenderProfiler::startWorld(const QString& name, const char* traceName)
+{
+    if(Tracer::isEnabled())
+    {
+        Tracer::begin(traceName && *traceName ? traceName : "world", "render");
+        m_tracedWorld = true;
+    }
+
+    if(m_current)
+    {
+        WorldStatistics world;
+        world.name = name;
+        m_current->statistics.worlds.push_back(world);
+    }
+
+    startPass(RenderPassSetup);
+}
+
+void Vasnecov::RenderProfiler::startPass(RenderPasses pass)
+{
+    stopPass();
+
+    if(m_tracedWorld && Tracer::isEnabled())
+    {
+        Tracer::begin(passNames[pass], "render");
+        m_tracedPass = true;
+    }
+
+    if(!m_current || m_current->statistics.worlds.empty())
+        return;
+
+    m_pass = pass;
+    m_query.world = m_current->statistics.worlds.size() - 1;
+    m_query.pass = pass;
+    m_query.timer = nullptr;
+
+    if(m_gpuSupport > 0)
+    {
+        m_query.timer = takeTimer(*m_current);
+        if(m_query.timer)
+            m_query.timer->begin();
+    }
+
+    m_passTimer.start();
+}
+
+void Vasnecov::RenderProfiler::setWorldCulled(GLuint amount)
+{
+    if(m_current && !m_current->statistics.worlds.empty())
+        m_current->statistics.worlds.back().culled = amount;
+}
+
+void Vasnecov::RenderProfiler::stopWorld()
+{
+    stopPass();
+
+    if(m_tracedWorld)
+    {
+        Tracer::end();
+        m_tracedWorld = false;
+    }
+}
+
+void Vasnecov::RenderProfiler::stopFrame()
+{
+    if(!m_current)
+        return;
+
+    stopPass();
+
+    FrameStatistics& stat(m_current->statistics);
+    stat.drawTime = m_frameTimer.nsecsElapsed() * 1e-6f - stat.updateTime;
+
+    m_current->pending = true;
+    if(m_current->queries.empty())
+        collect(*m_current); // Ждать нечего
+
+    m_current = nullptr;
+    ++m_frame;
+}
+
+void Vasnecov::RenderProfiler::stopPass()
+{
+    if(m_tracedPass)
+    {
+        Tracer::end();
+        m_tracedPass = false;
+    }
+
+    if(m_pass < 0)
+        return;
+
+    m_current->statistics.worlds[m_query.world].cpuTime[m_query.pass] += m_passTimer.nsecsElapsed() * 1e-6f;
+    if(m_query.timer)
+    {
+        m_query.timer->end();
+        m_current->queries.push_back(m_query);
+    }
+
+    m_pass = -1;
+}
+
+void Vasnecov::RenderProfiler::collect(Slot& slot)
+{
+    slot.pending = false;
+
+    // Запросы завершаются по порядку: если готов последний, готовы все.
+    // Если нет - время GPU этого кадра теряется, но конвейер не блокируется.
+    if(!slot.queries.empty() && slot.queries.back().timer->isResultAvailable())
+    {
+        for(const auto& query : slot.queries)
+        {
+            GLfloat& time(slot.statistics.worlds[query.world].gpuTime[query.pass]);
+            if(time < 0.0f)
+                time = 0.0f;
+            time += query.timer->waitForResult() * 1e-6f;
+        }
+    }
+
+    m_statistics = slot.statistics;
+    m_hasNew = true;
+}
+
+QOpenGLTimerQuery* Vasnecov::RenderProfiler::takeTimer(Slot& slot)
+{
+    if(slot.used < slot.pool.size())
+        return slot.pool[slot.used++];
+
+    QOpenGLTimerQuery* timer = new QOpenGLTimerQuery();
+    if(!timer->create())
+    {
+        delete timer;
+        m_gpuSupport = 0;
+        return nullptr;
+    }
+
+    slot.pool.push_back(timer);
+    ++slot.used;
+    return timer;
+}
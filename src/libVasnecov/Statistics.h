@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Статистика кадра: время CPU и GPU по мирам и проходам отрисовки
+#pragma once
+
+#include <vector>
+#include <QString>
+#include <QElapsedTimer>
+#include "Types.h"
+
+class QOpenGLTimerQuery;
+
+namespace Vasnecov
+{
+    const GLuint cfg_gpuTimersLatency = 3; // Глубина кольца запросов (в кадрах)
+
+    enum RenderPasses
+    {
+        RenderPassSetup = 0, // Очистка, проекция, лампы
+        RenderPassTerrains,
+        RenderPassOpaqueFigures,
+        RenderPassProducts,
+        RenderPassTransparent, // Прозрачные изделия и фигуры, фигуры без глубины
+        RenderPassLabels,
+        RenderPassesAmount
+    };
+
+    QString renderPassName(RenderPasses pass);
+
+    struct WorldStatistics
+    {
+        QString name;
+        GLfloat cpuTime[RenderPassesAmount]; // мс
+        GLfloat gpuTime[RenderPassesAmount]; // мс, отрицательное - нет данных
+        GLuint culled; // Элементов отсечено по пирамиде видимости
+
+        WorldStatistics();
+
+        GLfloat cpuTotal() const;
+        GLfloat gpuTotal() const;
+    };
+
+    struct FrameStatistics
+    {
+        GLuint frame;
+        GLfloat updateTime; // renderUpdateData, мс
+        GLfloat drawTime; // отрисовка миров, мс
+        GLboolean gpuTimersAvailable;
+        std::vector<WorldStatistics> worlds;
+
+        FrameStatistics();
+
+        QString toString() const;
+    };
+
+    // Сбор статистики в потоке отрисовки.
+    // Запросы GL_TIME_ELAPSED не могут быть вложенными, поэтому время мира - сумма времён его проходов.
+    // Результаты GPU читаются с опозданием на cfg_gpuTimersLatency - 1 кадров, чтобы не ждать конвейер.
+    class RenderProfiler
+    {
+        struct Query
+        {
+            GLuint world;
+            RenderPasses pass;
+            QOpenGLTimerQuery* timer;
+        };
+        struct Slot
+        {
+            FrameStatistics statistics;
+            std::vector<Query> queries;
+            GLuint used; // Задействовано таймеров из пула
+            std::vector<QOpenGLTimerQuery*> pool;
+            GLboolean pending;
+
+            Slot() : statistics(), queries(), used(0), pool(), pending(false) {}
+        };
+
+    public:
+        RenderProfiler();
+        ~RenderProfiler();
+
+        void setEnabled(GLboolean enabled);
+        GLboolean isEnabled() const;
+
+        void startFrame();
+        void stopUpdate();
+        void startWorld(const QString& name, const char* traceName); // traceName должно жить до выгрузки трассы
+        void startPass(RenderPasses pass);
+        void setWorldCulled(GLuint amount);
+        void stopWorld();
+        void stopFrame();
+
+        // Последний кадр, для которого известны и CPU, и GPU времена
+        const FrameStatistics& statistics() const;
+        GLboolean hasNewStatistics() const;
+        void clearNewStatistics();
+
+    private:
+        void stopPass();
+        void collect(Slot& slot);
+        QOpenGLTimerQuery* takeTimer(Slot& slot);
+
+    private:
+        GLboolean m_enabled;
+        GLint m_gpuSupport; // -1 - не проверено, 0 - нет, 1 - есть
+
+        std::vector<Slot> m_slots;
+        GLuint m_frame;
+        Slot* m_current;
+
+        GLint m_pass; // Текущий проход, -1 - нет
+        Query m_query;
+        QElapsedTimer m_frameTimer;
+        QElapsedTimer m_passTimer;
+
+        FrameStatistics m_statistics;
+        GLboolean m_hasNew;
+
+        // Открытые события трассировки (пишутся и без сбора статистики)
+        GLboolean m_tracedWorld;
+        GLboolean m_tracedPass;
+
+        Q_DISABLE_COPY(RenderProfiler)
+    };
+
+    inline void RenderProfiler::setEnabled(GLboolean enabled)
+    {
+        m_enabled = enabled;
+    }
+    inline GLboolean RenderProfiler::isEnabled() const
+    {
+        return m_enabled;
+    }
+    inline const FrameStatistics& RenderProfiler::statistics() const
+    {
+        return m_statistics;
+    }
+    inline GLboolean RenderProfiler::hasNewStatistics() const
+    {
+        return m_hasNew;
+    }
+    inline void RenderProfiler::clearNewStatistics()
+    {
+        m_hasNew = false;
+    }
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "Tracer.h"
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <QCoreApplication>
+#include <QFile>
+#include "Technologist.h"
+
+namespace
+{
+    static_assert((Vasnecov::cfg_traceEventsPerThread & (Vasnecov::cfg_traceEventsPerThread - 1)) == 0,
+                  "Trace ring size must be a power of two");
+
+    struct TraceEvent
+    {
+        const char* name;
+        const char* category;
+        qint64 time; // нс
+        qint64 value;
+        char phase;
+    };
+
+    // Кольцо событий одного потока. Пишет только поток-владелец, читает выгрузка.
+    struct ThreadBuffer
+    {
+        explicit ThreadBuffer(GLuint tid) :
+            events(Vasnecov::cfg_traceEventsPerThread),
+            head(0),
+            start(0),
+            threadId(tid),
+            threadName(nullptr),
+            next(nullptr)
+        {}
+
+        std::vector<TraceEvent> events;
+        std::atomic<quint64> head; // Количество записанных событий
+        std::atomic<quint64> start; // Граница очистки
+        const GLuint threadId;
+        std::atomic<const char*> threadName;
+        ThreadBuffer* next;
+    };
+
+    // Буферы потоков живут до конца программы, чтобы выгрузка видела и завершённые потоки
+    std::atomic<ThreadBuffer*> traceBuffers(nullptr);
+    std::atomic<GLuint> traceThreadsCount(0);
+    thread_local ThreadBuffer* traceLocalBuffer(nullptr);
+    // Открытые begin потока: бит на уровень вложенности, 1 - событие B записано
+    thread_local quint64 traceOpened(0);
+    thread_local GLuint traceDepth(0);
+
+    ThreadBuffer* localBuffer()
+    {
+        if(!traceLocalBuffer)
+        {
+            ThreadBuffer* buffer = new ThreadBuffer(++traceThreadsCount);
+            buffer->next = traceBuffers.load(std::memory_order_relaxed);
+            while(!traceBuffers.compare_exchange_weak(buffer->next, buffer,
+                                                      std::memory_order_release,
+                                                      std::memory_order_relaxed))
+            {}
+            traceLocalBuffer = buffer;
+        }
+        return traceLocalBuffer;
+    }
+
+    qint64 traceTime()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void writeEvent(ThreadBuffer* buffer, char phase, const char* name, const char* category, qint64 value)
+    {
+        quint64 index = buffer->head.load(std::memory_order_relaxed);
+        TraceEvent& event(buffer->events[index & (Vasnecov::cfg_traceEventsPerThread - 1)]);
+        event.name = name;
+        event.category = category;
+        event.time = traceTime();
+        event.value = value;
+        event.phase = phase;
+        buffer->head.store(index + 1, std::memory_order_release);
+    }
+
+    void appendEscaped(QByteArray& out, const char* text)
+    {
+        for(; text && *text; ++text)
+        {
+            const char c(*text);
+            if(c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if(static_cast<unsigned char>(c) < 0x20)
+            {
+                out += ' ';
+            }
+            else
+            {
+                out += c;
+            }
+        }
+    }
+}
+
+std::atomic<bool> Vasnecov::Tracer::m_enabled(false);
+
+void Vasnecov::Tracer::setEnabled(bool enabled)
+{
+    m_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Vasnecov::Tracer::begin(const char* name, const char* category)
+{
+    // Глубже 64 уровней события не пишутся
+    const quint64 bit(traceDepth < 64 ? quint64(1) << traceDepth : 0);
+    ++traceDepth;
+    if(!bit || !isEnabled())
+    {
+        traceOpened &= ~bit;
+        return;
+    }
+
+    traceOpened |= bit;
+    writeEvent(localBuffer(), 'B', name, category, 0);
+}
+
+void Vasnecov::Tracer::end()
+{
+    if(!traceDepth)
+        return;
+    --traceDepth;
+
+    // Закрывается только записанное начало, в том числе после выключения, чтобы не рвать пары
+    if(traceDepth >= 64 || !(traceOpened & (quint64(1) << traceDepth)))
+        return;
+    writeEvent(traceLocalBuffer, 'E', nullptr, nullptr, 0);
+}
+
+void Vasnecov::Tracer::instant(const char* name, const char* category)
+{
+    record('i', name, category, 0);
+}
+
+void Vasnecov::Tracer::counter(const char* name, qint64 value, const char* category)
+{
+    record('C', name, category, value);
+}
+
+void Vasnecov::Tracer::setThreadName(const char* name)
+{
+    localBuffer()->threadName.store(name, std::memory_order_release);
+}
+
+const char* Vasnecov::Tracer::intern(const QString& text)
+{
+    static std::mutex mutex;
+    static std::set<QByteArray> strings;
+
+    std::lock_guard<std::mutex> locker(mutex);
+    return strings.insert(text.toUtf8()).first->constData();
+}
+
+void Vasnecov::Tracer::clear()
+{
+    for(ThreadBuffer* buffer = traceBuffers.load(std::memory_order_acquire); buffer; buffer = buffer->next)
+        buffer->start.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+QByteArray Vasnecov::Tracer::dump()
+{
+    QByteArray out;
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    const QByteArray pid(QByteArray::number(QCoreApplication::applicationPid()));
+    bool first(true);
+
+    std::vector<TraceEvent> events;
+    for(ThreadBuffer* buffer = traceBuffers.load(std::memory_order_acquire); buffer; buffer = buffer->next)
+    {
+        const QByteArray tid(QByteArray::number(buffer->threadId));
+
+        const char* threadName(buffer->threadName.load(std::memory_order_acquire));
+        if(threadName)
+        {
+            out += first ? "" : ",";
+            first = false;
+            out += "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + pid + ",\"tid\":" + tid + ",\"args\":{\"name\":\"";
+            appendEscaped(out, threadName);
+            out += "\"}}";
+        }
+
+        // Копирование без блокировок: затёртые во время копирования события отбрасываются
+        quint64 head = buffer->head.load(std::memory_order_acquire);
+        quint64 from = buffer->start.load(std::memory_order_relaxed);
+        if(head > cfg_traceEventsPerThread && from < head - cfg_traceEventsPerThread)
+            from = head - cfg_traceEventsPerThread;
+
+        events.clear();
+        for(quint64 i = from; i < head; ++i)
+            events.push_back(buffer->events[i & (cfg_traceEventsPerThread - 1)]);
+
+        quint64 newHead = buffer->head.load(std::memory_order_acquire);
+        size_t skip(0);
+        if(newHead > cfg_traceEventsPerThread && newHead - cfg_traceEventsPerThread > from)
+            skip = std::min<quint64>(newHead - cfg_traceEventsPerThread - from, events.size());
+
+        for(size_t i = skip; i < events.size(); ++i)
+        {
+            const TraceEvent& event(events[i]);
+
+            out += first ? "" : ",";
+            first = false;
+            out += "\n{\"ph\":\"";
+            out += event.phase;
+            out += "\",\"pid\":" + pid + ",\"tid\":" + tid;
+            out += ",\"ts\":" + QByteArray::number(event.time / 1000) + "." +
+                   QByteArray::number(event.time % 1000).rightJustified(3, '0');
+            if(event.name)
+            {
+                out += ",\"name\":\"";
+                appendEscaped(out, event.name);
+                out += "\",\"cat\":\"";
+                appendEscaped(out, event.category);
+                out += "\"";
+            }
+            if(event.phase == 'i')
+                out += ",\"s\":\"t\"";
+            else if(event.phase == 'C')
+                out += ",\"args\":{\"value\":" + QByteArray::number(event.value) + "}";
+            out += "}";
+        }
+    }
+
+    out += "\n]}\n";
+    return out;
+}
+
+GLboolean Vasnecov::Tracer::dump(const QString& filePath)
+{
+    QFile file(filePath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        Vasnecov::problem("Can't open file for trace: ", filePath);
+        return false;
+    }
+
+    file.write(dump());
+    return true;
+}
+
+void Vasnecov::Tracer::record(char phase, const char* name, const char* category, qint64 value)
+{
+    if(!isEnabled())
+        return;
+
+    writeEvent(localBuffer(), phase, name, category, value);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Трассировка в формате Chrome Trace Event (chrome://tracing, Perfetto)
+#pragma once
+
+#include <atomic>
+#include <QByteArray>
+#include <QString>
+#include "Types.h"
+
+namespace Vasnecov
+{
+    const GLuint cfg_traceEventsPerThread = 16384; // Размер кольца событий одного потока (степень двойки)
+
+    // Каждый поток пишет в своё кольцо без блокировок, старые события затираются.
+    // Имена и категории событий должны жить до выгрузки (строковые литералы или intern()).
+    class Tracer
+    {
+    public:
+        static void setEnabled(bool enabled);
+        static bool isEnabled();
+
+        // Пары begin/end вкладываются. end закрывает только начало, записанное при включённой трассировке
+        static void begin(const char* name, const char* category = "vasnecov");
+        static void end();
+        static void instant(const char* name, const char* category = "vasnecov");
+        static void counter(const char* name, qint64 value, const char* category = "vasnecov");
+
+        static void setThreadName(const char* name);
+        static const char* intern(const QString& text); // Постоянная копия строки для пользовательских меток
+
+        static void clear();
+        static QByteArray dump();
+        static GLboolean dump(const QString& filePath);
+
+    private:
+        static void record(char phase, const char* name, const char* category, qint64 value);
+
+        static std::atomic<bool> m_enabled;
+    };
+
+    // Событие на время жизни области видимости
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(const char* name, const char* category = "vasnecov") :
+            m_active(Tracer::isEnabled())
+        {
+            if(m_active)
+                Tracer::begin(name, category);
+        }
+        ~TraceScope()
+        {
+            if(m_active)
+                Tracer::end();
+        }
+
+    private:
+        bool m_active;
+
+        Q_DISABLE_COPY(TraceScope)
+    };
+
+    inline bool Tracer::isEnabled()
+    {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+}
+
+#define VASNECOV_TRACE_CONCAT_(a, b) a##b
+#define VASNECOV_TRACE_CONCAT(a, b) VASNECOV_TRACE_CONCAT_(a, b)
+#define VASNECOV_TRACE(...) Vasnecov::TraceScope VASNECOV_TRACE_CONCAT(vasnecovTrace, __LINE__)(__VA_ARGS__)
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "Transform.h"
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define VASNECOV_TRANSFORM_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VASNECOV_TRANSFORM_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    // Столбцы поворота, умноженные на масштаб, и сдвиг. result - матрица без родителя
+    inline void writeLocal(GLfloat r00, GLfloat r10, GLfloat r20,
+                           GLfloat r01, GLfloat r11, GLfloat r21,
+                           GLfloat r02, GLfloat r12, GLfloat r22,
+                           const QVector3D& position, GLfloat* result)
+    {
+        result[0] = r00;
+        result[1] = r10;
+        result[2] = r20;
+        result[3] = 0.0f;
+        result[4] = r01;
+        result[5] = r11;
+        result[6] = r21;
+        result[7] = 0.0f;
+        result[8] = r02;
+        result[9] = r12;
+        result[10] = r22;
+        result[11] = 0.0f;
+        result[12] = position.x();
+        result[13] = position.y();
+        result[14] = position.z();
+        result[15] = 1.0f;
+    }
+}
+
+void Vasnecov::composeTransform(const QVector3D& position, const QQuaternion& orientation, GLfloat scale,
+                                GLfloat* result, const GLfloat* parent)
+{
+    const GLfloat x(orientation.x()), y(orientation.y()), z(orientation.z()), w(orientation.scalar());
+    const GLfloat x2(x + x), y2(y + y), z2(z + z);
+    const GLfloat xx(x * x2), yy(y * y2), zz(z * z2);
+    const GLfloat xy(x * y2), xz(x * z2), yz(y * z2);
+    const GLfloat wx(w * x2), wy(w * y2), wz(w * z2);
+
+    GLfloat local[16];
+    writeLocal((1.0f - (yy + zz)) * scale, (xy + wz) * scale, (xz - wy) * scale,
+               (xy - wz) * scale, (1.0f - (xx + zz)) * scale, (yz + wx) * scale,
+               (xz + wy) * scale, (yz - wx) * scale, (1.0f - (xx + yy)) * scale,
+               position, parent ? local : result);
+    if(parent)
+        multiplyAffine(parent, local, result);
+}
+
+void Vasnecov::composeTransformFromAngles(const QVector3D& position, const QVector3D& angles, GLfloat scale,
+                                          GLfloat* result, const GLfloat* parent)
+{
+    const GLfloat ax(angles.x() * c_degToRad), ay(angles.y() * c_degToRad), az(angles.z() * c_degToRad);
+    const GLfloat cx(std::cos(ax)), sx(std::sin(ax));
+    const GLfloat cy(std::cos(ay)), sy(std::sin(ay));
+    const GLfloat cz(std::cos(az)), sz(std::sin(az));
+
+    // R = Rz * Rx * Ry
+    const GLfloat sxsy(sx * sy), sxcy(sx * cy);
+
+    GLfloat local[16];
+    writeLocal((cz * cy - sz * sxsy) * scale, (sz * cy + cz * sxsy) * scale, -cx * sy * scale,
+               -sz * cx * scale, cz * cx * scale, sx * scale,
+               (cz * sy + sz * sxcy) * scale, (sz * sy - cz * sxcy) * scale, cx * cy * scale,
+               position, parent ? local : result);
+    if(parent)
+        multiplyAffine(parent, local, result);
+}
+
+void Vasnecov::multiplyAffine(const GLfloat* parent, const GLfloat* local, GLfloat* result)
+{
+    // Столбец j результата - сумма столбцов родителя с коэффициентами из столбца j локальной матрицы.
+    // Родитель читается целиком до записи, столбец local - до записи того же столбца result
+#if defined(VASNECOV_TRANSFORM_SSE)
+    const __m128 p0(_mm_loadu_ps(parent));
+    const __m128 p1(_mm_loadu_ps(parent + 4));
+    const __m128 p2(_mm_loadu_ps(parent + 8));
+    const __m128 p3(_mm_loadu_ps(parent + 12));
+
+    for(GLuint j = 0; j < 4; ++j)
+    {
+        const GLfloat* column(local + j * 4);
+        __m128 sum(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(column[0])),
+                                         _mm_mul_ps(p1, _mm_set1_ps(column[1]))),
+                              _mm_mul_ps(p2, _mm_set1_ps(column[2]))));
+        if(j == 3)
+            sum = _mm_add_ps(sum, p3);
+        _mm_storeu_ps(result + j * 4, sum);
+    }
+#elif defined(VASNECOV_TRANSFORM_NEON)
+    const float32x4_t p0(vld1q_f32(parent));
+    const float32x4_t p1(vld1q_f32(parent + 4));
+    const float32x4_t p2(vld1q_f32(parent + 8));
+    const float32x4_t p3(vld1q_f32(parent + 12));
+
+    for(GLuint j = 0; j < 4; ++j)
+    {
+        const GLfloat* column(local + j * 4);
+        float32x4_t sum(vmulq_n_f32(p0, column[0]));
+        sum = vmlaq_n_f32(sum, p1, column[1]);
+        sum = vmlaq_n_f32(sum, p2, column[2]);
+        if(j == 3)
+            sum = vaddq_f32(sum, p3);
+        vst1q_f32(result + j * 4, sum);
+    }
+#else
+    GLfloat p[16];
+    for(GLuint i = 0; i < 16; ++i)
+        p[i] = parent[i];
+
+    for(GLuint j = 0; j < 4; ++j)
+    {
+        const GLfloat c0(local[j * 4]), c1(local[j * 4 + 1]), c2(local[j * 4 + 2]);
+        for(GLuint i = 0; i < 4; ++i)
+        {
+            GLfloat sum(p[i] * c0 + p[4 + i] * c1 + p[8 + i] * c2);
+            if(j == 3)
+                sum += p[12 + i];
+            result[j * 4 + i] = sum;
+        }
+    }
+#endif
+}
+
+QMatrix4x4 Vasnecov::transformMatrix(const QVector3D& position, const QQuaternion& orientation, GLfloat scale)
+{
+    QMatrix4x4 matrix;
+    composeTransform(position, orientation, scale, matrix.data());
+    return matrix;
+}
+
+QMatrix4x4 Vasnecov::transformMatrix(const QMatrix4x4& parent,
+                                     const QVector3D& position, const QQuaternion& orientation, GLfloat scale)
+{
+    QMatrix4x4 matrix;
+    composeTransform(position, orientation, scale, matrix.data(), parent.constData());
+    return matrix;
+}
+
+QQuaternion Vasnecov::rotationX(GLfloat degrees)
+{
+    const GLfloat half(degrees * 0.5f * c_degToRad);
+    return QQuaternion(std::cos(half), std::sin(half), 0.0f, 0.0f);
+}
+
+QQuaternion Vasnecov::rotationY(GLfloat degrees)
+{
+    const GLfloat half(degrees * 0.5f * c_degToRad);
+    return QQuaternion(std::cos(half), 0.0f, std::sin(half), 0.0f);
+}
+
+QQuaternion Vasnecov::rotationZ(GLfloat degrees)
+{
+    const GLfloat half(degrees * 0.5f * c_degToRad);
+    return QQuaternion(std::cos(half), 0.0f, 0.0f, std::sin(half));
+}
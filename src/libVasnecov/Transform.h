@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Построение матриц элементов (сдвиг * поворот * масштаб) без общих методов QMatrix4x4
+#pragma once
+
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include <QVector3D>
+#include "Types.h"
+
+namespace Vasnecov
+{
+    // Матрицы хранятся по столбцам, как QMatrix4x4::data(). Нижняя строка аффинных матриц - (0, 0, 0, 1).
+    // Умножение на родительскую матрицу выполняется SSE или NEON, если они доступны при сборке.
+    // parent может быть nullptr, result может совпадать с parent
+
+    // orientation - единичный кватернион (как у QMatrix4x4::rotate, без нормирования)
+    void composeTransform(const QVector3D& position, const QQuaternion& orientation, GLfloat scale,
+                          GLfloat* result, const GLfloat* parent = nullptr);
+    // Углы в градусах, порядок поворотов как у элементов: сначала Z, далее X-Y
+    void composeTransformFromAngles(const QVector3D& position, const QVector3D& angles, GLfloat scale,
+                                    GLfloat* result, const GLfloat* parent = nullptr);
+    // result = parent * local, local - аффинная. result может совпадать с любым из аргументов
+    void multiplyAffine(const GLfloat* parent, const GLfloat* local, GLfloat* result);
+
+    QMatrix4x4 transformMatrix(const QVector3D& position, const QQuaternion& orientation, GLfloat scale);
+    QMatrix4x4 transformMatrix(const QMatrix4x4& parent,
+                               const QVector3D& position, const QQuaternion& orientation, GLfloat scale);
+
+    // Поворот вокруг оси координат на угол в градусах (то же, что QQuaternion::fromAxisAndAngle по оси)
+    QQuaternion rotationX(GLfloat degrees);
+    QQuaternion rotationY(GLfloat degrees);
+    QQuaternion rotationZ(GLfloat degrees);
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "TransparencyOrder.h"
+#include <algorithm>
+#include "VasnecovElement.h"
+
+Vasnecov::TransparencyOrder::TransparencyOrder() :
+    m_elements(),
+    m_x(), m_y(), m_z(),
+    m_keys(),
+    m_order(),
+    m_previous(),
+    m_indices(),
+    m_viewPoint(),
+    m_viewVector(),
+    m_sorted(false)
+{}
+
+void Vasnecov::TransparencyOrder::clear()
+{
+    m_elements.clear();
+    m_order.clear();
+    m_previous.clear();
+}
+
+void Vasnecov::TransparencyOrder::remember()
+{
+    m_previous.clear();
+    if(m_order.size() != m_elements.size())
+        return;
+
+    m_previous.reserve(m_order.size());
+    for(auto index : m_order)
+        m_previous.push_back(m_elements[index]);
+}
+
+void Vasnecov::TransparencyOrder::seed()
+{
+    const size_t count(m_elements.size());
+
+    m_indices.clear();
+    for(size_t i = 0; i < count; ++i)
+        m_indices[m_elements[i]] = static_cast<GLuint>(i);
+
+    // Оставшиеся элементы в прежнем порядке, новые за ними
+    std::vector<GLboolean> placed(count, false);
+    m_order.clear();
+    m_order.reserve(count);
+    for(auto element : m_previous)
+    {
+        auto found = m_indices.find(element);
+        if(found != m_indices.end() && !placed[found->second])
+        {
+            placed[found->second] = true;
+            m_order.push_back(found->second);
+        }
+    }
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(!placed[i])
+            m_order.push_back(static_cast<GLuint>(i));
+    }
+    m_previous.clear();
+}
+
+void Vasnecov::TransparencyOrder::update(GLboolean changed, GLboolean moved, const QVector3D& viewPoint, const QVector3D& viewVector)
+{
+    const size_t count(m_elements.size());
+
+    m_sorted = changed || moved || viewPoint != m_viewPoint || viewVector != m_viewVector;
+    if(!m_sorted)
+        return;
+
+    // Центры пересчитываются, только если элементы могли сдвинуться
+    if(changed || moved)
+    {
+        m_x.resize(count);
+        m_y.resize(count);
+        m_z.resize(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            QVector3D center(m_elements[i]->renderSortCenter());
+            m_x[i] = center.x();
+            m_y[i] = center.y();
+            m_z[i] = center.z();
+        }
+    }
+    m_viewPoint = viewPoint;
+    m_viewVector = viewVector;
+
+    m_keys.resize(count);
+    GLfloat* keys(m_keys.data());
+    const GLfloat* x(m_x.data());
+    const GLfloat* y(m_y.data());
+    const GLfloat* z(m_z.data());
+    const GLfloat px(viewPoint.x()), py(viewPoint.y()), pz(viewPoint.z());
+    const GLfloat nx(viewVector.x()), ny(viewVector.y()), nz(viewVector.z());
+
+#pragma omp simd
+    for(size_t i = 0; i < count; ++i)
+    {
+        keys[i] = (x[i] - px) * nx + (y[i] - py) * ny + (z[i] - pz) * nz;
+    }
+
+    auto farther = [keys](GLuint first, GLuint second) {return keys[first] > keys[second];};
+
+    if(changed || m_order.size() != count)
+        seed();
+
+    // Вставками по порядку прошлого кадра: при небольшом движении почти линейно
+    const size_t limit(count * cfg_sortShiftsLimit);
+    size_t shifts(0);
+    for(size_t i = 1; i < count; ++i)
+    {
+        GLuint current(m_order[i]);
+        size_t j(i);
+        while(j > 0 && farther(current, m_order[j - 1]))
+        {
+            m_order[j] = m_order[j - 1];
+            --j;
+        }
+        m_order[j] = current;
+
+        shifts += i - j;
+        if(shifts > limit)
+        {
+            std::sort(m_order.begin(), m_order.end(), farther);
+            break;
+        }
+    }
+}
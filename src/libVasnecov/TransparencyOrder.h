@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Порядок рисования прозрачных элементов от дальних к ближним с учётом порядка прошлого кадра
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <QVector3D>
+#include "Types.h"
+
+class VasnecovElement;
+
+namespace Vasnecov
+{
+    const GLuint cfg_sortShiftsLimit = 8; // Сдвигов вставками на элемент, после которых проще отсортировать заново
+
+    // Центры элементов хранятся отдельными массивами координат, расстояния до плоскости камеры
+    // считаются по ним одним векторизуемым проходом. Порядок прошлого кадра (новые элементы - в конце)
+    // досортировывается вставками, а без движения камеры и элементов и при прежнем наборе остаётся как был
+    class TransparencyOrder
+    {
+    public:
+        TransparencyOrder();
+
+        // Переставляет elements от дальних к ближним. moved - элементы мира двигались после прошлого вызова
+        template <typename T>
+        void sort(std::vector<T*>& elements, const QVector3D& viewPoint, const QVector3D& viewVector, GLboolean moved);
+
+        void clear();
+        GLboolean wasSorted() const; // Порядок пересчитывался при последнем вызове
+
+    private:
+        void remember(); // Сохраняет порядок перед сменой набора
+        void update(GLboolean changed, GLboolean moved, const QVector3D& viewPoint, const QVector3D& viewVector);
+        void seed(); // Начальный порядок нового набора по сохранённому
+
+    private:
+        std::vector<const VasnecovElement*> m_elements; // Набор прошлого вызова в исходном порядке
+        std::vector<GLfloat> m_x, m_y, m_z; // Центры в координатах мира
+        std::vector<GLfloat> m_keys; // Расстояния до плоскости камеры
+        std::vector<GLuint> m_order; // Индексы m_elements от дальних к ближним
+        std::vector<const VasnecovElement*> m_previous; // Прошлый набор в порядке рисования
+        std::unordered_map<const VasnecovElement*, GLuint> m_indices;
+        QVector3D m_viewPoint, m_viewVector;
+        GLboolean m_sorted;
+
+        Q_DISABLE_COPY(TransparencyOrder)
+    };
+
+    inline GLboolean TransparencyOrder::wasSorted() const
+    {
+        return m_sorted;
+    }
+
+    template <typename T>
+    void TransparencyOrder::sort(std::vector<T*>& elements, const QVector3D& viewPoint, const QVector3D& viewVector, GLboolean moved)
+    {
+        GLboolean changed(elements.size() != m_elements.size());
+        for(size_t i = 0; !changed && i < elements.size(); ++i)
+            changed = (m_elements[i] != elements[i]);
+
+        if(changed)
+        {
+            remember();
+            m_elements.assign(elements.begin(), elements.end());
+        }
+
+        update(changed, moved, viewPoint, viewVector);
+
+        std::vector<T*> sorted(elements.size());
+        for(size_t i = 0; i < m_order.size(); ++i)
+            sorted[i] = elements[m_order[i]];
+        elements.swap(sorted);
+    }
+}
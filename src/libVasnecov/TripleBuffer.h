@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Передача последнего состояния между потоками без блокировок
+#pragma once
+
+#include <atomic>
+#include "Types.h"
+
+namespace Vasnecov
+{
+    // Тройной буфер: один писатель, один читатель. Писатель заполняет свой буфер и обменивает его
+    // со средним, читатель забирает средний, если тот обновился. Никто никого не ждёт,
+    // промежуточные состояния, которые читатель не успел забрать, теряются.
+    template <typename T>
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer() :
+            m_buffers(),
+            m_back(0),
+            m_middle(1),
+            m_front(2)
+        {}
+
+        // Методы писателя
+        T& back()
+        {
+            return m_buffers[m_back];
+        }
+        // Возвращает true, если до этого читателю нечего было забирать
+        GLboolean publish()
+        {
+            GLuint previous = m_middle.exchange(m_back | Fresh, std::memory_order_acq_rel);
+            m_back = previous & IndexMask;
+            return !(previous & Fresh);
+        }
+        // Опубликованный снимок ещё не забран читателем (следующая публикация его вытеснит)
+        GLboolean isPending() const
+        {
+            return (m_middle.load(std::memory_order_relaxed) & Fresh) != 0;
+        }
+
+        // Методы читателя
+        // Возвращает true, если front() обновился
+        GLboolean consume()
+        {
+            if(!(m_middle.load(std::memory_order_relaxed) & Fresh))
+                return false;
+
+            GLuint previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+            m_front = previous & IndexMask;
+            return true;
+        }
+        const T& front() const
+        {
+            return m_buffers[m_front];
+        }
+
+    private:
+        enum Bits
+        {
+            IndexMask   = 0x3,
+            Fresh       = 0x4 // Средний буфер записан после последнего чтения
+        };
+
+        T m_buffers[3];
+        GLuint m_back; // Принадлежит писателю
+        std::atomic<GLuint> m_middle; // Индекс и признак Fresh
+        GLuint m_front; // Принадлежит читателю
+
+        Q_DISABLE_COPY(TripleBuffer)
+    };
+}
@@ -18,7 +18,9 @@
 #include <QString>
 #include <QVector3D>
 #include <QtGlobal>
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 const GLfloat M_2PI = static_cast<GLfloat>(M_PI * 2.0);
 
@@ -34,6 +36,105 @@ class VasnecovTexture;
 
 namespace Vasnecov
 {
+    class CoreObject;
+    typedef std::vector<CoreObject*> UpdateQueue;
+
+    // Флаги изменения сырых данных. При первой установке флагов владелец ставится в очередь
+    // рендерера (если она задана) и остаётся в ней, пока рендерер его не обработает.
+    // При отсоединении место в очереди обнуляется, пустые места пропускаются при её разборе
+    class UpdateFlags
+    {
+    public:
+        UpdateFlags(GLenum value = 0) :
+            m_value(value),
+            m_queue(nullptr),
+            m_owner(nullptr),
+            m_index(0),
+            m_queued(false)
+        {}
+        // Очередь не копируется
+        UpdateFlags(const UpdateFlags& other) :
+            m_value(other.m_value),
+            m_queue(nullptr),
+            m_owner(nullptr),
+            m_index(0),
+            m_queued(false)
+        {}
+        ~UpdateFlags()
+        {
+            detach();
+        }
+
+        UpdateFlags& operator=(const UpdateFlags& other)
+        {
+            return *this = other.m_value;
+        }
+        UpdateFlags& operator=(GLenum value)
+        {
+            m_value = value;
+            if(m_value)
+                enqueue();
+            return *this;
+        }
+        UpdateFlags& operator|=(GLenum value)
+        {
+            m_value |= value;
+            if(m_value)
+                enqueue();
+            return *this;
+        }
+        UpdateFlags& operator&=(GLenum value)
+        {
+            m_value &= value;
+            return *this;
+        }
+        operator GLenum() const
+        {
+            return m_value;
+        }
+
+        void attach(UpdateQueue* queue, CoreObject* owner)
+        {
+            detach();
+            m_queue = queue;
+            m_owner = owner;
+            if(m_value)
+                enqueue();
+        }
+        void detach()
+        {
+            // Очередь могла быть уже забрана рендерером, тогда место в ней занято другим
+            if(m_queue && m_queued && m_index < m_queue->size() && (*m_queue)[m_index] == m_owner)
+                (*m_queue)[m_index] = nullptr;
+            m_queue = nullptr;
+            m_queued = false;
+        }
+        // Постановка в очередь без изменения флагов
+        void enqueue()
+        {
+            if(m_queue && !m_queued)
+            {
+                m_queued = true;
+                m_index = m_queue->size();
+                m_queue->push_back(m_owner);
+            }
+        }
+        // Владелец обработан рендерером. Если флаги остались, он снова в очереди
+        void release()
+        {
+            m_queued = false;
+            if(m_value)
+                enqueue();
+        }
+
+    private:
+        GLenum m_value;
+        UpdateQueue* m_queue;
+        CoreObject* m_owner;
+        size_t m_index;
+        GLboolean m_queued;
+    };
+
     enum MatrixType
     {
         Identity		= 0x0000,
@@ -55,6 +156,12 @@ namespace Vasnecov
         PolygonDrawingTypeLines = GL_LINE,
         PolygonDrawingTypePoints = GL_POINT
     };
+
+    enum TransparencyModes
+    {
+        TransparencySorted = 1, // Сортировка прозрачных элементов от дальних к ближним
+        TransparencyWeighted = 2 // Взвешенное смешивание без сортировки (OIT), при поддержке контекстом
+    };
     // Характеристики вида
     class WorldParameters
     {
@@ -65,7 +172,10 @@ namespace Vasnecov
             m_width(320), m_height(280),
             m_drawingType(Vasnecov::PolygonDrawingTypeNormal),
             m_depth(true),
-            m_light(true)
+            m_light(true),
+            m_culling(true),
+            m_transparency(TransparencySorted),
+            m_caching(true)
         {
         }
         bool operator!=(const WorldParameters& other) const
@@ -77,7 +187,10 @@ namespace Vasnecov
                    m_height != other.m_height ||
                    m_drawingType != other.m_drawingType ||
                    m_depth != other.m_depth ||
-                   m_light != other.m_light;
+                   m_light != other.m_light ||
+                   m_culling != other.m_culling ||
+                   m_transparency != other.m_transparency ||
+                   m_caching != other.m_caching;
         }
         bool operator==(const WorldParameters& other) const
         {
@@ -88,7 +201,10 @@ namespace Vasnecov
                    m_height == other.m_height &&
                    m_drawingType == other.m_drawingType &&
                    m_depth == other.m_depth &&
-                   m_light == other.m_light;
+                   m_light == other.m_light &&
+                   m_culling == other.m_culling &&
+                   m_transparency == other.m_transparency &&
+                   m_caching == other.m_caching;
         }
 
         Vasnecov::WorldTypes projection() const;
@@ -115,6 +231,15 @@ namespace Vasnecov
         GLboolean light() const;
         void setLight(const GLboolean& light);
 
+        GLboolean culling() const;
+        void setCulling(const GLboolean& culling);
+
+        Vasnecov::TransparencyModes transparency() const;
+        void setTransparency(const Vasnecov::TransparencyModes& transparency);
+
+        GLboolean caching() const;
+        void setCaching(const GLboolean& caching);
+
     private:
         Vasnecov::WorldTypes            m_projection; // Тип проекции (орто/перспектива)
         GLint                           m_x, m_y; // координаты мира (окна просмотра) в плоскости экрана
@@ -122,6 +247,9 @@ namespace Vasnecov
         Vasnecov::PolygonDrawingTypes   m_drawingType; // GL_FILL, GL_LINE, GL_POINT
         GLboolean                       m_depth; // Тест глубины
         GLboolean                       m_light;
+        GLboolean                       m_culling; // Отсечение по пирамиде видимости
+        Vasnecov::TransparencyModes     m_transparency; // Способ отрисовки прозрачных элементов
+        GLboolean                       m_caching; // Вывод неизменного мира из снимка
     };
     struct Perspective
     {
@@ -192,7 +320,7 @@ namespace Vasnecov
 
     struct Attributes
     {
-        GLenum wasUpdated;
+        UpdateFlags wasUpdated;
 
         Attributes() :
             wasUpdated(false)
@@ -380,4 +508,34 @@ inline void WorldParameters::setLight(const GLboolean& light)
     m_light = light;
 }
 
+inline GLboolean WorldParameters::culling() const
+{
+    return m_culling;
+}
+
+inline void WorldParameters::setCulling(const GLboolean& culling)
+{
+    m_culling = culling;
+}
+
+inline Vasnecov::TransparencyModes WorldParameters::transparency() const
+{
+    return m_transparency;
+}
+
+inline void WorldParameters::setTransparency(const Vasnecov::TransparencyModes& transparency)
+{
+    m_transparency = transparency;
+}
+
+inline GLboolean WorldParameters::caching() const
+{
+    return m_caching;
+}
+
+inline void WorldParameters::setCaching(const GLboolean& caching)
+{
+    m_caching = caching;
+}
+
 }
@@ -8,20 +8,33 @@
  */
 
 #include "VasnecovElement.h"
+#include <algorithm>
+#include "ProductHierarchy.h"
 #include "Technologist.h"
+#include "Transform.h"
 
 VasnecovAbstractElement::VasnecovAbstractElement(VasnecovPipeline *pipeline, const QString& name) :
     Vasnecov::CoreObject(pipeline, name),
     raw_coordinates(),
     raw_angles(),
     raw_qX(), raw_qY(), raw_qZ(),
+    raw_anglesOutdated(false),
 
     m_Ms(raw_wasUpdated, MatrixMs),
-    m_alienMs(raw_wasUpdated, AlienMatrix, nullptr)
+    m_alienMs(raw_wasUpdated, AlienMatrix, nullptr),
+
+    m_batch(nullptr),
+    m_batchDeferred(false),
+    raw_dirty(0)
+{
+    raw_qX = Vasnecov::rotationX(raw_angles.x());
+    raw_qY = Vasnecov::rotationY(raw_angles.y());
+    raw_qZ = Vasnecov::rotationZ(raw_angles.z());
+}
+VasnecovAbstractElement::~VasnecovAbstractElement()
 {
-    raw_qX = raw_qX.fromAxisAndAngle(1.0, 0.0, 0.0, raw_angles.x());
-    raw_qY = raw_qY.fromAxisAndAngle(0.0, 1.0, 0.0, raw_angles.y());
-    raw_qZ = raw_qZ.fromAxisAndAngle(0.0, 0.0, 1.0, raw_angles.z());
+    if(m_batchDeferred && m_batch)
+        m_batch->forget(this);
 }
 
 void VasnecovAbstractElement::setCoordinates(const QVector3D &coordinates)
@@ -29,7 +42,7 @@ void VasnecovAbstractElement::setCoordinates(const QVector3D &coordinates)
     if(raw_coordinates != coordinates)
     {
         raw_coordinates = coordinates;
-        designerUpdateMatrixMs();
+        designerRequestMatrixUpdate();
     }
 }
 void VasnecovAbstractElement::setCoordinates(GLfloat x, GLfloat y, GLfloat z)
@@ -43,7 +56,7 @@ void VasnecovAbstractElement::incrementCoordinates(const QVector3D &increment)
     if(increment.x() != 0.0f || increment.y() != 0.0f || increment.z() != 0.0f)
     {
         raw_coordinates += increment;
-        designerUpdateMatrixMs();
+        designerRequestMatrixUpdate();
     }
 }
 void VasnecovAbstractElement::incrementCoordinates(GLfloat x, GLfloat y, GLfloat z)
@@ -59,6 +72,8 @@ QVector3D VasnecovAbstractElement::coordinates() const
 }
 void VasnecovAbstractElement::setAngles(const QVector3D &angles)
 {
+    designerUpdateAngles();
+
     if(raw_angles != angles)
     {
         GLenum rotate(0);
@@ -66,25 +81,25 @@ void VasnecovAbstractElement::setAngles(const QVector3D &angles)
         if(raw_angles.x() != angles.x())
         {
             raw_angles.setX(Vasnecov::trimAngle(angles.x()));
-            raw_qX = raw_qX.fromAxisAndAngle(1.0, 0.0, 0.0, raw_angles.x());
+            raw_qX = Vasnecov::rotationX(raw_angles.x());
             rotate |= Vasnecov::RotationX;
         }
         if(raw_angles.y() != angles.y())
         {
             raw_angles.setY(Vasnecov::trimAngle(angles.y()));
-            raw_qY = raw_qY.fromAxisAndAngle(0.0, 1.0, 0.0, raw_angles.y());
+            raw_qY = Vasnecov::rotationY(raw_angles.y());
             rotate |= Vasnecov::RotationY;
         }
         if(raw_angles.z() != angles.z())
         {
             raw_angles.setZ(Vasnecov::trimAngle(angles.z()));
-            raw_qZ = raw_qZ.fromAxisAndAngle(0.0, 0.0, 1.0, raw_angles.z());
+            raw_qZ = Vasnecov::rotationZ(raw_angles.z());
             rotate |= Vasnecov::RotationZ;
         }
 
         if(rotate)
         {
-            designerUpdateMatrixMs();
+            designerRequestMatrixUpdate();
         }
     }
 }
@@ -96,6 +111,8 @@ void VasnecovAbstractElement::setAngles(GLfloat x, GLfloat y, GLfloat z)
 }
 void VasnecovAbstractElement::incrementAngles(const QVector3D &increment)
 {
+    designerUpdateAngles();
+
     if(increment.x() != 0.0f || increment.y() != 0.0f || increment.z() != 0.0f)
     {
         GLenum rotate(0);
@@ -103,25 +120,25 @@ void VasnecovAbstractElement::incrementAngles(const QVector3D &increment)
         if(increment.x() != 0.0)
         {
             raw_angles.setX(Vasnecov::trimAngle(raw_angles.x() + increment.x()));
-            raw_qX = raw_qX.fromAxisAndAngle(1.0, 0.0, 0.0, raw_angles.x());
+            raw_qX = Vasnecov::rotationX(raw_angles.x());
             rotate |= Vasnecov::RotationX;
         }
         if(increment.y() != 0.0)
         {
             raw_angles.setY(Vasnecov::trimAngle(raw_angles.y() + increment.y()));
-            raw_qY = raw_qY.fromAxisAndAngle(0.0, 1.0, 0.0, raw_angles.y());
+            raw_qY = Vasnecov::rotationY(raw_angles.y());
             rotate |= Vasnecov::RotationY;
         }
         if(increment.z() != 0.0)
         {
             raw_angles.setZ(Vasnecov::trimAngle(raw_angles.z() + increment.z()));
-            raw_qZ = raw_qZ.fromAxisAndAngle(0.0, 0.0, 1.0, raw_angles.z());
+            raw_qZ = Vasnecov::rotationZ(raw_angles.z());
             rotate |= Vasnecov::RotationZ;
         }
 
         if(rotate)
         {
-            designerUpdateMatrixMs();
+            designerRequestMatrixUpdate();
         }
     }
 }
@@ -149,9 +166,28 @@ void VasnecovAbstractElement::incrementAnglesRad(GLfloat x, GLfloat y, GLfloat z
 }
 QVector3D VasnecovAbstractElement::angles() const
 {
+    if(raw_anglesOutdated)
+    {
+        QVector3D angles(Vasnecov::anglesFromOrientation(raw_qZ));
+        return QVector3D(Vasnecov::trimAngle(angles.x()), Vasnecov::trimAngle(angles.y()), Vasnecov::trimAngle(angles.z()));
+    }
+
     QVector3D angles(raw_angles);
     return angles;
 }
+void VasnecovAbstractElement::setOrientation(const QQuaternion& orientation)
+{
+    raw_qX = QQuaternion();
+    raw_qY = QQuaternion();
+    raw_qZ = orientation.normalized();
+    raw_anglesOutdated = true;
+
+    designerRequestMatrixUpdate();
+}
+QQuaternion VasnecovAbstractElement::orientation() const
+{
+    return raw_qZ * raw_qX * raw_qY;
+}
 
 void VasnecovAbstractElement::setPositionFromElement(const VasnecovAbstractElement *element)
 {
@@ -159,6 +195,7 @@ void VasnecovAbstractElement::setPositionFromElement(const VasnecovAbstractEleme
     {
         // NOTE: After this element's coordinates, angles & quaternions will be not actual
         m_Ms.set(element->designerMatrixMs());
+        raw_dirty &= ~DirtyMatrix;
     }
 }
 void VasnecovAbstractElement::detachFromOtherElement()
@@ -177,14 +214,84 @@ void VasnecovAbstractElement::attachToElement(const VasnecovAbstractElement *ele
 void VasnecovAbstractElement::designerUpdateMatrixMs()
 {
     // Сначала вращение по оси Z, далее - X-Y.
-    QMatrix4x4 newMatrix;
-    newMatrix.translate(raw_coordinates);
+    m_Ms.set(Vasnecov::transformMatrix(raw_coordinates, raw_qZ * raw_qX * raw_qY, 1.0f));
+}
+void VasnecovAbstractElement::designerRequestMatrixUpdate()
+{
+    if(designerIsLazy() || (m_batch && m_batch->isOpen()))
+        designerMarkDirty(DirtyMatrix);
+    else
+        designerUpdateMatrixMs();
+}
+GLboolean VasnecovAbstractElement::designerIsLazy() const
+{
+    return false;
+}
+void VasnecovAbstractElement::designerMarkDirty(GLenum dirty)
+{
+    raw_dirty |= dirty;
+    if(m_batchDeferred)
+        return;
 
-    QQuaternion qRot;
-    qRot = raw_qZ * raw_qX * raw_qY;
+    if(m_batch)
+    {
+        m_batchDeferred = true;
+        m_batch->defer(this);
+    }
+    else
+    {
+        // Вне вселенной откладывать некуда
+        GLenum current(raw_dirty);
+        raw_dirty = 0;
+        designerResolve(current);
+    }
+}
+void VasnecovAbstractElement::designerResolvePending() const
+{
+    if(m_batch)
+        m_batch->resolve();
+}
+void VasnecovAbstractElement::designerResolve(GLenum dirty)
+{
+    if(dirty & DirtyMatrix)
+        designerUpdateMatrixMs();
+}
+VasnecovAbstractElement* VasnecovAbstractElement::designerBatchParent() const
+{
+    return nullptr;
+}
+void VasnecovAbstractElement::designerSetBatch(Vasnecov::UpdateBatch* batch)
+{
+    m_batch = batch;
+}
+void VasnecovAbstractElement::designerSetPose(const QVector3D& coordinates, const QQuaternion& orientation, const QMatrix4x4& matrix,
+                                              GLboolean inherited)
+{
+    raw_coordinates = coordinates;
+    raw_qX = QQuaternion();
+    raw_qY = QQuaternion();
+    raw_qZ = orientation.normalized();
+    raw_anglesOutdated = true;
+
+    if(m_batch && m_batch->isOpen())
+        designerRequestMatrixUpdate();
+    else
+        designerApplyPoseMatrix(matrix, inherited);
+}
+void VasnecovAbstractElement::designerApplyPoseMatrix(const QMatrix4x4& matrix, GLboolean)
+{
+    m_Ms.set(matrix);
+}
+void VasnecovAbstractElement::designerUpdateAngles()
+{
+    if(!raw_anglesOutdated)
+        return;
 
-    newMatrix.rotate(qRot);
-    m_Ms.set(newMatrix);
+    raw_angles = angles();
+    raw_qX = Vasnecov::rotationX(raw_angles.x());
+    raw_qY = Vasnecov::rotationY(raw_angles.y());
+    raw_qZ = Vasnecov::rotationZ(raw_angles.z());
+    raw_anglesOutdated = false;
 }
 
 GLenum VasnecovAbstractElement::renderUpdateData()
@@ -207,16 +314,18 @@ GLenum VasnecovAbstractElement::renderUpdateData()
 
 VasnecovElement::VasnecovElement(VasnecovPipeline *pipeline, const QString& name) :
     VasnecovAbstractElement(pipeline, name),
-    m_color(raw_wasUpdated, Color, QColor(255, 255, 255, 255)),
-    m_scale(raw_wasUpdated, Scale, 1.0f),
-    m_isTransparency(raw_wasUpdated, Transparency, false),
+    raw_color(255, 255, 255, 255),
+    raw_scale(1.0f),
+    raw_isTransparency(false),
 
-    pure_distance(0.0f)
+    m_postQueue(nullptr),
+    m_postChannel(),
+    m_postNext(nullptr)
 {
 }
 void VasnecovElement::setColor(const QColor &color)
 {
-    m_color.set(color);
+    designerSet(raw_color, color, Color);
 }
 void VasnecovElement::setColor(GLint r, GLint g, GLint b, GLint a)
 {
@@ -256,74 +365,115 @@ void VasnecovElement::setColorAlphaF(GLfloat alpha)
 }
 QColor VasnecovElement::color() const
 {
-    QColor color(m_color.raw());
+    QColor color(raw_color);
     return color;
 }
 void VasnecovElement::setScale(GLfloat scale)
 {
-    if(m_scale.set(scale))
+    if(designerSet(raw_scale, scale, Scale))
     {
-        designerUpdateMatrixMs();
+        designerRequestMatrixUpdate();
     }
 }
 GLfloat VasnecovElement::scale() const
 {
-    GLfloat scale(m_scale.raw());
+    GLfloat scale(raw_scale);
     return scale;
 }
 GLboolean VasnecovElement::isTransparency() const
 {
-    GLboolean transparency(m_isTransparency.raw());
+    GLboolean transparency(raw_isTransparency);
     return transparency;
 }
 
-bool VasnecovElement::renderCompareByReverseDistance(VasnecovElement *first, VasnecovElement *second)
+void VasnecovElement::postCoordinates(const QVector3D& coordinates)
 {
-    if(first && second && first != second)
-    {
-        if(first->renderDistance() > second->renderDistance())
-        {
-            return true;
-        }
-        else
-        {
-            return false;
-        }
-    }
-    return false;
+    if(!m_postChannel)
+        m_postChannel.reset(new PostChannel());
+
+    m_postChannel->draft.coordinates = coordinates;
+    m_postChannel->draft.fields |= Vasnecov::PostedState::Coordinates;
+    postPublish();
 }
-bool VasnecovElement::renderCompareByDirectDistance(VasnecovElement *first, VasnecovElement *second)
+void VasnecovElement::postAngles(const QVector3D& angles)
 {
-    if(first && second && first != second)
-    {
-        if(first->renderDistance() > second->renderDistance())
-        {
-            return false;
-        }
-        else
-        {
-            return true;
-        }
-    }
-    return false;
+    if(!m_postChannel)
+        m_postChannel.reset(new PostChannel());
+
+    m_postChannel->draft.angles = angles;
+    m_postChannel->draft.fields |= Vasnecov::PostedState::Angles;
+    postPublish();
 }
+void VasnecovElement::postPose(const QVector3D& coordinates, const QVector3D& angles)
+{
+    if(!m_postChannel)
+        m_postChannel.reset(new PostChannel());
 
-void VasnecovElement::designerUpdateMatrixMs()
+    m_postChannel->draft.coordinates = coordinates;
+    m_postChannel->draft.angles = angles;
+    m_postChannel->draft.fields |= Vasnecov::PostedState::Coordinates | Vasnecov::PostedState::Angles;
+    postPublish();
+}
+void VasnecovElement::postColor(const QColor& color)
 {
-    QMatrix4x4 newMatrix;
-    newMatrix.translate(raw_coordinates);
+    if(!m_postChannel)
+        m_postChannel.reset(new PostChannel());
 
-    QQuaternion qRot;
-    qRot = raw_qZ * raw_qX * raw_qY;
+    m_postChannel->draft.color = color;
+    m_postChannel->draft.fields |= Vasnecov::PostedState::Color;
+    postPublish();
+}
+void VasnecovElement::postPublish()
+{
+    PostChannel& channel(*m_postChannel);
 
-    newMatrix.rotate(qRot);
+    // В снимке только поля, изменённые после забранного рендером снимка. Поля незабранного снимка,
+    // который будет вытеснен, переносятся в новый (значения в черновике всегда последние)
+    Vasnecov::PostedState& snapshot(channel.buffer.back());
+    snapshot = channel.draft;
+    if(channel.buffer.isPending())
+        snapshot.fields |= channel.published;
+    channel.published = snapshot.fields;
+    channel.draft.fields = 0;
 
-    if(m_scale.raw() != 1.0f)
+    // Элемент попадает в очередь, только если рендер уже забрал предыдущий снимок
+    if(channel.buffer.publish() && m_postQueue)
+        m_postQueue->push(this);
+}
+
+void VasnecovElement::designerUpdateMatrixMs()
+{
+    m_Ms.set(Vasnecov::transformMatrix(raw_coordinates, raw_qZ * raw_qX * raw_qY, raw_scale));
+}
+void VasnecovElement::designerApplyPoseMatrix(const QMatrix4x4& matrix, GLboolean)
+{
+    if(raw_scale != 1.0f)
+    {
+        QMatrix4x4 newMatrix(matrix);
+        newMatrix.scale(raw_scale, raw_scale, raw_scale);
+        m_Ms.set(newMatrix);
+    }
+    else
     {
-        newMatrix.scale(m_scale.raw(), m_scale.raw(), m_scale.raw());
+        m_Ms.set(matrix);
     }
+}
+void VasnecovElement::designerSetPostQueue(Vasnecov::PostQueue* queue)
+{
+    m_postQueue = queue;
+}
+void VasnecovElement::updaterApplyPosted()
+{
+    if(!m_postChannel || !m_postChannel->buffer.consume())
+        return;
 
-    m_Ms.set(newMatrix);
+    const Vasnecov::PostedState& state(m_postChannel->buffer.front());
+    if(state.fields & Vasnecov::PostedState::Coordinates)
+        setCoordinates(state.coordinates);
+    if(state.fields & Vasnecov::PostedState::Angles)
+        setAngles(state.angles);
+    if(state.fields & Vasnecov::PostedState::Color)
+        setColor(state.color);
 }
 GLenum VasnecovElement::renderUpdateData()
 {
@@ -334,9 +484,15 @@ GLenum VasnecovElement::renderUpdateData()
         pure_pipeline->setSomethingWasUpdated();
 
         // Копирование сырых данных в основные
-        m_color.update();
-        m_scale.update();
-        m_isTransparency.update();
+        if(raw_wasUpdated & Color)
+            pure_state.setColor(raw_color);
+        if(raw_wasUpdated & Scale)
+        {
+            pure_state.scale = raw_scale;
+            pure_state.assign(Vasnecov::RenderState::Scaled, raw_scale != 1.0f);
+        }
+        if(raw_wasUpdated & Transparency)
+            pure_state.assign(Vasnecov::RenderState::Transparent, raw_isTransparency);
 
         VasnecovAbstractElement::renderUpdateData();
     }
@@ -344,7 +500,7 @@ GLenum VasnecovElement::renderUpdateData()
     return updated;
 }
 
-GLfloat VasnecovElement::renderCalculateDistanceToPlane(const QVector3D &planePoint, const QVector3D &normal)
+QVector3D VasnecovElement::renderSortCenter() const
 {
     QVector3D centerPoint;
 
@@ -357,7 +513,172 @@ GLfloat VasnecovElement::renderCalculateDistanceToPlane(const QVector3D &planePo
         centerPoint = m_Ms.pure() * centerPoint;
     }
 
-    pure_distance = centerPoint.distanceToPlane(planePoint, normal);
+    return centerPoint;
+}
+
+Vasnecov::BoundingBox VasnecovElement::renderBoundingBox() const
+{
+    return Vasnecov::BoundingBox();
+}
+
+Vasnecov::BoundingBox VasnecovElement::renderWorldBoundingBox() const
+{
+    return renderBoundingBox().transformed(renderWorldMatrix());
+}
+
+GLboolean VasnecovElement::renderIsVisible(const Vasnecov::Frustum& frustum) const
+{
+    Vasnecov::BoundingBox box(renderWorldBoundingBox());
+    if(!box.isValid())
+        return true;
+
+    return frustum.intersects(box);
+}
+
+GLboolean VasnecovElement::renderBoundsChanged(GLenum updated) const
+{
+    // Масштаб входит в матрицу
+    return (updated & (MatrixMs | AlienMatrix)) != 0;
+}
+
+GLboolean VasnecovElement::renderIntersectRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                              GLfloat& distance, QVector3D& normal) const
+{
+    bool invertible(false);
+    QMatrix4x4 inverse(renderWorldMatrix().inverted(&invertible));
+    if(!invertible)
+        return false;
+
+    // При аффинном преобразовании параметр луча сохраняется
+    QVector3D localNormal;
+    if(!renderIntersectLocalRay(inverse.map(origin), inverse.mapVector(direction), maxDistance, distance, localNormal))
+        return false;
+
+    // Нормали переносятся обратной транспонированной матрицей и разворачиваются к началу луча
+    normal = inverse.transposed().mapVector(localNormal).normalized();
+    if(QVector3D::dotProduct(normal, direction) > 0.0f)
+        normal = -normal;
+    return true;
+}
 
-    return pure_distance;
+GLboolean VasnecovElement::renderIntersectLocalRay(const QVector3D& /*origin*/, const QVector3D& /*direction*/, GLfloat /*maxDistance*/,
+                                                   GLfloat& /*distance*/, QVector3D& /*normal*/) const
+{
+    return false;
+}
+
+void Vasnecov::PostQueue::push(VasnecovElement* element)
+{
+    VasnecovElement* head = m_head.load(std::memory_order_relaxed);
+    do
+    {
+        element->m_postNext = head;
+    }
+    while(!m_head.compare_exchange_weak(head, element, std::memory_order_release, std::memory_order_relaxed));
+}
+VasnecovElement* Vasnecov::PostQueue::take()
+{
+    if(!m_head.load(std::memory_order_relaxed))
+        return nullptr;
+    return m_head.exchange(nullptr, std::memory_order_acquire);
+}
+GLboolean Vasnecov::PostQueue::isEmpty() const
+{
+    return m_head.load(std::memory_order_relaxed) == nullptr;
+}
+
+Vasnecov::UpdateBatch::UpdateBatch(ProductHierarchy* hierarchy) :
+    m_hierarchy(hierarchy),
+    m_depth(0),
+    m_stamp(0),
+    m_deferred(),
+    m_roots()
+{}
+void Vasnecov::UpdateBatch::begin()
+{
+    ++m_depth;
+}
+GLboolean Vasnecov::UpdateBatch::commit()
+{
+    if(!m_depth)
+        return false;
+    if(!--m_depth)
+        resolve();
+
+    return true;
+}
+GLboolean Vasnecov::UpdateBatch::isOpen() const
+{
+    return m_depth > 0;
+}
+void Vasnecov::UpdateBatch::resolve()
+{
+    if(m_deferred.empty())
+    {
+        // Позы без открытого пакета меняют матрицы дерева, не откладывая изделия
+        if(m_hierarchy)
+            m_hierarchy->propagate();
+        return;
+    }
+
+    // Элементы с отложенным предком разрешаются при обходе его поддерева
+    m_roots.clear();
+    for(auto element : m_deferred)
+    {
+        if(!element->raw_dirty)
+            continue;
+
+        VasnecovAbstractElement* parent(element->designerBatchParent());
+        while(parent && !parent->raw_dirty)
+            parent = parent->designerBatchParent();
+
+        if(!parent)
+            m_roots.push_back(element);
+    }
+
+    for(auto element : m_roots)
+    {
+        GLenum dirty(element->raw_dirty);
+        element->raw_dirty = 0;
+        element->designerResolve(dirty);
+    }
+    m_roots.clear();
+
+    // Обход предка не заходит в поддеревья, если наследовать нечего (матрицы дерева считаются ниже)
+    for(size_t i = 0; i < m_deferred.size(); ++i)
+    {
+        VasnecovAbstractElement* element(m_deferred[i]);
+        if(element->raw_dirty)
+        {
+            GLenum dirty(element->raw_dirty);
+            element->raw_dirty = 0;
+            element->designerResolve(dirty);
+        }
+    }
+
+    for(auto element : m_deferred)
+    {
+        element->m_batchDeferred = false;
+        element->raw_dirty = 0;
+    }
+    m_deferred.clear();
+
+    if(m_hierarchy)
+        m_hierarchy->propagate();
+}
+GLboolean Vasnecov::UpdateBatch::isEmpty() const
+{
+    return m_deferred.empty();
+}
+void Vasnecov::UpdateBatch::defer(VasnecovAbstractElement* element)
+{
+    m_deferred.push_back(element);
+}
+void Vasnecov::UpdateBatch::forget(VasnecovAbstractElement* element)
+{
+    m_deferred.erase(std::remove(m_deferred.begin(), m_deferred.end(), element), m_deferred.end());
+}
+quint64 Vasnecov::UpdateBatch::stamp()
+{
+    return ++m_stamp;
 }
@@ -10,14 +10,95 @@
 // Базовый класс для всех элементов сцены, которые можно нарисовать
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <unordered_set>
 #include <QQuaternion>
 #include "CoreObject.h"
 #include "VasnecovPipeline.h"
+#include "Geometry.h"
+#include "TripleBuffer.h"
+
+class VasnecovAbstractElement;
+class VasnecovElement;
+
+namespace Vasnecov
+{
+    class TransparencyOrder;
+    class ProductHierarchy;
+
+    // Отложенные изменения элементов. Изменения иерархий изделий (матрицы, видимость, цвет) только
+    // помечаются и разрешаются сверху вниз один раз за синхронизацию, только для помеченных поддеревьев.
+    // Мировые матрицы изделий дерева hierarchy затем считаются одним его проходом.
+    // Пока открыт пакет, откладывается пересчёт матриц и остальных элементов, а рендер не забирает
+    // изменения, поэтому пакет виден целиком
+    class UpdateBatch
+    {
+    public:
+        explicit UpdateBatch(ProductHierarchy* hierarchy = nullptr);
+
+        void begin(); // Пакеты могут быть вложенными
+        GLboolean commit(); // false, если пакет не был открыт
+        GLboolean isOpen() const;
+
+        void resolve(); // Разрешение всех отложенных изменений
+        GLboolean isEmpty() const;
+
+        void defer(VasnecovAbstractElement* element);
+        void forget(VasnecovAbstractElement* element);
+        quint64 stamp(); // Порядковый номер изменения (для цвета, заданного разным уровням иерархии)
+
+    private:
+        ProductHierarchy* m_hierarchy;
+        GLuint m_depth;
+        quint64 m_stamp;
+        std::vector<VasnecovAbstractElement*> m_deferred;
+        std::vector<VasnecovAbstractElement*> m_roots; // Отложенные элементы без отложенных предков
+
+        Q_DISABLE_COPY(UpdateBatch)
+    };
+
+    // Состояние элемента, публикуемое из внешнего потока
+    struct PostedState
+    {
+        enum Fields
+        {
+            Coordinates = 0x01,
+            Angles      = 0x02,
+            Color       = 0x04
+        };
+
+        GLenum fields; // Какие поля заданы
+        QVector3D coordinates;
+        QVector3D angles;
+        QColor color;
+
+        PostedState() : fields(0), coordinates(), angles(), color() {}
+    };
+
+    // Стек элементов с неприменёнными публикациями: много писателей, один читатель (без блокировок)
+    class PostQueue
+    {
+    public:
+        PostQueue() : m_head(nullptr) {}
+
+        void push(VasnecovElement* element);
+        // Забирает весь стек. Следующий элемент - VasnecovElement::m_postNext
+        VasnecovElement* take();
+        GLboolean isEmpty() const;
+
+    private:
+        std::atomic<VasnecovElement*> m_head;
+
+        Q_DISABLE_COPY(PostQueue)
+    };
+}
 
 class VasnecovAbstractElement : public Vasnecov::CoreObject
 {
 public:
     VasnecovAbstractElement(VasnecovPipeline* pipeline, const QString& name = QString());
+    ~VasnecovAbstractElement();
 
 public:
     // Методы, вызываемые извне (защищенные мьютексами). Без префикса.
@@ -37,6 +118,9 @@ public:
     void incrementAnglesRad(const QVector3D& increment);
     void incrementAnglesRad(GLfloat x, GLfloat y, GLfloat z);
     QVector3D angles() const;
+    // Ориентация кватернионом. Углы после неё вычисляются по требованию
+    void setOrientation(const QQuaternion& orientation);
+    QQuaternion orientation() const;
 
     virtual void setPositionFromElement(const VasnecovAbstractElement* element);
     void attachToElement(const VasnecovAbstractElement* element);
@@ -48,6 +132,23 @@ protected:
     const QMatrix4x4* designerExportingMatrix() const;
     virtual void designerUpdateMatrixMs();
     GLboolean designerRemoveThisAlienMatrix(const QMatrix4x4* alienMs); // Обнуление чужой матрицы, равной заданной параметром
+    GLboolean designerRemoveAlienMatrices(const std::unordered_set<const QMatrix4x4*>& alienMs); // То же для набора матриц
+
+    // Пересчёт матриц после изменения положения. Откладывается в открытом пакете и для иерархий
+    void designerRequestMatrixUpdate();
+    virtual GLboolean designerIsLazy() const; // Изменения всегда откладываются до синхронизации
+    void designerMarkDirty(GLenum dirty);
+    void designerResolvePending() const; // Перед чтением данных, зависящих от отложенных изменений
+    virtual void designerResolve(GLenum dirty); // dirty - свои и унаследованные от предков пометки
+    virtual VasnecovAbstractElement* designerBatchParent() const; // Элемент, изменение которого затрагивает этот
+    void designerSetBatch(Vasnecov::UpdateBatch* batch);
+
+    // Положение с уже вычисленной матрицей сдвига и поворота (пакетная установка положений).
+    // inherited - предок задаётся тем же вызовом
+    void designerSetPose(const QVector3D& coordinates, const QQuaternion& orientation, const QMatrix4x4& matrix,
+                         GLboolean inherited = false);
+    virtual void designerApplyPoseMatrix(const QMatrix4x4& matrix, GLboolean inherited);
+    void designerUpdateAngles(); // Углы по ориентации, заданной кватернионом
 
 protected:
     // Методы, вызываемые рендерером (прямое обращение к основным данным без мьютексов). Префикс render
@@ -56,6 +157,7 @@ protected:
 
     void renderApplyTranslation() const; // Выполнение позиционирования элемента
     const QMatrix4x4& renderMatrixMs() const;
+    QMatrix4x4 renderWorldMatrix() const; // С учётом чужой матрицы
 
     QVector3D renderCoordinates() const;
     QVector3D renderAngles() const;
@@ -64,15 +166,30 @@ protected:
     QVector3D raw_coordinates;
     QVector3D raw_angles;
     QQuaternion raw_qX, raw_qY, raw_qZ;
+    GLboolean raw_anglesOutdated; // Ориентация задана кватернионом в raw_qZ
 
     Vasnecov::MutualData<QMatrix4x4> m_Ms;
     Vasnecov::MutualData<const QMatrix4x4*> m_alienMs;
 
+    Vasnecov::UpdateBatch* m_batch;
+    GLboolean m_batchDeferred; // Элемент в списке отложенных
+    GLenum raw_dirty; // Отложенные изменения
+
     enum Updated // Изменение данных
     {
         MatrixMs		= 0x0008,
         AlienMatrix 	= 0x0010
     };
+    enum Dirty // Отложенные изменения
+    {
+        DirtyMatrix         = 0x01, // Своя матрица и матрицы потомков
+        DirtyChildrenMatrix = 0x02, // Только матрицы потомков
+        DirtyVisibility     = 0x04,
+        DirtyColor          = 0x08
+    };
+
+    friend class VasnecovUniverse;
+    friend class Vasnecov::UpdateBatch;
 
 private:
     Q_DISABLE_COPY(VasnecovAbstractElement)
@@ -101,30 +218,69 @@ public:
     // Прозрачность
     GLboolean isTransparency() const; // Является ли прозрачной
 
+    // Публикация состояния из любого потока без блокировок (например, из потока телеметрии).
+    // У элемента должен быть один публикующий поток, и он прекращает публикации до удаления элемента.
+    // Применяется последнее опубликованное состояние при следующей синхронизации с рендером
+    void postCoordinates(const QVector3D& coordinates);
+    void postAngles(const QVector3D& angles);
+    void postPose(const QVector3D& coordinates, const QVector3D& angles);
+    void postColor(const QColor& color);
+
 protected:
     // Методы без мьютексов, вызываемые методами, защищенными своими мьютексами
     virtual void designerUpdateMatrixMs();
+    void designerApplyPoseMatrix(const QMatrix4x4& matrix, GLboolean inherited);
+    void designerSetPostQueue(Vasnecov::PostQueue* queue);
+    // Применение опубликованного состояния обычными методами (в потоке рендера)
+    void updaterApplyPosted();
+
+private:
+    void postPublish();
 
 protected:
     // Методы, вызываемые рендерером (прямое обращение к основным данным без мьютексов)
     virtual GLenum renderUpdateData(); // обновление данных, вызов должен быть обёрнут мьютексом
 
-    GLfloat renderDistance() const;
-    QColor renderColor() const;
+    const GLubyte* renderColor() const; // RGBA, как для glColor4ubv
     GLfloat renderScale() const;
+    GLboolean renderIsScaled() const; // Масштаб отличается от 1
 
     GLboolean renderIsTransparency() const;
-    virtual GLfloat renderCalculateDistanceToPlane(const QVector3D& planePoint, const QVector3D& normal);
-
-    static bool renderCompareByReverseDistance(VasnecovElement* first, VasnecovElement* second);
-    static bool renderCompareByDirectDistance(VasnecovElement* first, VasnecovElement* second);
+    virtual QVector3D renderSortCenter() const; // Точка сортировки прозрачных в координатах мира
+
+    // Отсечение по пирамиде видимости. Элемент без бокса не отсекается
+    virtual Vasnecov::BoundingBox renderBoundingBox() const; // В собственных координатах
+    virtual Vasnecov::BoundingBox renderWorldBoundingBox() const; // В координатах мира
+    virtual GLboolean renderIsVisible(const Vasnecov::Frustum& frustum) const;
+    // Изменились ли мировые границы при обновлении с флагами updated
+    virtual GLboolean renderBoundsChanged(GLenum updated) const;
+
+    // Пересечение с лучом в координатах мира (distance - в длинах direction).
+    // Луч переводится в собственные координаты, поэтому учитываются иерархия, чужая матрица и масштаб
+    GLboolean renderIntersectRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                 GLfloat& distance, QVector3D& normal) const;
+    // То же в собственных координатах. По умолчанию элемент не пересекается
+    virtual GLboolean renderIntersectLocalRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                              GLfloat& distance, QVector3D& normal) const;
 
 protected:
-    Vasnecov::MutualData<QColor> m_color; // Цвет
-    Vasnecov::MutualData<GLfloat> m_scale; // Масштаб
-    Vasnecov::MutualData<GLboolean> m_isTransparency; // Прозрачность
+    // Для рендера - в pure_state
+    QColor raw_color; // Цвет
+    GLfloat raw_scale; // Масштаб
+    GLboolean raw_isTransparency; // Прозрачность
+
+    // Канал публикаций, создаётся при первой публикации
+    struct PostChannel
+    {
+        Vasnecov::TripleBuffer<Vasnecov::PostedState> buffer;
+        Vasnecov::PostedState draft; // Последние значения; fields - изменённые после последней публикации
+        GLenum published; // Поля последнего опубликованного снимка
 
-    GLfloat pure_distance; // Расстояние от ЦМ объекта до плоскости камеры (для сортировки)
+        PostChannel() : buffer(), draft(), published(0) {}
+    };
+    Vasnecov::PostQueue* m_postQueue;
+    std::unique_ptr<PostChannel> m_postChannel;
+    VasnecovElement* m_postNext; // Связь в PostQueue
 
     enum Updated// Изменение данных
     {
@@ -135,6 +291,8 @@ protected:
 
     friend class VasnecovUniverse;
     friend class VasnecovWorld;
+    friend class Vasnecov::PostQueue;
+    friend class Vasnecov::TransparencyOrder;
 
 private:
     Q_DISABLE_COPY(VasnecovElement)
@@ -154,8 +312,16 @@ inline void VasnecovAbstractElement::renderApplyTranslation() const
         pure_pipeline->setMatrixMV(m_Ms.pure());
     }
 }
+inline QMatrix4x4 VasnecovAbstractElement::renderWorldMatrix() const
+{
+    if(m_alienMs.pure())
+        return (*m_alienMs.pure()) * m_Ms.pure();
+
+    return m_Ms.pure();
+}
 inline QMatrix4x4 VasnecovAbstractElement::designerMatrixMs() const
 {
+    designerResolvePending();
     return m_Ms.raw();
 }
 inline const QMatrix4x4 *VasnecovAbstractElement::designerExportingMatrix() const
@@ -173,26 +339,35 @@ inline GLboolean VasnecovAbstractElement::designerRemoveThisAlienMatrix(const QM
     }
     return false;
 }
+inline GLboolean VasnecovAbstractElement::designerRemoveAlienMatrices(const std::unordered_set<const QMatrix4x4*>& alienMs)
+{
+    if(m_alienMs.raw() && alienMs.count(m_alienMs.raw()))
+    {
+        m_alienMs.set(nullptr);
+        return true;
+    }
+    return false;
+}
 inline const QMatrix4x4 &VasnecovAbstractElement::renderMatrixMs() const
 {
     return m_Ms.pure();
 }
 
-inline GLfloat VasnecovElement::renderDistance() const
-{
-    return pure_distance;
-}
-inline QColor VasnecovElement::renderColor() const
+inline const GLubyte* VasnecovElement::renderColor() const
 {
-    return m_color.pure();
+    return pure_state.color;
 }
 
 inline GLfloat VasnecovElement::renderScale() const
 {
-    return m_scale.pure();
+    return pure_state.scale;
+}
+inline GLboolean VasnecovElement::renderIsScaled() const
+{
+    return pure_state.has(Vasnecov::RenderState::Scaled);
 }
 
 inline GLboolean VasnecovElement::renderIsTransparency() const
 {
-    return m_isTransparency.pure();
+    return pure_state.has(Vasnecov::RenderState::Transparent);
 }
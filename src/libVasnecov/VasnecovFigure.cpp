@@ -287,7 +287,7 @@ void VasnecovFigure::createLine(GLfloat length, const QColor &color)
 
         if(color.isValid())
         {
-            m_color.set(color);
+            designerSet(raw_color, color, Color);
         }
 
         m_points.set(std::vector<QVector3D>{QVector3D(0.0, 0.0, 0.0), QVector3D(length, 0.0, 0.0)});
@@ -302,7 +302,7 @@ void VasnecovFigure::createLine(const QVector3D &first, const QVector3D &second,
 
         if(color.isValid())
         {
-            m_color.set(color);
+            designerSet(raw_color, color, Color);
         }
 
         m_points.set(std::vector<QVector3D>{first, second});
@@ -325,7 +325,7 @@ void VasnecovFigure::createCircle(GLfloat r, const QColor &color, GLuint factor)
 
         if(color.isValid())
         {
-            m_color.set(color);
+            designerSet(raw_color, color, Color);
         }
 
         std::vector<QVector3D> circ;
@@ -351,7 +351,7 @@ void VasnecovFigure::createArc(GLfloat r, GLfloat startAngle, GLfloat spanAngle,
 
         if(color.isValid())
         {
-            m_color.set(color);
+            designerSet(raw_color, color, Color);
         }
 
         startAngle *= c_degToRad;
@@ -401,7 +401,7 @@ void VasnecovFigure::createPie(GLfloat r, GLfloat startAngle, GLfloat spanAngle,
 
         if(color.isValid())
         {
-            m_color.set(color);
+            designerSet(raw_color, color, Color);
         }
 
         startAngle *= c_degToRad;
@@ -452,7 +452,7 @@ void VasnecovFigure::createSquareGrid(GLfloat width, GLfloat height, const QColo
 
         if(color.isValid())
         {
-            m_color.set(color);
+            designerSet(raw_color, color, Color);
         }
 
         std::vector<QVector3D> points;
@@ -505,7 +505,7 @@ void VasnecovFigure::createMeshFromFile(const QString& fileName, const QColor &c
 
     if(color.isValid())
     {
-        m_color.set(color);
+        designerSet(raw_color, color, Color);
     }
 
     m_points.set(readPointsFromObj(fileName));
@@ -517,7 +517,7 @@ void VasnecovFigure::createMeshFromPoints(const std::vector<QVector3D> &points,
 
     if(color.isValid())
     {
-        m_color.set(color);
+        designerSet(raw_color, color, Color);
     }
 
     m_points.set(points);
@@ -583,11 +583,11 @@ GLenum VasnecovFigure::renderUpdateData()
     // Проверка прозрачности
     GLboolean transp = false;
 
-    if(m_color.raw().alphaF() < 1.0)
+    if(Vasnecov::RenderState::isTranslucent(raw_color))
     {
         transp = true;
     }
-    m_isTransparency.set(transp);
+    designerSet(raw_isTransparency, transp, Transparency);
 
     // Далее, как обычно
     GLenum updated(raw_wasUpdated);
@@ -615,21 +615,21 @@ GLenum VasnecovFigure::renderUpdateData()
 }
 void VasnecovFigure::renderDraw()
 {
-    if(!m_isHidden.pure())
+    if(!renderIsHidden())
     {
         renderApplyTranslation();
 
         pure_pipeline->activateLamps(m_lighting.pure());
         pure_pipeline->activateDepth(m_depth.pure());
 
-        pure_pipeline->setColor(m_color.pure());
+        pure_pipeline->setColor(renderColor());
         pure_pipeline->setLineWidth(m_thickness.pure());
         pure_pipeline->setPointSize(m_thickness.pure());
 
         if(renderLineStyle())
             pure_pipeline->enableLineStipple(1, renderLineStyle());
 
-        bool normalize = (m_scale.pure() != 1.0f) &&
+        bool normalize = (renderIsScaled()) &&
                          (m_type.pure() == VasnecovPipeline::Triangles ||
                           m_type.pure() == VasnecovPipeline::FanTriangle ||
                           m_type.pure() == VasnecovPipeline::StripTriangle);
@@ -648,7 +648,119 @@ void VasnecovFigure::renderDraw()
     }
 }
 
-GLfloat VasnecovFigure::renderCalculateDistanceToPlane(const QVector3D &planePoint, const QVector3D &normal)
+GLboolean VasnecovFigure::renderIntersectLocalRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                                 GLfloat& distance, QVector3D& normal) const
+{
+    if(!renderIsSolid())
+        return false;
+
+    const std::vector<QVector3D>& vertices(*m_points.pureVertices());
+    const std::vector<GLuint>& indices(*m_points.pureIndices());
+    GLboolean found(false);
+
+    auto test = [&](GLuint i0, GLuint i1, GLuint i2)
+    {
+        const QVector3D& a(vertices[indices[i0]]);
+        const QVector3D& b(vertices[indices[i1]]);
+        const QVector3D& c(vertices[indices[i2]]);
+
+        GLfloat t(0.0f);
+        if(Vasnecov::intersectTriangle(origin, direction, a, b, c, t) && t <= maxDistance)
+        {
+            maxDistance = t;
+            distance = t;
+            normal = QVector3D::crossProduct(b - a, c - a);
+            found = true;
+        }
+    };
+
+    const GLuint amount(static_cast<GLuint>(indices.size()));
+    switch(m_type.pure())
+    {
+        case VasnecovPipeline::Triangles:
+            for(GLuint i = 0; i + 2 < amount; i += 3)
+                test(i, i + 1, i + 2);
+            break;
+        case VasnecovPipeline::FanTriangle:
+            for(GLuint i = 1; i + 1 < amount; ++i)
+                test(0, i, i + 1);
+            break;
+        case VasnecovPipeline::StripTriangle:
+            for(GLuint i = 0; i + 2 < amount; ++i)
+                test(i, i + 1, i + 2);
+            break;
+        default:
+            break;
+    }
+
+    return found;
+}
+
+GLboolean VasnecovFigure::renderApproachRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                           GLfloat tolerance, GLfloat toleranceSlope,
+                                           GLfloat& distance, QVector3D& point) const
+{
+    if(renderIsSolid())
+        return false;
+
+    const std::vector<QVector3D>& vertices(*m_points.pureVertices());
+    const std::vector<GLuint>& indices(*m_points.pureIndices());
+    if(indices.empty())
+        return false;
+
+    const QMatrix4x4 matrix(renderWorldMatrix());
+    const QVector3D segment(direction * maxDistance); // Параметр отрезка луча в [0; 1]
+    GLboolean found(false);
+
+    auto test = [&](GLuint i0, GLuint i1)
+    {
+        const QVector3D a(matrix.map(vertices[indices[i0]]));
+        const QVector3D b(matrix.map(vertices[indices[i1]]));
+
+        GLfloat t(0.0f);
+        QVector3D closest;
+        GLfloat squared = Vasnecov::closestToSegment(origin, segment, a, b, t, closest);
+        t *= maxDistance;
+
+        GLfloat allowed(tolerance + t * toleranceSlope);
+        if(t <= distance && squared <= allowed * allowed)
+        {
+            distance = t;
+            point = closest;
+            found = true;
+        }
+    };
+
+    distance = maxDistance;
+    const GLuint amount(static_cast<GLuint>(indices.size()));
+    switch(m_type.pure())
+    {
+        case VasnecovPipeline::Points:
+            for(GLuint i = 0; i < amount; ++i)
+                test(i, i);
+            break;
+        case VasnecovPipeline::Lines:
+            for(GLuint i = 0; i + 1 < amount; i += 2)
+                test(i, i + 1);
+            break;
+        case VasnecovPipeline::LoopLine:
+            if(amount > 2)
+                test(amount - 1, 0);
+            // fall through
+        case VasnecovPipeline::PolyLine:
+            for(GLuint i = 0; i + 1 < amount; ++i)
+                test(i, i + 1);
+            if(amount == 1)
+                test(0, 0);
+            break;
+        default:
+            break;
+    }
+
+    return found;
+}
+
+QVector3D VasnecovFigure::renderSortCenter() const
 {
     QVector3D centerPoint = m_points.cm();
 
@@ -661,7 +773,5 @@ GLfloat VasnecovFigure::renderCalculateDistanceToPlane(const QVector3D &planePoi
         centerPoint = m_Ms.pure() * centerPoint;
     }
 
-    pure_distance = centerPoint.distanceToPlane(planePoint, normal);
-
-    return pure_distance;
+    return centerPoint;
 }
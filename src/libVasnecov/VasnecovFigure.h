@@ -96,7 +96,18 @@ protected:
     GLenum renderUpdateData();
     void renderDraw();
 
-    GLfloat renderCalculateDistanceToPlane(const QVector3D& planePoint, const QVector3D& normal);
+    QVector3D renderSortCenter() const;
+    Vasnecov::BoundingBox renderBoundingBox() const;
+    GLboolean renderBoundsChanged(GLenum updated) const;
+    // Пересечение с залитыми фигурами
+    GLboolean renderIntersectLocalRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                      GLfloat& distance, QVector3D& normal) const;
+    GLboolean renderIsSolid() const;
+    // Сближение линий и точек с лучом в координатах мира. Допуск растёт вдоль луча
+    // как tolerance + t * toleranceSlope (пиксельный допуск в перспективе)
+    GLboolean renderApproachRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                GLfloat tolerance, GLfloat toleranceSlope,
+                                GLfloat& distance, QVector3D& point) const;
 
     GLenum renderType() const;
     GLushort renderLineStyle() const;
@@ -109,7 +120,7 @@ private:
     class VertexManager
     {
     public:
-        VertexManager(GLenum& wasUpdated, const GLenum flag, GLboolean optimize = false) :
+        VertexManager(Vasnecov::UpdateFlags& wasUpdated, const GLenum flag, GLboolean optimize = false) :
             m_flag(flag),
             m_wasUpdated(wasUpdated),
             m_optimize(optimize),
@@ -123,7 +134,9 @@ private:
             pure_indices(),
 #endif
             raw_cm(),
-            pure_cm()
+            pure_cm(),
+            raw_box(),
+            pure_box()
         {}
         void setOptimization(GLboolean optimize)
         {
@@ -306,6 +319,7 @@ private:
                 pure_indices  = raw_indices;
 #endif
                 pure_cm = raw_cm;
+                pure_box = raw_box;
 
                 m_wasUpdated = m_wasUpdated &~ m_flag; // Удаление своего флага из общего
                 return m_flag;
@@ -325,6 +339,10 @@ private:
         {
             return pure_cm;
         }
+        const Vasnecov::BoundingBox& box() const
+        {
+            return pure_box;
+        }
 
     private:
         GLboolean optimizedIndex(const QVector3D& vert, GLuint& fIndex) const
@@ -370,11 +388,13 @@ private:
             m_wasUpdated |= m_flag;
 
             raw_cm = QVector3D(); // Нулевой по умолчанию
+            raw_box = Vasnecov::BoundingBox();
             if(!raw_vertices.empty())
             {
                 for(GLuint i = 0; i < raw_vertices.size(); ++i)
                 {
                     raw_cm += raw_vertices[i];
+                    raw_box.add(raw_vertices[i]);
                 }
                 raw_cm /= raw_vertices.size();
             }
@@ -382,7 +402,7 @@ private:
 
     private:
         const GLenum m_flag; // Флаг. Идентификатор, выдаваемый результатом синхронизации update()
-        GLenum& m_wasUpdated; // Ссылка на общий флаг обновлений
+        Vasnecov::UpdateFlags& m_wasUpdated; // Ссылка на общий флаг обновлений
         GLboolean m_optimize;
 
         std::vector<QVector3D> raw_vertices; // Точки сырых данных
@@ -396,6 +416,8 @@ private:
 #endif
         QVector3D raw_cm;
         QVector3D pure_cm;
+        Vasnecov::BoundingBox raw_box;
+        Vasnecov::BoundingBox pure_box;
     };
 
     Vasnecov::MutualData<VasnecovPipeline::ElementDrawingMethods> m_type; // Тип отрисовки
@@ -464,6 +486,21 @@ inline QVector3D VasnecovFigure::renderCm() const
 {
     return m_points.cm();
 }
+inline Vasnecov::BoundingBox VasnecovFigure::renderBoundingBox() const
+{
+    return m_points.box();
+}
+inline GLboolean VasnecovFigure::renderBoundsChanged(GLenum updated) const
+{
+    return VasnecovElement::renderBoundsChanged(updated) || (updated & Points) != 0;
+}
+
+inline GLboolean VasnecovFigure::renderIsSolid() const
+{
+    return m_type.pure() == VasnecovPipeline::Triangles ||
+           m_type.pure() == VasnecovPipeline::FanTriangle ||
+           m_type.pure() == VasnecovPipeline::StripTriangle;
+}
 
 inline GLboolean VasnecovFigure::renderLighting() const
 {
@@ -246,7 +246,7 @@ GLenum VasnecovLabel::renderUpdateData()
 }
 void VasnecovLabel::renderDraw()
 {
-    if(!m_isHidden.pure() && m_texture)
+    if(!renderIsHidden() && m_texture)
     {
         // Позиционирование
         if(m_alienMs.pure())
@@ -259,13 +259,29 @@ void VasnecovLabel::renderDraw()
         }
 
         // Растровая часть
-        pure_pipeline->setColor(m_color.pure());
+        pure_pipeline->setColor(renderColor());
         pure_pipeline->enableTexture2D(m_texture->id());
 
         pure_pipeline->drawElements(VasnecovPipeline::Triangles, &m_indices, &m_vertices, nullptr, &m_textures);
     }
 }
 
+Vasnecov::BoundingBox VasnecovLabel::renderWorldBoundingBox() const
+{
+    // Та же матрица, что и при отрисовке
+    QMatrix4x4 matrix(m_Ms.pure());
+    if(m_alienMs.pure())
+        matrix = matrix * (*m_alienMs.pure());
+
+    QVector3D anchor(matrix.column(3).toVector3D());
+    return Vasnecov::BoundingBox(anchor, anchor);
+}
+
+GLboolean VasnecovLabel::renderIsVisible(const Vasnecov::Frustum& frustum) const
+{
+    return frustum.contains(renderWorldBoundingBox().minimum());
+}
+
 void VasnecovLabel::updaterRemoveOldPersonalTexture()
 {
     if(m_personalTexture)
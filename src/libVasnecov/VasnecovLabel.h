@@ -68,7 +68,10 @@ protected:
 
 protected:
     GLenum renderUpdateData();
+    GLboolean renderUpdateNeedsContext() const; // Обновление загружает или удаляет текстуры
     void renderDraw();
+    Vasnecov::BoundingBox renderWorldBoundingBox() const; // Точка привязки
+    GLboolean renderIsVisible(const Vasnecov::Frustum& frustum) const;
 
     VasnecovTexture* texture() const {return m_texture;}
 
@@ -103,6 +106,11 @@ private:
 };
 
 
+inline GLboolean VasnecovLabel::renderUpdateNeedsContext() const
+{
+    return updaterIsUpdateFlag(Image | Texture);
+}
+
 inline void VasnecovLabel::setSize(GLfloat width, GLfloat height)
 {
     raw_dataLabel.size.setX(width);
@@ -137,7 +137,7 @@ GLenum VasnecovLamp::renderUpdateData()
 }
 void VasnecovLamp::renderDraw()
 {
-    if(!m_isHidden.pure())
+    if(!renderIsHidden())
     {
         pure_pipeline->enableConcreteLamp(pure_index);
 
@@ -34,6 +34,7 @@ VasnecovMesh::VasnecovMesh(const QString& meshPath, const QString& name)
     , _borderBoxVertices(8)
     , _borderBoxIndices(24)
     , _massCenter()
+    , _triangles()
     , _magicNumber(qToBigEndian(0x766d6601))
 {
 }
@@ -52,6 +53,7 @@ GLboolean VasnecovMesh::loadModel(const QString &path, GLboolean readFromMTL)
 {
     _meshPath = path;
     _type = VasnecovPipeline::Points;
+    _triangles.clear();
 
     // Списки для данных в грубом виде
     std::vector <TrianglesIndices> rawIndices; // Набор индексов для всего подряд
@@ -417,6 +419,9 @@ GLboolean VasnecovMesh::loadModel(const QString &path, GLboolean readFromMTL)
 
     optimizeData();
     calculateBox();
+    // Дерево для поиска пересечений строится здесь, а не при запросе (pick не должен менять общий меш)
+    if(_type == VasnecovPipeline::Triangles)
+        _triangles.build(_vertices, _indices);
 
     // Выставление флагов
     _isLoaded = true;
@@ -433,6 +438,7 @@ GLboolean VasnecovMesh::loadRawModel()
 GLboolean VasnecovMesh::loadRawModel(const QString& path)
 {
     _meshPath = path;
+    _triangles.clear();
     QFile rawFile(path);
     if(!rawFile.open(QIODevice::ReadOnly))
     {
@@ -514,6 +520,8 @@ GLboolean VasnecovMesh::loadRawModel(const QString& path)
     _type = static_cast<VasnecovPipeline::ElementDrawingMethods>(type);
 
     calculateBox();
+    if(_type == VasnecovPipeline::Triangles)
+        _triangles.build(_vertices, _indices);
 
     _isLoaded = true;
     _isHidden = false;
@@ -579,6 +587,15 @@ void VasnecovMesh::drawBorderBox(VasnecovPipeline* pipeline)
  */
 
 
+GLboolean VasnecovMesh::intersectRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                     GLfloat& distance, QVector3D& normal) const
+{
+    if(!_isLoaded || _type != VasnecovPipeline::Triangles)
+        return false;
+
+    return _triangles.intersectRay(origin, direction, maxDistance, distance, normal);
+}
+
 GLboolean VasnecovMesh::writeRawModel(const QString& path)
 {
     if(!_isLoaded)
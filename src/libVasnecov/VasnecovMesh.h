@@ -15,6 +15,7 @@
 #include <QVector3D>
 #include "Configuration.h"
 #include "VasnecovPipeline.h"
+#include "BoundingVolumeHierarchy.h"
 
 class VasnecovMesh
 {
@@ -30,6 +31,11 @@ public:
     void drawModel(VasnecovPipeline* pipeline); // Отрисовка модели
     void drawBorderBox(VasnecovPipeline* pipeline); // Рисовать ограничивающий бокс
     const QVector3D& massCenter() const;
+    Vasnecov::BoundingBox box() const; // Ограничивающий бокс в координатах модели
+    // Пересечение с лучом в координатах модели (только для треугольников).
+    // Дерево треугольников строится при первом вызове
+    GLboolean intersectRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                           GLfloat& distance, QVector3D& normal) const;
 
     GLboolean writeRawModel(const QString& path);
 
@@ -61,6 +67,7 @@ private:
     std::vector<QVector3D>  _borderBoxVertices; // Координаты ограничивающего бокса
     std::vector<GLuint>     _borderBoxIndices; // Индексы для ограничивающего бокса
     QVector3D               _massCenter; // Координата центра масс (по вершинам ограничивающей коробки)
+    Vasnecov::TriangleHierarchy _triangles; // Для поиска пересечений, строится при загрузке
 
     uint32_t                _magicNumber; // Always in BE (ex. 76 6d 66 01)
 
@@ -143,6 +150,13 @@ inline const QVector3D& VasnecovMesh::massCenter() const
 {
     return _massCenter;
 }
+inline Vasnecov::BoundingBox VasnecovMesh::box() const
+{
+    if(!_isLoaded || _vertices.empty())
+        return Vasnecov::BoundingBox();
+
+    return Vasnecov::BoundingBox(_borderBoxVertices[0], _borderBoxVertices[6]);
+}
 
 template<typename T>
 T VasnecovMesh::getPartOfArray(const char * &fromPos, const T &)
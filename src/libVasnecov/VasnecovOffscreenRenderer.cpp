@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "VasnecovOffscreenRenderer.h"
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QSurfaceFormat>
+#include "Technologist.h"
+#include "VasnecovUniverse.h"
+
+VasnecovOffscreenRenderer::VasnecovOffscreenRenderer(const QSize& size) :
+    m_surface(nullptr),
+    m_context(nullptr),
+    m_framebuffer(nullptr),
+    m_universe(nullptr),
+    m_size(size)
+{
+    // Конвейер использует фиксированную функциональность, поэтому нужен профиль совместимости
+    QSurfaceFormat format;
+    format.setRenderableType(QSurfaceFormat::OpenGL);
+    format.setProfile(QSurfaceFormat::CompatibilityProfile);
+    format.setVersion(2, 1);
+    format.setDepthBufferSize(24);
+    format.setStencilBufferSize(8);
+
+    m_context = new QOpenGLContext();
+    m_context->setFormat(format);
+    if(!m_context->create())
+    {
+        Vasnecov::problem("Can't create offscreen OpenGL context");
+        return;
+    }
+
+    m_surface = new QOffscreenSurface();
+    m_surface->setFormat(m_context->format());
+    m_surface->create();
+    if(!m_surface->isValid())
+    {
+        Vasnecov::problem("Can't create offscreen surface");
+        return;
+    }
+
+    if(!makeCurrent())
+        return;
+
+    if(!QOpenGLFramebufferObject::hasOpenGLFramebufferObjects())
+    {
+        Vasnecov::problem("Framebuffer objects are not supported");
+        return;
+    }
+
+    createFramebuffer();
+}
+
+VasnecovOffscreenRenderer::~VasnecovOffscreenRenderer()
+{
+    if(m_context && m_surface && m_surface->isValid())
+        m_context->makeCurrent(m_surface);
+
+    delete m_framebuffer;
+    m_framebuffer = nullptr;
+
+    if(m_context)
+        m_context->doneCurrent();
+
+    delete m_context;
+    delete m_surface;
+}
+
+GLboolean VasnecovOffscreenRenderer::setUniverse(VasnecovUniverse* universe)
+{
+    if(!universe || !makeCurrent())
+        return false;
+
+    m_universe = universe;
+    m_universe->renderInitialize();
+
+    return true;
+}
+
+GLboolean VasnecovOffscreenRenderer::setSize(const QSize& size)
+{
+    if(size.width() <= 0 || size.height() <= 0)
+    {
+        Vasnecov::problem("Incorrect offscreen size");
+        return false;
+    }
+
+    if(size == m_size && m_framebuffer)
+        return true;
+
+    m_size = size;
+
+    if(!makeCurrent())
+        return false;
+
+    return createFramebuffer();
+}
+
+GLboolean VasnecovOffscreenRenderer::makeCurrent()
+{
+    if(!m_context || !m_surface || !m_surface->isValid())
+        return false;
+
+    if(!m_context->makeCurrent(m_surface))
+    {
+        Vasnecov::problem("Can't make offscreen context current");
+        return false;
+    }
+    return true;
+}
+
+void VasnecovOffscreenRenderer::doneCurrent()
+{
+    if(m_context)
+        m_context->doneCurrent();
+}
+
+GLboolean VasnecovOffscreenRenderer::renderFrame()
+{
+    if(!m_universe || !m_framebuffer || !makeCurrent())
+        return false;
+
+    m_framebuffer->bind();
+    m_universe->renderDrawAll(m_size.width(), m_size.height());
+
+    return true;
+}
+
+QImage VasnecovOffscreenRenderer::renderImage()
+{
+    if(!renderFrame())
+        return QImage();
+
+    // Альфа в буфере цвета не несёт смысла (фон очищается нулевой альфой)
+    return m_framebuffer->toImage().convertToFormat(QImage::Format_RGB32);
+}
+
+GLboolean VasnecovOffscreenRenderer::renderToBuffer(std::vector<uchar>& buffer)
+{
+    if(!renderFrame())
+        return false;
+
+    buffer.resize(static_cast<size_t>(m_size.width()) * m_size.height() * 4);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, m_size.width(), m_size.height(), GL_RGBA, GL_UNSIGNED_BYTE, buffer.data());
+
+    return true;
+}
+
+void VasnecovOffscreenRenderer::finish()
+{
+    if(makeCurrent())
+        glFinish();
+}
+
+GLboolean VasnecovOffscreenRenderer::createFramebuffer()
+{
+    delete m_framebuffer;
+    m_framebuffer = new QOpenGLFramebufferObject(m_size, QOpenGLFramebufferObject::CombinedDepthStencil);
+
+    if(!m_framebuffer->isValid())
+    {
+        Vasnecov::problem("Can't create offscreen framebuffer");
+        delete m_framebuffer;
+        m_framebuffer = nullptr;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Отрисовка без окна: собственный контекст OpenGL на QOffscreenSurface и FBO.
+// Требует существующего QGuiApplication (подойдёт платформа offscreen или minimal).
+#pragma once
+
+#include <vector>
+#include <QImage>
+#include <QSize>
+#include "Configuration.h"
+
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+class VasnecovUniverse;
+
+class VasnecovOffscreenRenderer
+{
+public:
+    explicit VasnecovOffscreenRenderer(const QSize& size = QSize(Vasnecov::cfg_displayWidthDefault,
+                                                                 Vasnecov::cfg_displayHeightDefault));
+    ~VasnecovOffscreenRenderer();
+
+    GLboolean isValid() const;
+
+    GLboolean setUniverse(VasnecovUniverse* universe);
+    VasnecovUniverse* universe() const;
+
+    GLboolean setSize(const QSize& size);
+    GLboolean setSize(GLsizei width, GLsizei height);
+    QSize size() const;
+
+    GLboolean makeCurrent();
+    void doneCurrent();
+
+    // Отрисовка кадра в FBO без чтения результата
+    GLboolean renderFrame();
+    // Отрисовка и чтение в картинку (без альфа-канала)
+    QImage renderImage();
+    // Отрисовка и чтение в буфер RGBA, строки снизу вверх (как в OpenGL)
+    GLboolean renderToBuffer(std::vector<uchar>& buffer);
+    // Ожидание окончания отрисовки (для замеров времени)
+    void finish();
+
+    QOpenGLContext* context() const;
+    QOpenGLFramebufferObject* framebuffer() const;
+
+private:
+    GLboolean createFramebuffer();
+
+private:
+    QOffscreenSurface* m_surface;
+    QOpenGLContext* m_context;
+    QOpenGLFramebufferObject* m_framebuffer;
+    VasnecovUniverse* m_universe;
+    QSize m_size;
+
+    Q_DISABLE_COPY(VasnecovOffscreenRenderer)
+};
+
+inline GLboolean VasnecovOffscreenRenderer::isValid() const
+{
+    return m_framebuffer != nullptr;
+}
+inline VasnecovUniverse* VasnecovOffscreenRenderer::universe() const
+{
+    return m_universe;
+}
+inline GLboolean VasnecovOffscreenRenderer::setSize(GLsizei width, GLsizei height)
+{
+    return setSize(QSize(width, height));
+}
+inline QSize VasnecovOffscreenRenderer::size() const
+{
+    return m_size;
+}
+inline QOpenGLContext* VasnecovOffscreenRenderer::context() const
+{
+    return m_context;
+}
+inline QOpenGLFramebufferObject* VasnecovOffscreenRenderer::framebuffer() const
+{
+    return m_framebuffer;
+}
@@ -15,7 +15,7 @@
 VasnecovPipeline::VasnecovPipeline(QGLContext* context) :
     m_context(context),
     m_backgroundColor(0, 0, 0, 255),
-    m_color(255, 255, 255, 255),
+    m_color{255, 255, 255, 255},
     m_drawingType(Vasnecov::PolygonDrawingTypeNormal),
     m_texture2D(0),
     m_P(),
@@ -46,7 +46,10 @@ VasnecovPipeline::VasnecovPipeline(QGLContext* context) :
     m_lineWidth(1.0f),
     m_pointSize(1.0f),
 
-    m_wasSomethingUpdated(true)
+    m_wasSomethingUpdated(true),
+
+    m_profiler(),
+    m_transparency()
 
 //	m_config()
 {
@@ -148,6 +151,27 @@ void VasnecovPipeline::unsetOrtho2D()
 
     glMatrixMode(GL_MODELVIEW);
 }
+GLboolean VasnecovPipeline::beginWeightedTransparency()
+{
+    if(!m_transparency.isSupported())
+        return false;
+
+    return m_transparency.renderBegin(m_viewX, m_viewY, m_viewWidth, m_viewHeight, m_flagTexture2D);
+}
+void VasnecovPipeline::endWeightedTransparency()
+{
+    if(!m_transparency.isActive())
+        return;
+
+    m_transparency.renderEnd();
+
+    // Состояние, изменённое наложением
+    glBindTexture(GL_TEXTURE_2D, m_texture2D);
+    activateDepth(m_flagDepth, true);
+    setDrawingType(m_drawingType, true);
+    if(!m_blending)
+        glDisable(GL_BLEND);
+}
 void VasnecovPipeline::setViewport(GLint x, GLint y, GLsizei width, GLsizei height)
 {
     m_viewX = x;
@@ -189,10 +213,17 @@ QVector4D VasnecovPipeline::projectPoint(const QMatrix4x4 &MV, const QVector3D &
 }
 void VasnecovPipeline::setColor(const QColor &color)
 {
-    if(color != m_color)
+    QRgb rgba(color.rgba());
+    const GLubyte packed[4] = {static_cast<GLubyte>(qRed(rgba)), static_cast<GLubyte>(qGreen(rgba)),
+                               static_cast<GLubyte>(qBlue(rgba)), static_cast<GLubyte>(qAlpha(rgba))};
+    setColor(packed);
+}
+void VasnecovPipeline::setColor(const GLubyte* color)
+{
+    if(!std::equal(color, color + 4, m_color))
     {
-        m_color = color;
-        glColor4f(m_color.redF(), m_color.greenF(), m_color.blueF(), m_color.alphaF());
+        std::copy(color, color + 4, m_color);
+        glColor4ubv(m_color);
     }
 }
 void VasnecovPipeline::setAmbientColor(const QColor &color)
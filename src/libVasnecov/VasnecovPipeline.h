@@ -10,11 +10,14 @@
 // "Виртуализация" конвейера OpenGL
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <QColor>
 #include <QMatrix4x4>
 #include <QVector2D>
 #include "Types.h"
+#include "Statistics.h"
+#include "WeightedTransparency.h"
 
 class QGLContext;
 
@@ -105,9 +108,13 @@ public:
 
     void setBackgroundColor(const QColor& color = QColor(0, 0, 0, 0));
     void setColor(const QColor& color = QColor(255, 255, 255, 255));
+    void setColor(const GLubyte* color); // RGBA, как для glColor4ubv
 
     void enableTexture2D(GLuint m_texture2D, GLboolean strong = false);
     void disableTexture2D(GLboolean strong = false);
+    // Для текстур, создаваемых и удаляемых в обход конвейера
+    void restoreTexture2D() const; // Возврат привязки активной текстуры
+    void forgetTexture2D(GLuint texture); // Удалённая текстура перестаёт быть активной (привязка сброшена в 0)
 
     void setAmbientColor(const QColor& color);
 
@@ -162,7 +169,18 @@ public:
                       const std::vector<QVector2D>* textures = nullptr,
                       const std::vector<QVector3D>* colors = nullptr) const;
 
-    void setSomethingWasUpdated() {m_wasSomethingUpdated = true;}
+    // Вызывается и из параллельного обновления элементов. Лишняя запись не делается, чтобы потоки не делили строку кэша
+    void setSomethingWasUpdated()
+    {
+        if(!m_wasSomethingUpdated.load(std::memory_order_relaxed))
+            m_wasSomethingUpdated.store(true, std::memory_order_relaxed);
+    }
+
+    Vasnecov::RenderProfiler& profiler() {return m_profiler;}
+
+    // Прозрачное между begin и end рисуется в любом порядке. false - режим не поддерживается, нужна сортировка
+    GLboolean beginWeightedTransparency();
+    void endWeightedTransparency();
 
 //	Vasnecov::Config &config();
 //	void setConfig(const Vasnecov::Config config);
@@ -173,14 +191,14 @@ protected:
 
     void setContext(const QGLContext* context);
 
-    void clearSomethingUpdates() {m_wasSomethingUpdated = false;}
-    bool wasSomethingUpdated() const {return m_wasSomethingUpdated;}
+    void clearSomethingUpdates() {m_wasSomethingUpdated.store(false, std::memory_order_relaxed);}
+    bool wasSomethingUpdated() const {return m_wasSomethingUpdated.load(std::memory_order_relaxed);}
 
 protected:
     const QGLContext* m_context;
 
     QColor m_backgroundColor; // Цвет задника
-    QColor m_color; // Цвет отрисовки
+    GLubyte m_color[4]; // Цвет отрисовки, RGBA
     Vasnecov::PolygonDrawingTypes m_drawingType; // Тип отрисовки
     GLuint m_texture2D; // Индекс активной текстуры
 
@@ -217,7 +235,10 @@ protected:
     GLint       m_lineStippleFactor;
     GLushort    m_lineStipplePattern;
 
-    bool m_wasSomethingUpdated;
+    std::atomic<bool> m_wasSomethingUpdated;
+
+    Vasnecov::RenderProfiler m_profiler; // Статистика времени отрисовки
+    Vasnecov::WeightedTransparency m_transparency;
 
 //	Vasnecov::Config m_config;
 
@@ -300,6 +321,8 @@ inline void VasnecovPipeline::enableTexture2D(GLuint texture, GLboolean strong)
     {
         m_flagTexture2D = true;
         glEnable(GL_TEXTURE_2D);
+        if(m_transparency.isActive())
+            m_transparency.renderSetTextured(true);
     }
     if(texture != m_texture2D)
     {
@@ -313,8 +336,19 @@ inline void VasnecovPipeline::disableTexture2D(GLboolean strong)
     {
         m_flagTexture2D = false;
         glDisable(GL_TEXTURE_2D);
+        if(m_transparency.isActive())
+            m_transparency.renderSetTextured(false);
     }
 }
+inline void VasnecovPipeline::restoreTexture2D() const
+{
+    glBindTexture(GL_TEXTURE_2D, m_texture2D);
+}
+inline void VasnecovPipeline::forgetTexture2D(GLuint texture)
+{
+    if(m_texture2D == texture)
+        m_texture2D = 0;
+}
 
 inline void VasnecovPipeline::enableLamps(GLboolean strong)
 {
@@ -8,14 +8,20 @@
  */
 
 #include "VasnecovProduct.h"
+#include <algorithm>
+#include "ProductHierarchy.h"
 #include "Technologist.h"
+#include "Transform.h"
 #include "VasnecovMaterial.h"
 #include "VasnecovMesh.h"
 
 VasnecovProduct::VasnecovProduct(VasnecovPipeline *pipeline, VasnecovProduct::ProductTypes type, VasnecovProduct* parent, GLuint level) :
     VasnecovElement(pipeline),
     raw_M1(),
+    m_hierarchy(nullptr),
+    raw_node(-1),
     raw_ownVisible(true),
+    raw_colorStamp(0),
 
     m_type(raw_wasUpdated, Type, type),
     m_parent(raw_wasUpdated, Parent, parent),
@@ -23,7 +29,7 @@ VasnecovProduct::VasnecovProduct(VasnecovPipeline *pipeline, VasnecovProduct::Pr
 
     m_mesh(raw_wasUpdated, Mesh, nullptr),
     m_material(raw_wasUpdated, Material, nullptr),
-    m_children(raw_wasUpdated, Children),
+    raw_children(),
 
     m_drawingBox(raw_wasUpdated, DrawingBox, false)
 {
@@ -32,7 +38,10 @@ VasnecovProduct::VasnecovProduct(VasnecovPipeline *pipeline, VasnecovProduct::Pr
 VasnecovProduct::VasnecovProduct(VasnecovPipeline *pipeline, const QString& name, VasnecovProduct::ProductTypes type, VasnecovProduct *parent, GLuint level) :
     VasnecovElement(pipeline, name),
     raw_M1(),
+    m_hierarchy(nullptr),
+    raw_node(-1),
     raw_ownVisible(true),
+    raw_colorStamp(0),
 
     m_type(raw_wasUpdated, Type, type),
     m_parent(raw_wasUpdated, Parent, parent),
@@ -40,7 +49,7 @@ VasnecovProduct::VasnecovProduct(VasnecovPipeline *pipeline, const QString& name
 
     m_mesh(raw_wasUpdated, Mesh, nullptr),
     m_material(raw_wasUpdated, Material, nullptr),
-    m_children(raw_wasUpdated, Children),
+    raw_children(),
 
     m_drawingBox(raw_wasUpdated, DrawingBox, false)
 {
@@ -49,7 +58,10 @@ VasnecovProduct::VasnecovProduct(VasnecovPipeline *pipeline, const QString& name
 VasnecovProduct::VasnecovProduct(VasnecovPipeline *pipeline, const QString& name, VasnecovMesh *mesh, VasnecovProduct *parent, GLuint level) :
     VasnecovElement(pipeline, name),
     raw_M1(),
+    m_hierarchy(nullptr),
+    raw_node(-1),
     raw_ownVisible(true),
+    raw_colorStamp(0),
 
     m_type(raw_wasUpdated, Type, ProductTypePart), // т.к. меш может быть только у детали
     m_parent(raw_wasUpdated, Parent, parent),
@@ -57,7 +69,7 @@ VasnecovProduct::VasnecovProduct(VasnecovPipeline *pipeline, const QString& name
 
     m_mesh(raw_wasUpdated, Mesh, mesh),
     m_material(raw_wasUpdated, Material, nullptr),
-    m_children(raw_wasUpdated, Children),
+    raw_children(),
 
     m_drawingBox(raw_wasUpdated, DrawingBox, false)
 {
@@ -66,7 +78,10 @@ VasnecovProduct::VasnecovProduct(VasnecovPipeline *pipeline, const QString& name
 VasnecovProduct::VasnecovProduct(VasnecovPipeline *pipeline, const QString& name, VasnecovMesh *mesh, VasnecovMaterial *material, VasnecovProduct *parent, GLuint level) :
     VasnecovElement(pipeline, name),
     raw_M1(),
+    m_hierarchy(nullptr),
+    raw_node(-1),
     raw_ownVisible(true),
+    raw_colorStamp(0),
 
     m_type(raw_wasUpdated, Type, ProductTypePart), // т.к. меш может быть только у детали
     m_parent(raw_wasUpdated, Parent, parent),
@@ -74,7 +89,7 @@ VasnecovProduct::VasnecovProduct(VasnecovPipeline *pipeline, const QString& name
 
     m_mesh(raw_wasUpdated, Mesh, mesh),
     m_material(raw_wasUpdated, Material, material),
-    m_children(raw_wasUpdated, Children),
+    raw_children(),
 
     m_drawingBox(raw_wasUpdated, DrawingBox, false)
 {
@@ -103,7 +118,10 @@ void VasnecovProduct::setPositionFromElement(const VasnecovAbstractElement *elem
 
     if(element)
     {
-        designerUpdateChildrenMatrix();
+        if(m_hierarchy)
+            m_hierarchy->setWorld(this, m_Ms.raw().constData());
+        else
+            designerUpdateChildrenMatrix();
     }
 }
 
@@ -121,14 +139,18 @@ void VasnecovProduct::designerOwnSetVisible(bool visible)
 {
     raw_ownVisible = visible;
 
+    // Своя видимость меняется сразу, видимость потомков - при разрешении отложенных изменений
     if(m_parent.raw())
     {
-        designerSetVisibleFromParent(m_parent.raw()->designerIsVisible() && raw_ownVisible);
+        designerSetHidden(!(m_parent.raw()->designerIsVisible() && raw_ownVisible));
     }
     else
     {
-        designerSetVisibleFromParent(raw_ownVisible);
+        designerSetHidden(!raw_ownVisible);
     }
+
+    if(!raw_children.empty())
+        designerMarkDirty(DirtyVisibility);
 }
 
 void VasnecovProduct::designerSetVisibleFromParent(bool visible)
@@ -140,12 +162,12 @@ void VasnecovProduct::designerSetVisibleFromParent(bool visible)
         trueVis = true;
     }
 
-    m_isHidden.set(!trueVis);
+    designerSetHidden(!trueVis);
 
-    if(!m_children.raw().empty())
+    if(!raw_children.empty())
     {
-        for(std::vector<VasnecovProduct *>::const_iterator cit = m_children.raw().begin();
-            cit != m_children.raw().end(); ++cit)
+        for(std::vector<VasnecovProduct *>::const_iterator cit = raw_children.begin();
+            cit != raw_children.end(); ++cit)
         {
             (*cit)->designerSetVisibleFromParent(trueVis);
         }
@@ -154,23 +176,33 @@ void VasnecovProduct::designerSetVisibleFromParent(bool visible)
 
 void VasnecovProduct::designerUpdateMatrixMs()
 {
-    QMatrix4x4 newMatrix(raw_M1);
-    newMatrix.translate(raw_coordinates);
-
-    QQuaternion qRot;
-    qRot = raw_qZ * raw_qX * raw_qY;
-
-    newMatrix.rotate(qRot);
-
-    if(m_scale.raw() != 1.0f)
+    // Сначала вращение по оси Z, далее - X-Y. Масштаб и родительская матрица - в том же проходе
+    if(m_hierarchy)
     {
-        newMatrix.scale(m_scale.raw(), m_scale.raw(), m_scale.raw());
+        // Мировая матрица будет посчитана проходом по дереву
+        GLfloat local[16];
+        Vasnecov::composeTransform(raw_coordinates, raw_qZ * raw_qX * raw_qY, raw_scale, local);
+        m_hierarchy->setLocal(this, local);
     }
-
-    m_Ms.set(newMatrix);
+    else
+    {
+        m_Ms.set(Vasnecov::transformMatrix(raw_M1, raw_coordinates, raw_qZ * raw_qX * raw_qY, raw_scale));
+    }
+}
+void VasnecovProduct::designerSetHierarchy(Vasnecov::ProductHierarchy* hierarchy)
+{
+    m_hierarchy = hierarchy;
+    if(m_hierarchy && m_hierarchy->attach(this, m_parent.raw()))
+        designerRequestMatrixUpdate();
+}
+void VasnecovProduct::designerSetWorldMatrix(const GLfloat* matrix)
+{
+    QMatrix4x4 Ms;
+    std::copy(matrix, matrix + 16, Ms.data());
+    m_Ms.set(Ms);
 }
 
-GLfloat VasnecovProduct::renderCalculateDistanceToPlane(const QVector3D &planePoint, const QVector3D &normal)
+QVector3D VasnecovProduct::renderSortCenter() const
 {
     QVector3D centerPoint;
     if(m_mesh.pure())
@@ -187,9 +219,7 @@ GLfloat VasnecovProduct::renderCalculateDistanceToPlane(const QVector3D &planePo
         centerPoint = m_Ms.pure() * centerPoint;
     }
 
-    pure_distance = centerPoint.distanceToPlane(planePoint, normal);
-
-    return pure_distance;
+    return centerPoint;
 }
 GLenum VasnecovProduct::renderUpdateData()
 {
@@ -199,11 +229,11 @@ GLenum VasnecovProduct::renderUpdateData()
     {
         transp = m_material.raw()->renderTextureD()->isTransparency();
     }
-    if(m_color.raw().alphaF() < 1.0)
+    if(Vasnecov::RenderState::isTranslucent(raw_color))
     {
         transp = true;
     }
-    m_isTransparency.set(transp);
+    designerSet(raw_isTransparency, transp, Transparency);
 
     // Далее, как обычно
     GLenum updated(raw_wasUpdated);
@@ -220,8 +250,6 @@ GLenum VasnecovProduct::renderUpdateData()
         m_mesh.update();
         m_material.update();
 
-        m_children.update();
-
         m_drawingBox.update();
 
         VasnecovElement::renderUpdateData();
@@ -231,7 +259,7 @@ GLenum VasnecovProduct::renderUpdateData()
 }
 void VasnecovProduct::renderDraw()
 {
-    if(!m_isHidden.pure() &&
+    if(!renderIsHidden() &&
        m_type.pure() == ProductTypePart &&
        m_mesh.pure())
     {
@@ -244,10 +272,10 @@ void VasnecovProduct::renderDraw()
         else
         {
             pure_pipeline->disableTexture2D();
-            pure_pipeline->setColor(m_color.pure());
+            pure_pipeline->setColor(renderColor());
         }
 
-        if(m_scale.pure() != 1.0f)
+        if(renderIsScaled())
             pure_pipeline->enableNormalization();
 
         if(m_drawingBox.pure())
@@ -256,10 +284,30 @@ void VasnecovProduct::renderDraw()
         }
         m_mesh.pure()->drawModel(pure_pipeline);
 
-        if(m_scale.pure() != 1.0f)
+        if(renderIsScaled())
             pure_pipeline->disableNormalization();
     }
 }
+Vasnecov::BoundingBox VasnecovProduct::renderBoundingBox() const
+{
+    // Сборки не рисуются, их бокс не нужен
+    if(m_type.pure() != ProductTypePart || !m_mesh.pure())
+        return Vasnecov::BoundingBox();
+
+    return m_mesh.pure()->box();
+}
+GLboolean VasnecovProduct::renderBoundsChanged(GLenum updated) const
+{
+    return VasnecovElement::renderBoundsChanged(updated) || (updated & (Type | Mesh)) != 0;
+}
+GLboolean VasnecovProduct::renderIntersectLocalRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                                  GLfloat& distance, QVector3D& normal) const
+{
+    if(m_type.pure() != ProductTypePart || !m_mesh.pure())
+        return false;
+
+    return m_mesh.pure()->intersectRay(origin, direction, maxDistance, distance, normal);
+}
 GLboolean VasnecovProduct::designerAddChild(VasnecovProduct *child)
 {
     GLboolean res(false);
@@ -268,15 +316,29 @@ GLboolean VasnecovProduct::designerAddChild(VasnecovProduct *child)
         if(m_type.raw() == ProductTypeAssembly &&
            m_level.raw() <= Vasnecov::cfg_elementMaxLevel)
         {
-            std::vector<VasnecovProduct *> chs = m_children.raw();
-            chs.push_back(child);
-            m_children.set(chs);
+            designerResolvePending();
+
+            // Дерево отказывает, например, при переносе узла в собственное поддерево (о причине сообщает само)
+            if(m_hierarchy)
+            {
+                if(!m_hierarchy->attach(child, this))
+                    return false;
+            }
+            else
+            {
+                child->designerSetMatrixM1Recursively(m_Ms.raw());
+            }
 
-            child->designerSetMatrixM1Recursively(m_Ms.raw());
-            child->designerSetColorRecursively(m_color.raw());
+            raw_children.push_back(child);
+            child->designerSetColorRecursively(raw_color);
+            child->raw_colorStamp = raw_colorStamp;
 
             res = true;
         }
+        else
+        {
+            Vasnecov::problem("Product can't take children");
+        }
     }
 
     return res;
@@ -288,33 +350,41 @@ GLboolean VasnecovProduct::designerRemoveChild(VasnecovProduct *child)
     {
         if(m_type.raw() == ProductTypeAssembly)
         {
-            std::vector<VasnecovProduct *> chs = m_children.raw();
-
-            for(std::vector<VasnecovProduct *>::iterator cit = chs.begin();
-                cit != chs.end(); ++cit)
+            std::vector<VasnecovProduct *>::iterator cit = std::find(raw_children.begin(), raw_children.end(), child);
+            if(cit != raw_children.end())
             {
-                if((*cit) == child)
-                {
-                    chs.erase(cit);
-                    m_children.set(chs);
-
-                    res = true;
-                    break;
-                }
+                raw_children.erase(cit);
+
+                res = true;
             }
         }
     }
 
     return res;
 }
+GLuint VasnecovProduct::designerRemoveChildren(const std::unordered_set<const VasnecovProduct *>& children)
+{
+    if(m_type.raw() != ProductTypeAssembly || raw_children.empty())
+        return 0;
+
+    auto removed = [&children](const VasnecovProduct* child) {return children.count(child) > 0;};
+    std::vector<VasnecovProduct *>::iterator last = std::remove_if(raw_children.begin(), raw_children.end(), removed);
+    GLuint count = static_cast<GLuint>(raw_children.end() - last);
+    raw_children.erase(last, raw_children.end());
+
+    return count;
+}
 std::vector<VasnecovProduct *> VasnecovProduct::designerAllChildren()
 {
+    if(m_hierarchy && m_hierarchy->contains(this))
+        return m_hierarchy->subtree(this);
+
     std::vector<VasnecovProduct *> children;
 
     if(m_type.raw() == ProductTypeAssembly)
     {
-        for(std::vector<VasnecovProduct *>::const_iterator cit = m_children.raw().begin();
-            cit != m_children.raw().end(); ++cit)
+        for(std::vector<VasnecovProduct *>::const_iterator cit = raw_children.begin();
+            cit != raw_children.end(); ++cit)
         {
             children.push_back(*cit);
 
@@ -372,34 +442,49 @@ VasnecovProduct *VasnecovProduct::parent() const
 
 void VasnecovProduct::changeParent(VasnecovProduct *newParent)
 {
-    if(m_parent.raw())
-    {
-        m_parent.raw()->designerRemoveChild(this);
-    }
+    VasnecovProduct* oldParent(m_parent.raw());
     if(newParent)
     {
+        // Прежний родитель отпускает элемент, только если новый его принял
+        if(newParent == oldParent || !newParent->designerAddChild(this))
+            return;
+
+        if(oldParent)
+            oldParent->designerRemoveChild(this);
         m_parent.set(newParent);
-        newParent->designerAddChild(this);
     }
     else // Нет родителя - элемент глобальный
     {
-        designerSetMatrixM1Recursively(QMatrix4x4());
+        if(oldParent)
+            oldParent->designerRemoveChild(this);
+        m_parent.set(nullptr);
+        if(m_hierarchy)
+            m_hierarchy->attach(this, nullptr);
+        else
+            designerSetMatrixM1Recursively(QMatrix4x4());
     }
 }
 std::vector<VasnecovProduct *> VasnecovProduct::children() const
 {
-    std::vector<VasnecovProduct *> children(m_children.raw());
+    std::vector<VasnecovProduct *> children(raw_children);
     return children;
 }
 void VasnecovProduct::setColor(const QColor &color)
 {
-    if(m_material.raw() == nullptr && m_color.raw() == color)
+    // У детали с материалом цвет отрисовки задаёт материал, а не raw_color
+    VasnecovMaterial* material(m_material.raw());
+    if(!material && color == raw_color)
         return;
-    if(m_material.raw() != nullptr &&
-       (m_material.raw()->ambientColor() == color && m_material.raw()->diffuseColor() == color))
-       return;
+    if(material && material->ambientColor() == color && material->diffuseColor() == color)
+        return;
+
+    // Цвет потомков задаётся при разрешении отложенных изменений. Номер изменения нужен,
+    // чтобы более поздний цвет потомка не перекрывался более ранним цветом предка
+    raw_colorStamp = m_batch ? m_batch->stamp() : 0;
+    designerSetOwnColor(color);
 
-    designerSetColorRecursively(color);
+    if(!raw_children.empty())
+        designerMarkDirty(DirtyColor);
 }
 void VasnecovProduct::setCoordinates(const QVector3D &coordinates)
 {
@@ -407,8 +492,7 @@ void VasnecovProduct::setCoordinates(const QVector3D &coordinates)
     {
         raw_coordinates = coordinates;
 
-        designerUpdateMatrixMs();
-        designerUpdateChildrenMatrix();
+        designerRequestMatrixUpdate();
     }
 }
 void VasnecovProduct::incrementCoordinates(const QVector3D &increment)
@@ -417,17 +501,20 @@ void VasnecovProduct::incrementCoordinates(const QVector3D &increment)
     {
         raw_coordinates += increment;
 
-        designerUpdateMatrixMs();
-        designerUpdateChildrenMatrix();
+        designerRequestMatrixUpdate();
     }
 }
 QVector3D VasnecovProduct::globalCoordinates()
 {
+    designerResolvePending();
+
     QVector3D coordinates(m_Ms.raw()(0, 3), m_Ms.raw()(1, 3), m_Ms.raw()(2, 3));
     return coordinates;
 }
 void VasnecovProduct::setAngles(const QVector3D &angles)
 {
+    designerUpdateAngles();
+
     if(raw_angles != angles)
     {
         GLenum rotate(0);
@@ -435,31 +522,32 @@ void VasnecovProduct::setAngles(const QVector3D &angles)
         if(raw_angles.x() != angles.x())
         {
             raw_angles.setX(Vasnecov::trimAngle(angles.x()));
-            raw_qX = raw_qX.fromAxisAndAngle(1.0, 0.0, 0.0, raw_angles.x());
+            raw_qX = Vasnecov::rotationX(raw_angles.x());
             rotate |= Vasnecov::RotationX;
         }
         if(raw_angles.y() != angles.y())
         {
             raw_angles.setY(Vasnecov::trimAngle(angles.y()));
-            raw_qY = raw_qY.fromAxisAndAngle(0.0, 1.0, 0.0, raw_angles.y());
+            raw_qY = Vasnecov::rotationY(raw_angles.y());
             rotate |= Vasnecov::RotationY;
         }
         if(raw_angles.z() != angles.z())
         {
             raw_angles.setZ(Vasnecov::trimAngle(angles.z()));
-            raw_qZ = raw_qZ.fromAxisAndAngle(0.0, 0.0, 1.0, raw_angles.z());
+            raw_qZ = Vasnecov::rotationZ(raw_angles.z());
             rotate |= Vasnecov::RotationZ;
         }
 
         if(rotate)
         {
-            designerUpdateMatrixMs();
-            designerUpdateChildrenMatrix();
+            designerRequestMatrixUpdate();
         }
     }
 }
 void VasnecovProduct::incrementAngles(const QVector3D &increment)
 {
+    designerUpdateAngles();
+
     if(increment.x() != 0.0f || increment.y() != 0.0f || increment.z() != 0.0f)
     {
         GLenum rotate(0);
@@ -467,57 +555,53 @@ void VasnecovProduct::incrementAngles(const QVector3D &increment)
         if(increment.x() != 0.0)
         {
             raw_angles.setX(Vasnecov::trimAngle(raw_angles.x() + increment.x()));
-            raw_qX = raw_qX.fromAxisAndAngle(1.0, 0.0, 0.0, raw_angles.x());
+            raw_qX = Vasnecov::rotationX(raw_angles.x());
             rotate |= Vasnecov::RotationX;
         }
         if(increment.y() != 0.0)
         {
             raw_angles.setY(Vasnecov::trimAngle(raw_angles.y() + increment.y()));
-            raw_qY = raw_qY.fromAxisAndAngle(0.0, 1.0, 0.0, raw_angles.y());
+            raw_qY = Vasnecov::rotationY(raw_angles.y());
             rotate |= Vasnecov::RotationY;
         }
         if(increment.z() != 0.0)
         {
             raw_angles.setZ(Vasnecov::trimAngle(raw_angles.z() + increment.z()));
-            raw_qZ = raw_qZ.fromAxisAndAngle(0.0, 0.0, 1.0, raw_angles.z());
+            raw_qZ = Vasnecov::rotationZ(raw_angles.z());
             rotate |= Vasnecov::RotationZ;
         }
 
         if(rotate)
         {
-            designerUpdateMatrixMs();
-            designerUpdateChildrenMatrix();
+            designerRequestMatrixUpdate();
         }
     }
 }
 void VasnecovProduct::setScale(GLfloat scale)
 {
-    if(m_scale.set(scale))
-    {
-        designerUpdateMatrixMs();
-        designerUpdateChildrenMatrix();
-    }
-}
-void VasnecovProduct::designerSetMatrixM1(const QMatrix4x4 &M1)
-{
-    if(raw_M1 != M1)
+    if(designerSet(raw_scale, scale, Scale))
     {
-        designerSetMatrixM1Recursively(M1);
+        designerRequestMatrixUpdate();
     }
 }
 void VasnecovProduct::designerSetColorRecursively(const QColor &color)
 {
-    m_color.set(color);
+    designerSetOwnColor(color);
 
-    if(!m_children.raw().empty())
+    if(!raw_children.empty())
     {
-        for(std::vector<VasnecovProduct *>::const_iterator cit = m_children.raw().begin();
-            cit != m_children.raw().end();
+        for(std::vector<VasnecovProduct *>::const_iterator cit = raw_children.begin();
+            cit != raw_children.end();
             ++cit)
         {
             (*cit)->designerSetColorRecursively(color);
         }
     }
+}
+void VasnecovProduct::designerSetOwnColor(const QColor &color)
+{
+    designerSet(raw_color, color, Color);
+
     if(m_type.raw() == ProductTypePart && m_material.raw())
     {
         m_material.raw()->designerSetAmbientAndDiffuseColor(color);
@@ -525,10 +609,10 @@ void VasnecovProduct::designerSetColorRecursively(const QColor &color)
 }
 void VasnecovProduct::designerUpdateChildrenMatrix()
 {
-    if(!m_children.raw().empty())
+    if(!raw_children.empty())
     {
-        for(std::vector<VasnecovProduct *>::const_iterator cit = m_children.raw().begin();
-            cit != m_children.raw().end();
+        for(std::vector<VasnecovProduct *>::const_iterator cit = raw_children.begin();
+            cit != raw_children.end();
             ++cit)
         {
             // Матрица преобразований элемента передается дочерним в качестве матрицы начальных преобразований
@@ -536,6 +620,77 @@ void VasnecovProduct::designerUpdateChildrenMatrix()
         }
     }
 }
+GLboolean VasnecovProduct::designerIsLazy() const
+{
+    return true;
+}
+void VasnecovProduct::designerResolve(GLenum dirty)
+{
+    VasnecovProduct* parent(m_parent.raw());
+
+    // Предки к этому моменту разрешены
+    if(dirty & DirtyMatrix)
+    {
+        if(parent && !m_hierarchy)
+            raw_M1 = parent->m_Ms.raw();
+        designerUpdateMatrixMs();
+    }
+    if(dirty & DirtyVisibility)
+    {
+        designerSetHidden(!(raw_ownVisible && (!parent || parent->designerIsVisible())));
+    }
+    if((dirty & DirtyColor) && parent && parent->raw_colorStamp >= raw_colorStamp)
+    {
+        raw_colorStamp = parent->raw_colorStamp;
+        designerSetOwnColor(parent->raw_color);
+    }
+
+    // Матрицы потомков в дереве пересчитываются его проходом, поэтому обходятся только поддеревья
+    // с изменённой видимостью или цветом
+    GLenum inherited(dirty & (DirtyVisibility | DirtyColor));
+    if(!m_hierarchy && (dirty & (DirtyMatrix | DirtyChildrenMatrix)))
+        inherited |= DirtyMatrix;
+    if(!inherited)
+        return;
+
+    for(auto child : raw_children)
+    {
+        GLenum childDirty(inherited | child->raw_dirty);
+        child->raw_dirty = 0;
+        child->designerResolve(childDirty);
+    }
+}
+void VasnecovProduct::designerApplyPoseMatrix(const QMatrix4x4& matrix, GLboolean inherited)
+{
+    // Матрица позы уже посчитана. В дереве она становится локальной, мировые считаются его проходом.
+    // Без дерева потомки пересчитываются при разрешении отложенных изменений, поэтому потомок
+    // изменённого тем же вызовом предка сам не считается
+    if(inherited && !m_hierarchy)
+    {
+        designerMarkDirty(DirtyMatrix);
+        return;
+    }
+
+    QMatrix4x4 newMatrix(matrix);
+    if(raw_scale != 1.0f)
+    {
+        newMatrix.scale(raw_scale, raw_scale, raw_scale);
+    }
+    if(m_hierarchy)
+    {
+        m_hierarchy->setLocal(this, newMatrix.constData());
+        return;
+    }
+    Vasnecov::multiplyAffine(raw_M1.constData(), newMatrix.constData(), newMatrix.data());
+
+    m_Ms.set(newMatrix);
+    if(!raw_children.empty())
+        designerMarkDirty(DirtyChildrenMatrix);
+}
+VasnecovAbstractElement* VasnecovProduct::designerBatchParent() const
+{
+    return m_parent.raw();
+}
 void VasnecovProduct::designerSetMatrixM1Recursively(const QMatrix4x4 &M1)
 {
     designerUpdateMatrixM1(M1);
@@ -15,6 +15,11 @@
 class VasnecovMaterial;
 class VasnecovMesh;
 
+namespace Vasnecov
+{
+    class ProductHierarchy;
+}
+
 class VasnecovProduct : public VasnecovElement
 {
 public:
@@ -98,26 +103,38 @@ protected:
 
     GLboolean designerAddChild(VasnecovProduct* child); // Добавить дочерний элемент, параметром передается индекс элемента
     GLboolean designerRemoveChild(VasnecovProduct* child);
+    GLuint designerRemoveChildren(const std::unordered_set<const VasnecovProduct*>& children); // Одним проходом по списку
     std::vector<VasnecovProduct*> designerAllChildren(); // Возвращает общий список всех детей
     VasnecovProduct* designerParent() const;
     VasnecovMaterial* designerMaterial() const;
 
-    void designerSetMatrixM1(const QMatrix4x4& M1);
+    // Матрицы изделий в дереве считаются его проходом, без дерева - рекурсивно через M1
+    void designerSetHierarchy(Vasnecov::ProductHierarchy* hierarchy);
+    void designerSetWorldMatrix(const GLfloat* matrix);
 
     void designerSetColorRecursively(const QColor& color);
+    void designerSetOwnColor(const QColor& color); // С материалом детали
 
     void designerUpdateChildrenMatrix(); // Обновляет матрицы детей
     void designerSetMatrixM1Recursively(const QMatrix4x4& M1);
 
     void designerUpdateMatrixM1(const QMatrix4x4& M1);
     void designerUpdateMatrixMs();
+    GLboolean designerIsLazy() const;
+    void designerResolve(GLenum dirty);
+    void designerApplyPoseMatrix(const QMatrix4x4& matrix, GLboolean inherited);
+    VasnecovAbstractElement* designerBatchParent() const;
 
-    GLfloat renderCalculateDistanceToPlane(const QVector3D& planePoint, const QVector3D& normal);
+    QVector3D renderSortCenter() const;
 
 protected:
     // Методы, вызываемые рендерером (прямое обращение к основным данным без мьютексов)
     GLenum renderUpdateData();
     void renderDraw();
+    Vasnecov::BoundingBox renderBoundingBox() const;
+    GLboolean renderBoundsChanged(GLenum updated) const;
+    GLboolean renderIntersectLocalRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                      GLfloat& distance, QVector3D& normal) const;
 
     VasnecovMaterial* renderMaterial() const;
     VasnecovMesh* renderMesh() const;
@@ -126,11 +143,13 @@ protected:
     GLuint renderLevel() const;
 
     VasnecovProduct* renderParent() const;
-    const std::vector<VasnecovProduct*>* renderChildren() const;
 
 protected:
-    QMatrix4x4 raw_M1; // Матрица родительских трансформаций
+    QMatrix4x4 raw_M1; // Матрица родительских трансформаций (для изделия вне дерева)
+    Vasnecov::ProductHierarchy* m_hierarchy;
+    GLint raw_node; // Индекс в дереве, -1 - вне его
     bool raw_ownVisible;
+    quint64 raw_colorStamp; // Номер изменения, которым задан цвет (своим или предка)
 
     Vasnecov::MutualData<ProductTypes> m_type; // тип: узел, деталь
     Vasnecov::MutualData<VasnecovProduct*> m_parent; // Индекс родительского элемента (если уровень больше нуля, иначе 0)
@@ -139,7 +158,7 @@ protected:
     Vasnecov::MutualData<VasnecovMesh*> m_mesh; // Меш (для детали) - геометрия отрисовки
     Vasnecov::MutualData<VasnecovMaterial*> m_material; // Материал меша
 
-    Vasnecov::MutualData<std::vector<VasnecovProduct*> > m_children; // Список дочерних объектов (для узла)
+    std::vector<VasnecovProduct*> raw_children; // Список дочерних объектов (для узла). Рендеру не нужен
     Vasnecov::MutualData<GLboolean> m_drawingBox; // TODO: to enum with configuration flags
 
     enum Updated // Дополнительные флаги изменений. При множественном наследовании могут быть проблемы
@@ -149,12 +168,12 @@ protected:
         Level		= 0x0800,
         Mesh		= 0x1000,
         Material	= 0x2000,
-        Children	= 0x4000,
         DrawingBox  = 0x8000
     };
 
     friend class VasnecovUniverse;
     friend class VasnecovWorld;
+    friend class Vasnecov::ProductHierarchy;
 
 private:
     void init();
@@ -223,8 +242,3 @@ inline VasnecovProduct *VasnecovProduct::renderParent() const
 {
     return m_parent.pure();
 }
-
-inline const std::vector<VasnecovProduct *> *VasnecovProduct::renderChildren() const
-{
-    return &m_children.pure();
-}
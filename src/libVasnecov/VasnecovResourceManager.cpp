@@ -1,4 +1,5 @@
 #include "Technologist.h"
+#include "Tracer.h"
 #include "VasnecovMesh.h"
 #include "VasnecovResourceManager.h"
 #include "VasnecovTexture.h"
@@ -47,6 +48,7 @@ GLboolean VasnecovResourceManager::setMeshesDir(const QString& dir)
 
 GLboolean VasnecovResourceManager::loadMeshFile(const QString& fileName)
 {
+    VASNECOV_TRACE("loadMeshFile", "resources");
     QString path = _dirMeshes + fileName; // Путь файла с расширением
     QString fileId = fileName;
 
@@ -71,6 +73,7 @@ GLboolean VasnecovResourceManager::loadMeshFile(const QString& fileName)
 
 GLboolean VasnecovResourceManager::loadMeshFileByPath(const QString& filePath)
 {
+    VASNECOV_TRACE("loadMeshFileByPath", "resources");
     if(filePath.isEmpty())
         return false;
 
@@ -201,6 +204,7 @@ QString VasnecovResourceManager::correctFileId(const QString& fileId, const QStr
 
 GLboolean VasnecovResourceManager::createTexture(const QString& path, Vasnecov::TextureTypes type, const QString& name)
 {
+    VASNECOV_TRACE("createTexture", "resources");
     QImage image(path);
 
     if(image.isNull())
@@ -307,11 +311,13 @@ VasnecovTexture*VasnecovResourceManager::designerFindTexture(const QString& name
 
 bool VasnecovResourceManager::handleMeshesDir(const QString& dirName, GLboolean withSub)
 {
+    VASNECOV_TRACE("handleMeshesDir", "resources");
     return handleFilesInDir(_dirMeshes, dirName, Vasnecov::cfg_meshFormat, &VasnecovResourceManager::loadMeshFile, withSub);
 }
 
 bool VasnecovResourceManager::handleTexturesDir(const QString& dirName, GLboolean withSub)
 {
+    VASNECOV_TRACE("handleTexturesDir", "resources");
     GLuint res(0);
 
     res  = handleFilesInDir(_dirTextures, _dirTexturesDPref + dirName, Vasnecov::cfg_textureFormat, &VasnecovResourceManager::loadTextureFile, withSub);
@@ -358,6 +364,7 @@ GLuint VasnecovResourceManager::handleFilesInDir(const QString& dirPref, const Q
 
 bool VasnecovResourceManager::renderUpdate()
 {
+    VASNECOV_TRACE("renderUpdate", "resources");
     bool wasUpdated(false);
 
     if(raw_data.wasUpdated)
@@ -391,8 +398,13 @@ bool VasnecovResourceManager::renderUpdate()
             }
         }
 
+        raw_data.clearUpdateFlag();
         wasUpdated = true;
     }
 
     return wasUpdated;
 }
+GLboolean VasnecovResourceManager::hasUpdates() const
+{
+    return raw_data.updateFlag() != 0;
+}
@@ -54,6 +54,7 @@ private:
                             GLboolean withSub = true); // Поиск файлов в директории и выполнение с ними метода
 
     bool renderUpdate();
+    GLboolean hasUpdates() const; // Есть ресурсы для обработки в renderUpdate
 
     const QString& texturesDPref() const {return _dirTexturesDPref;}
     const QString& texturesNPref() const {return _dirTexturesNPref;}
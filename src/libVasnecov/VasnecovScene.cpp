@@ -34,6 +34,15 @@ void VasnecovScene::drawBackground(QPainter *painter, const QRectF &)
         m_universe->renderDrawAll(m_width, m_height);
     }
 }
+bool VasnecovScene::needsRedraw() const
+{
+    return m_universe && m_universe->needsRedraw();
+}
+void VasnecovScene::updateIfNeeded()
+{
+    if(needsRedraw())
+        update();
+}
 void VasnecovScene::setUniverse(VasnecovUniverse *universe)
 {
     if(universe)
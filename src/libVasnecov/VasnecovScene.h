@@ -30,10 +30,15 @@ class VasnecovScene : public QGraphicsScene
 public:
     explicit VasnecovScene(QObject* parent = nullptr);
     VasnecovUniverse* universe() const;
+    // Устарел ли последний кадр (см. VasnecovUniverse::needsRedraw). Смену размера окна
+    // обрабатывает само представление
+    bool needsRedraw() const;
 
 public slots:
     virtual void setUniverse(VasnecovUniverse* universe);
     virtual bool removeUniverse();
+    // Отрисовка по требованию: для вызова по таймеру вместо update()
+    void updateIfNeeded();
 
 protected:
     virtual void drawBackground(QPainter* painter, const QRectF&);
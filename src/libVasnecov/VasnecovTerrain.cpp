@@ -21,6 +21,7 @@ VasnecovTerrain::VasnecovTerrain(VasnecovPipeline *pipeline, const QString& name
     : VasnecovElement(pipeline, name)
     , _type(TypeSurface)
     , _lineSize(0)
+    , _triangles()
     , _texture(new VasnecovTextureDiffuse(QImage()))
     , _textureZone(0.0, 0.0, 1.0, 1.0)
     , _isTextureEnabled(false)
@@ -33,6 +34,9 @@ VasnecovTerrain::~VasnecovTerrain()
 void VasnecovTerrain::setPoints(std::vector <QVector3D>&& points, std::vector<QVector3D>&& colors)
 {
     _points = std::move(points);
+    _box = Vasnecov::BoundingBox();
+    _triangles.clear();
+    updaterSetUpdateFlag(Points);
     if(colors.size() == _points.size())
         _colors = std::move(colors);
     else
@@ -58,14 +62,20 @@ void VasnecovTerrain::setPoints(std::vector <QVector3D>&& points, std::vector<QV
     }
 
     updateCornerPoints();
+    // Вместе с опущенными до нуля краями
+    _box.add(_points);
     updateNormals();
     updateTextures();
     updateIndices();
+    updateTriangles();
 }
 
 void VasnecovTerrain::clearPoints()
 {
     _points.clear();
+    _box = Vasnecov::BoundingBox();
+    _triangles.clear();
+    updaterSetUpdateFlag(Points);
     _colors.clear();
     _indices.clear();
 }
@@ -146,13 +156,13 @@ void VasnecovTerrain::setImageZone(GLfloat x, GLfloat y, GLfloat width, GLfloat
 
 void VasnecovTerrain::renderDraw()
 {
-    if(m_isHidden.pure() || _indices.empty())
+    if(renderIsHidden() || _indices.empty())
         return;
 
     renderApplyTranslation();
 
     if(_colors.empty())
-        pure_pipeline->setColor(m_color.pure());
+        pure_pipeline->setColor(renderColor());
 
     if(_type == TypeSurface)
     {
@@ -163,7 +173,7 @@ void VasnecovTerrain::renderDraw()
             pure_pipeline->enableTexture2D(_texture->id());
         }
 
-        if(m_scale.pure() != 1.0f)
+        if(renderIsScaled())
             pure_pipeline->enableNormalization();
 
         for(auto& indValue : _indices)
@@ -189,7 +199,7 @@ void VasnecovTerrain::renderDraw()
             }
         }
 
-        if(m_scale.pure() != 1.0f)
+        if(renderIsScaled())
             pure_pipeline->disableNormalization();
         if(textured)
         {
@@ -216,6 +226,25 @@ void VasnecovTerrain::renderDraw()
     }
 }
 
+Vasnecov::BoundingBox VasnecovTerrain::renderBoundingBox() const
+{
+    return _box;
+}
+
+GLboolean VasnecovTerrain::renderBoundsChanged(GLenum updated) const
+{
+    return VasnecovElement::renderBoundsChanged(updated) || (updated & Points) != 0;
+}
+
+GLboolean VasnecovTerrain::renderIntersectLocalRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                                   GLfloat& distance, QVector3D& normal) const
+{
+    if(_lineSize < 2)
+        return false;
+
+    return _triangles.intersectRay(origin, direction, maxDistance, distance, normal);
+}
+
 void VasnecovTerrain::updateCornerPoints()
 {
     if(_points.empty())
@@ -512,3 +541,30 @@ void VasnecovTerrain::updateIndices()
         }
     }
 }
+
+void VasnecovTerrain::updateTriangles()
+{
+    _triangles.clear();
+    if(_lineSize < 2)
+        return;
+
+    std::vector<GLuint> indices;
+    indices.reserve((_lineSize - 1) * (_lineSize - 1) * 6);
+    for(GLuint row = 0; row < _lineSize - 1; ++row)
+    {
+        for(GLuint col = 0; col < _lineSize - 1; ++col)
+        {
+            GLuint first = row * _lineSize + col;
+            GLuint next = first + _lineSize;
+
+            indices.push_back(first);
+            indices.push_back(first + 1);
+            indices.push_back(next);
+
+            indices.push_back(first + 1);
+            indices.push_back(next + 1);
+            indices.push_back(next);
+        }
+    }
+    _triangles.build(_points, indices);
+}
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "VasnecovElement.h"
+#include "BoundingVolumeHierarchy.h"
 
 class VasnecovTerrain : public VasnecovElement
 {
@@ -41,20 +42,28 @@ public:
 
 protected:
     void renderDraw();
+    Vasnecov::BoundingBox renderBoundingBox() const;
+    GLboolean renderBoundsChanged(GLenum updated) const;
+    // Пересечение с сеткой высот (без боковых стенок). Дерево треугольников строится в setPoints
+    GLboolean renderIntersectLocalRay(const QVector3D& origin, const QVector3D& direction, GLfloat maxDistance,
+                                      GLfloat& distance, QVector3D& normal) const;
 
 private:
     void updateCornerPoints();
     void updateNormals();
     void updateTextures();
     void updateIndices();
+    void updateTriangles();
 
     Types                               _type;
     std::vector<QVector3D>              _points;
+    Vasnecov::BoundingBox               _box;
     std::vector<QVector3D>              _colors;
     std::vector<std::vector<GLuint>>    _indices;
     std::vector<QVector3D>              _normals;
     std::vector<QVector2D>              _textures;
     GLuint                              _lineSize;
+    Vasnecov::TriangleHierarchy         _triangles;
 
     VasnecovTexture*                    _texture;
     QRectF                              _textureZone;
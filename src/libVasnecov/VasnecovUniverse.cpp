@@ -11,12 +11,14 @@
 #ifdef _MSC_VER
     #include <windows.h>
 #endif
+#include <algorithm>
 #include <GL/glu.h>
 #include <QDir>
 #include <QDirIterator>
 #include <QFile>
 #include <bmcl/Logging.h>
 
+#include "Tracer.h"
 #include "VasnecovFigure.h"
 #include "VasnecovLabel.h"
 #include "VasnecovLamp.h"
@@ -33,21 +35,43 @@ VasnecovUniverse::VasnecovUniverse(VasnecovResourceManager* resourceManager, con
 
     _width(Vasnecov::cfg_displayWidthDefault),
     _height(Vasnecov::cfg_displayHeightDefault),
+    _redrawRequested(true),
 
     _loading(raw_data.wasUpdated, Loading, false),
     _loadingImage0(),
     _loadingImage1(),
     _loadingImageTimer(Vasnecov::timeDefault()),
+    _statisticsEnabled(raw_data.wasUpdated, Statistics, false),
+    _captureParameters(raw_data.wasUpdated, Capture),
+    _capture(),
     _lampsCountMax(Vasnecov::cfg_lampsCountMax),
 
     raw_data(),
     _resourceManager(resourceManager),
+    _updatedWorlds(),
+    _updatedMaterials(),
+    _updatedLamps(),
+    _updatedProducts(),
+    _updatedFigures(),
+    _updatedTerrains(),
+    _updatedLabels(),
+    _updating(),
+    _posted(),
+    _hierarchy(),
+    _batch(&_hierarchy),
+    _poses(),
+    _posed(),
     _elements(),
+    _changedBounds(),
+    _updateStates(),
 
     _techRenderer(raw_data.wasUpdated, Tech01),
     _techVersion(raw_data.wasUpdated, Tech02),
     _techSL(raw_data.wasUpdated, Tech03),
-    _techExtensions(raw_data.wasUpdated, Tech04)
+    _techExtensions(raw_data.wasUpdated, Tech04),
+
+    _statisticsUpdated(0),
+    _statistics(_statisticsUpdated, Statistics)
 {
     Q_INIT_RESOURCE(vasnecov);
 
@@ -81,10 +105,12 @@ VasnecovUniverse::~VasnecovUniverse()
 }
 VasnecovWorld *VasnecovUniverse::addWorld(GLint posX, GLint posY, GLsizei width, GLsizei height)
 {
+    VASNECOV_TRACE("addWorld", "designer");
     if(width > Vasnecov::cfg_worldWidthMin && width < Vasnecov::cfg_worldWidthMax &&
        height > Vasnecov::cfg_worldHeightMin && height < Vasnecov::cfg_worldHeightMax)
     {
-        VasnecovWorld *newWorld = new VasnecovWorld(&_pipeline, posX, posY, width, height);
+        VasnecovWorld *newWorld = _elements.createWorld(&_pipeline, posX, posY, width, height);
+        newWorld->designerSetUpdateQueue(&_updatedWorlds);
 
         _elements.addElement(newWorld);
 
@@ -96,6 +122,7 @@ VasnecovWorld *VasnecovUniverse::addWorld(GLint posX, GLint posY, GLsizei width,
 }
 VasnecovLamp *VasnecovUniverse::addLamp(const QString& name, VasnecovWorld *world, Vasnecov::LampTypes type)
 {
+    VASNECOV_TRACE("addLamp", "designer");
     if(!world)
     {
         Vasnecov::problem("World is not set");
@@ -118,7 +145,9 @@ VasnecovLamp *VasnecovUniverse::addLamp(const QString& name, VasnecovWorld *worl
         index += count;
     }
 
-    VasnecovLamp *lamp = new VasnecovLamp(&_pipeline, name, type, index);
+    VasnecovLamp *lamp = _elements.createLamp(&_pipeline, name, type, index);
+    lamp->designerSetUpdateQueue(&_updatedLamps);
+    lamp->designerSetBatch(&_batch);
     if(_elements.addElement(lamp))
     {
         world->designerAddElement(lamp);
@@ -126,7 +155,7 @@ VasnecovLamp *VasnecovUniverse::addLamp(const QString& name, VasnecovWorld *worl
     }
     else
     {
-        delete lamp;
+        _elements.destroyElement(lamp);
         lamp = nullptr;
 
         Vasnecov::problem("Incorrect lamp or data duplication");
@@ -135,6 +164,7 @@ VasnecovLamp *VasnecovUniverse::addLamp(const QString& name, VasnecovWorld *worl
 }
 VasnecovLamp *VasnecovUniverse::referLampToWorld(VasnecovLamp *lamp, VasnecovWorld *world)
 {
+    VASNECOV_TRACE("referLampToWorld", "designer");
     if(!lamp || !world)
     {
         Vasnecov::problem("Lamp or world is incorrect");
@@ -167,10 +197,12 @@ VasnecovLamp *VasnecovUniverse::referLampToWorld(VasnecovLamp *lamp, VasnecovWor
 
 GLboolean VasnecovUniverse::removeLamp(VasnecovLamp* lamp)
 {
+    VASNECOV_TRACE("removeLamp", "designer");
     return designerRemoveSimpleElement(lamp);
 }
 VasnecovProduct *VasnecovUniverse::addAssembly(const QString& name, VasnecovWorld *world, VasnecovProduct *parent)
 {
+    VASNECOV_TRACE("addAssembly", "designer");
     if(!world)
     {
         Vasnecov::problem("World is not set");
@@ -206,11 +238,14 @@ VasnecovProduct *VasnecovUniverse::addAssembly(const QString& name, VasnecovWorl
     }
 
     // world && (parent exists)
-    assembly = new VasnecovProduct(&_pipeline, name, VasnecovProduct::ProductTypeAssembly, parent, level);
+    assembly = _elements.createProduct(&_pipeline, name, VasnecovProduct::ProductTypeAssembly, parent, level);
+    assembly->designerSetUpdateQueue(&_updatedProducts);
+    assembly->designerSetPostQueue(&_posted);
+    assembly->designerSetBatch(&_batch);
+    assembly->designerSetHierarchy(&_hierarchy);
 
     if(parent)
     {
-        assembly->designerSetMatrixM1(parent->designerMatrixMs());
         parent->designerAddChild(assembly);
     }
     _elements.addElement(assembly);
@@ -224,51 +259,17 @@ VasnecovProduct *VasnecovUniverse::addPart(const QString& name, VasnecovWorld *w
 }
 VasnecovProduct *VasnecovUniverse::addPart(const QString& name, VasnecovWorld *world, const QString& meshName, VasnecovMaterial *material, VasnecovProduct *parent)
 {
+    VASNECOV_TRACE("addPart", "designer");
     if(!world)
     {
         Vasnecov::problem("World is not set");
         return nullptr;
     }
 
-    VasnecovProduct *part(nullptr);
-    VasnecovMesh *mesh(nullptr);
-    GLuint level(0);
-
     // Проверка на наличие меша и его догрузка при необходимости
-    if(!meshName.isEmpty())
-    {
-        QString corMeshName = VasnecovResourceManager::correctFileId(meshName, Vasnecov::cfg_meshFormat);
-        // Поиск меша в списке
-        mesh = _resourceManager->designerFindMesh(corMeshName);
-
-        if(mesh == nullptr)
-            mesh = _resourceManager->designerFindMesh(meshName); // Full path
-
-        if(mesh == nullptr)
-        {
-            // Попытка загрузить насильно
-            // Метод загрузки сам управляет мьютексом
-            if(!_resourceManager->loadMeshFile(corMeshName))
-            {
-                Vasnecov::problem("Mesh can't be loaded: ", corMeshName);
-                return nullptr;
-            }
-
-            mesh = _resourceManager->designerFindMesh(corMeshName);
-
-            if(!mesh)
-            {
-                // Условие невозможное после попытки загрузки, но для надёжности оставим :)
-                Vasnecov::problem("Mesh is not found: ", corMeshName);
-                return nullptr;
-            }
-        }
-    }
-    else
-    {
-        Vasnecov::problem("Mesh is not set");
+    VasnecovMesh *mesh(designerLoadMesh(meshName));
+    if(!mesh)
         return nullptr;
-    }
 
     // Поиск мира в списке
     if(!_elements.findRawElement(world))
@@ -285,37 +286,8 @@ VasnecovProduct *VasnecovUniverse::addPart(const QString& name, VasnecovWorld *w
             return nullptr;
         }
     }
-    // Указан родитель
-    if(parent)
-    {
-        if(world->designerFindElement(parent))
-        {
-            level = parent->designerLevel() + 1;
-            if(level > Vasnecov::cfg_elementMaxLevel)
-            {
-                Vasnecov::problem("Maximum nesting level is exceeded");
-                return nullptr;
-            }
-        }
-        else
-        {
-            Vasnecov::problem("Parent node is not found");
-            return nullptr;
-        }
-    }
-
-    // world && mesh && (parent exists)
-    part = new VasnecovProduct(&_pipeline, name, mesh, material, parent, level);
-
-    if(parent)
-    {
-        part->designerSetMatrixM1(parent->designerMatrixMs());
-        parent->designerAddChild(part);
-    }
-    _elements.addElement(part);
-    world->designerAddElement(part); // Здесь не требуется проверка на дубликаты, т.к. указатель part девственно чист
 
-    return part;
+    return designerAddPart(name, world, mesh, material, parent);
 }
 VasnecovProduct *VasnecovUniverse::addPart(const QString& name, VasnecovWorld *world, const QString& meshName, const QString& textureName, VasnecovProduct *parent)
 {
@@ -330,6 +302,7 @@ VasnecovProduct *VasnecovUniverse::addPart(const QString& name, VasnecovWorld *w
 }
 VasnecovProduct *VasnecovUniverse::referProductToWorld(VasnecovProduct *product, VasnecovWorld *world)
 {
+    VASNECOV_TRACE("referProductToWorld", "designer");
     if(!product || !world)
     {
         Vasnecov::problem("Element or world is not found");
@@ -361,82 +334,104 @@ VasnecovProduct *VasnecovUniverse::referProductToWorld(VasnecovProduct *product,
 }
 GLboolean VasnecovUniverse::removeProduct(VasnecovProduct *product)
 {
+    VASNECOV_TRACE("removeProduct", "designer");
     if(!product)
         return false;
 
-    /* Тут необходимо:
-     * 1. Проверить используется ли материал продукта в других продуктах.
-     * Если нет - удалить материал тоже (при этом текстуру не удалять)
-     * 2. Удалить из списка родителя.
-     * 3. Удалить всех детей, если продукт является узлом.
-     * 4. Убить все чужие матрицы, которые были от этих (продукт + дети + внуки) продуктов.
-     */
-
-    if(_elements.findRawElement(product))
+    return designerRemoveProducts(std::vector<VasnecovProduct *>(1, product)) > 0;
+}
+GLuint VasnecovUniverse::addParts(VasnecovWorld *world, const Vasnecov::PartDescriptor *parts, GLuint count, VasnecovProduct **result)
+{
+    VASNECOV_TRACE("addParts", "designer");
+    if(!world)
     {
-        // Удаление продуктов - долгая операция с заблокированным мьютексом
-        std::vector<VasnecovProduct *> delProd(product->designerAllChildren());
-        delProd.push_back(product);
+        Vasnecov::problem("World is not set");
+        return 0;
+    }
+    // Поиск мира в списке
+    if(!_elements.findRawElement(world))
+    {
+        Vasnecov::problem("Wrong world");
+        return 0;
+    }
+    if(!parts)
+        return 0;
 
-        _elements.removeElements(delProd);
+    // Меши ищутся (и загружаются) по разу на имя
+    std::map<QString, VasnecovMesh *> meshes;
+    GLuint added(0);
 
-        // Удаление материалов
-        std::vector<VasnecovMaterial *> delMat;
-        for(std::vector<VasnecovProduct *>::iterator dit = delProd.begin();
-            dit != delProd.end(); ++dit)
-        {
-            if((*dit)->designerMaterial())
-            {
-                delMat.push_back((*dit)->designerMaterial());
-            }
-        }
-        // Если материал встречается где-то в других продуктах, то из списка претендентов он вычеркивается
-        for(std::vector<VasnecovProduct *>::const_iterator pit = _elements.rawProducts().begin();
-            pit != _elements.rawProducts().end(); ++pit)
+    _batch.begin();
+    for(GLuint i = 0; i < count; ++i)
+    {
+        const Vasnecov::PartDescriptor& descriptor(parts[i]);
+        VasnecovProduct *part(nullptr);
+
+        std::map<QString, VasnecovMesh *>::iterator mit = meshes.find(descriptor.meshName);
+        if(mit == meshes.end())
         {
-            for(std::vector<VasnecovMaterial *>::iterator mit = delMat.begin();
-                mit != delMat.end(); ++mit)
-            {
-                if((*pit)->designerMaterial() == (*mit))
-                {
-                    delMat.erase(mit);
-                    break;
-                }
-            }
+            mit = meshes.insert(std::make_pair(descriptor.meshName, designerLoadMesh(descriptor.meshName))).first;
         }
-        // Непосредственное удаление больше не нужных материалов
-        _elements.removeElements(delMat);
 
-        // Прочие удаления
-        for(std::vector<VasnecovProduct *>::iterator dit = delProd.begin();
-            dit != delProd.end(); ++dit)
+        if(mit->second)
         {
-            // Удаление из мира
-            for(std::vector<VasnecovWorld *>::const_iterator wit = _elements.rawWorlds().begin();
-                wit != _elements.rawWorlds().end(); ++wit)
+            if(descriptor.material && !_elements.findRawElement(descriptor.material))
             {
-                (*wit)->designerRemoveElement((*dit));
+                Vasnecov::problem("Material is not found");
             }
-
-            // Удаление из списка родителей
-            if((*dit)->designerParent())
+            else
             {
-                (*dit)->designerParent()->designerRemoveChild(*dit);
+                part = designerAddPart(descriptor.name, world, mit->second, descriptor.material, descriptor.parent);
             }
-
-            // Удаление чужих матриц
-            const QMatrix4x4 *matrix = (*dit)->designerExportingMatrix();
-            designerRemoveThisAlienMatrix(matrix);
         }
 
-        return true;
+        if(part)
+            ++added;
+        if(result)
+            result[i] = part;
     }
+    _batch.commit();
 
-    return false;
+    return added;
+}
+GLuint VasnecovUniverse::removeProducts(const std::vector<VasnecovProduct *>& products)
+{
+    VASNECOV_TRACE("removeProducts", "designer");
+    return designerRemoveProducts(products);
+}
+GLuint VasnecovUniverse::clearWorld(VasnecovWorld *world)
+{
+    VASNECOV_TRACE("clearWorld", "designer");
+    if(!world || !_elements.findRawElement(world))
+    {
+        Vasnecov::problem("Wrong world");
+        return 0;
+    }
+
+    const auto& content(world->designerElements());
+    GLuint count = static_cast<GLuint>(content.rawProducts().size() + content.rawLamps().size() + content.rawFigures().size() +
+                                       content.rawTerrains().size() + content.rawLabels().size());
+
+    _batch.begin();
+
+    // Элементы, оставшиеся только в этом мире, удаляются совсем (изделия - вместе с потомками)
+    designerRemoveProducts(designerDetachFromWorld(world, content.rawProducts()));
+
+    std::unordered_set<const QMatrix4x4 *> alienMs;
+    designerRemoveSimpleElements(designerDetachFromWorld(world, content.rawLamps()), alienMs);
+    designerRemoveSimpleElements(designerDetachFromWorld(world, content.rawFigures()), alienMs);
+    designerRemoveSimpleElements(designerDetachFromWorld(world, content.rawTerrains()), alienMs);
+    designerRemoveSimpleElements(designerDetachFromWorld(world, content.rawLabels()), alienMs);
+    designerRemoveAlienMatrices(alienMs);
+
+    _batch.commit();
+
+    return count;
 }
 
 VasnecovFigure *VasnecovUniverse::addFigure(const QString& name, VasnecovWorld *world)
 {
+    VASNECOV_TRACE("addFigure", "designer");
     if(!world)
     {
         Vasnecov::problem("World is not set");
@@ -452,7 +447,10 @@ VasnecovFigure *VasnecovUniverse::addFigure(const QString& name, VasnecovWorld *
         return nullptr;
     }
 
-    figure = new VasnecovFigure(&_pipeline, name);
+    figure = _elements.createFigure(&_pipeline, name);
+    figure->designerSetUpdateQueue(&_updatedFigures);
+    figure->designerSetPostQueue(&_posted);
+    figure->designerSetBatch(&_batch);
 
     if(_elements.addElement(figure))
     {
@@ -461,7 +459,7 @@ VasnecovFigure *VasnecovUniverse::addFigure(const QString& name, VasnecovWorld *
     }
     else
     {
-        delete figure;
+        _elements.destroyElement(figure);
         figure = nullptr;
 
         Vasnecov::problem("Incorrect figure or data duplicating");
@@ -471,11 +469,13 @@ VasnecovFigure *VasnecovUniverse::addFigure(const QString& name, VasnecovWorld *
 
 GLboolean VasnecovUniverse::removeFigure(VasnecovFigure *figure)
 {
+    VASNECOV_TRACE("removeFigure", "designer");
     return designerRemoveSimpleElement(figure);
 }
 
 VasnecovTerrain*VasnecovUniverse::addTerrain(const QString& name, VasnecovWorld* world)
 {
+    VASNECOV_TRACE("addTerrain", "designer");
     if(world == nullptr)
     {
         Vasnecov::problem("World is not set");
@@ -489,7 +489,10 @@ VasnecovTerrain*VasnecovUniverse::addTerrain(const QString& name, VasnecovWorld*
         return nullptr;
     }
 
-    VasnecovTerrain *terrain = new VasnecovTerrain(&_pipeline, name);
+    VasnecovTerrain *terrain = _elements.createTerrain(&_pipeline, name);
+    terrain->designerSetUpdateQueue(&_updatedTerrains);
+    terrain->designerSetPostQueue(&_posted);
+    terrain->designerSetBatch(&_batch);
 
     if(_elements.addElement(terrain))
     {
@@ -498,7 +501,7 @@ VasnecovTerrain*VasnecovUniverse::addTerrain(const QString& name, VasnecovWorld*
     }
     else
     {
-        delete terrain;
+        _elements.destroyElement(terrain);
         Vasnecov::problem("Incorrect or duplicated terrain");
     }
     return nullptr;
@@ -506,6 +509,7 @@ VasnecovTerrain*VasnecovUniverse::addTerrain(const QString& name, VasnecovWorld*
 
 GLboolean VasnecovUniverse::removeTerrain(VasnecovTerrain* terrain)
 {
+    VASNECOV_TRACE("removeTerrain", "designer");
     return designerRemoveSimpleElement(terrain);
 }
 
@@ -515,6 +519,7 @@ VasnecovLabel *VasnecovUniverse::addLabel(const QString& name, VasnecovWorld *wo
 }
 VasnecovLabel *VasnecovUniverse::addLabel(const QString& name, VasnecovWorld *world, GLfloat width, GLfloat height, const QString& textureName)
 {
+    VASNECOV_TRACE("addLabel", "designer");
     if(!world)
     {
         Vasnecov::problem("World is not set");
@@ -561,7 +566,10 @@ VasnecovLabel *VasnecovUniverse::addLabel(const QString& name, VasnecovWorld *wo
         return nullptr;
     }
 
-    label = new VasnecovLabel(&_pipeline, name, QVector2D(width, height), texture);
+    label = _elements.createLabel(&_pipeline, name, QVector2D(width, height), texture);
+    label->designerSetUpdateQueue(&_updatedLabels);
+    label->designerSetPostQueue(&_posted);
+    label->designerSetBatch(&_batch);
 
     if(_elements.addElement(label))
     {
@@ -570,7 +578,7 @@ VasnecovLabel *VasnecovUniverse::addLabel(const QString& name, VasnecovWorld *wo
     }
     else
     {
-        delete label;
+        _elements.destroyElement(label);
         label = nullptr;
 
         Vasnecov::problem("Incorrect label or data duplicating");
@@ -579,6 +587,7 @@ VasnecovLabel *VasnecovUniverse::addLabel(const QString& name, VasnecovWorld *wo
 }
 VasnecovLabel *VasnecovUniverse::referLabelToWorld(VasnecovLabel *label, VasnecovWorld *world)
 {
+    VASNECOV_TRACE("referLabelToWorld", "designer");
     if(!label || !world)
     {
         Vasnecov::problem("Element or world is not set");
@@ -610,10 +619,102 @@ VasnecovLabel *VasnecovUniverse::referLabelToWorld(VasnecovLabel *label, Vasneco
 }
 GLboolean VasnecovUniverse::removeLabel(VasnecovLabel *label)
 {
+    VASNECOV_TRACE("removeLabel", "designer");
     return designerRemoveSimpleElement(label);
 }
+void VasnecovUniverse::beginBatch()
+{
+    _batch.begin();
+}
+GLboolean VasnecovUniverse::commit()
+{
+    VASNECOV_TRACE("commit", "designer");
+    if(!_batch.commit())
+    {
+        Vasnecov::problem("Batch is not opened");
+        return false;
+    }
+    return true;
+}
+GLboolean VasnecovUniverse::isBatchOpen() const
+{
+    return _batch.isOpen();
+}
+GLboolean VasnecovUniverse::needsRedraw() const
+{
+    if(_redrawRequested.load(std::memory_order_relaxed) || _loading.raw() || _loading.pure())
+        return true;
+
+    // До commit рисуется прежнее состояние
+    if(_batch.isOpen())
+        return false;
+
+    return raw_data.updateFlag() != 0 ||
+           _elements.wasUpdated() ||
+           !_updatedWorlds.empty() ||
+           !_updatedMaterials.empty() ||
+           !_updatedLamps.empty() ||
+           !_updatedProducts.empty() ||
+           !_updatedFigures.empty() ||
+           !_updatedTerrains.empty() ||
+           !_updatedLabels.empty() ||
+           !_posted.isEmpty() ||
+           // Перемещения изделий копятся в пакете и в дереве, не ставя изделия в очередь
+           !_batch.isEmpty() ||
+           _hierarchy.isDirty() ||
+           _resourceManager->hasUpdates() ||
+           _pipeline.wasSomethingUpdated();
+}
+GLboolean VasnecovUniverse::needsRedraw(GLsizei width, GLsizei height) const
+{
+    return width != _width || height != _height || needsRedraw();
+}
+void VasnecovUniverse::requestRedraw()
+{
+    _redrawRequested.store(true, std::memory_order_relaxed);
+}
+GLboolean VasnecovUniverse::setPoses(VasnecovAbstractElement* const* elements,
+                                     const QVector3D* positions,
+                                     const QQuaternion* orientations,
+                                     GLuint count)
+{
+    VASNECOV_TRACE("setPoses", "designer");
+    if(!count)
+        return true;
+    if(!elements || !positions || !orientations)
+    {
+        Vasnecov::problem("Poses are not set");
+        return false;
+    }
+
+    if(_poses.px.size() < count)
+        _poses.resize(count);
+
+    for(GLuint i = 0; i < count; ++i)
+        _poses.set(i, positions[i], orientations[i]);
+
+    Vasnecov::composeRotations(_poses, count);
+
+    _posed.clear();
+    _posed.insert(elements, elements + count);
+
+    // Матрица элемента, чей предок тоже в вызове, считается один раз - при разрешении отложенных изменений
+    for(GLuint i = 0; i < count; ++i)
+    {
+        if(!elements[i])
+            continue;
+
+        GLboolean inherited(false);
+        for(auto parent = elements[i]->designerBatchParent(); parent && !inherited; parent = parent->designerBatchParent())
+            inherited = _posed.count(parent) != 0;
+
+        elements[i]->designerSetPose(positions[i], orientations[i], _poses.matrix(i), inherited);
+    }
+    return true;
+}
 VasnecovMaterial *VasnecovUniverse::addMaterial(const QString& textureName)
 {
+    VASNECOV_TRACE("addMaterial", "designer");
     VasnecovTexture *texture(nullptr);
 
     // Проверка на наличие текстуры и её догрузка при необходимости
@@ -648,14 +749,15 @@ VasnecovMaterial *VasnecovUniverse::addMaterial(const QString& textureName)
         }
     }
 
-    VasnecovMaterial *material = new VasnecovMaterial(&_pipeline, texture);
+    VasnecovMaterial *material = _elements.createMaterial(&_pipeline, texture);
+    material->designerSetUpdateQueue(&_updatedMaterials);
     if(_elements.addElement(material))
     {
         return material;
     }
     else
     {
-        delete material;
+        _elements.destroyElement(material);
         material = nullptr;
 
         Vasnecov::problem("Incorrect material or data duplicating");
@@ -664,14 +766,16 @@ VasnecovMaterial *VasnecovUniverse::addMaterial(const QString& textureName)
 }
 VasnecovMaterial *VasnecovUniverse::addMaterial()
 {
-    VasnecovMaterial *material = new VasnecovMaterial(&_pipeline);
+    VASNECOV_TRACE("addMaterial", "designer");
+    VasnecovMaterial *material = _elements.createMaterial(&_pipeline);
+    material->designerSetUpdateQueue(&_updatedMaterials);
     if(_elements.addElement(material))
     {
         return material;
     }
     else
     {
-        delete material;
+        _elements.destroyElement(material);
         material = nullptr;
 
         Vasnecov::problem("Incorrect material or data duplicating");
@@ -806,10 +910,39 @@ QString VasnecovUniverse::info(GLuint type)
 
     return res;
 }
+void VasnecovUniverse::setStatisticsEnabled(GLboolean enabled)
+{
+    _statisticsEnabled.set(enabled);
+}
+Vasnecov::FrameStatistics VasnecovUniverse::statistics()
+{
+    _statistics.update();
+    Vasnecov::FrameStatistics stat(_statistics.pure());
+    return stat;
+}
+void VasnecovUniverse::startCapture(const Vasnecov::CaptureParameters& parameters)
+{
+    Vasnecov::CaptureParameters& raw(_captureParameters.editableRaw());
+    raw = parameters;
+    raw.enabled = true;
+}
+void VasnecovUniverse::stopCapture()
+{
+    _captureParameters.editableRaw().enabled = false;
+}
+GLboolean VasnecovUniverse::takeCapturedFrame(Vasnecov::CapturedFrame& frame)
+{
+    return _capture.take(frame);
+}
+quint64 VasnecovUniverse::droppedCapturedFrames() const
+{
+    return _capture.droppedFrames();
+}
 void VasnecovUniverse::renderInitialize()
 {
     // Инициализация состояний
     _pipeline.initialize();
+    requestRedraw();
 
     glGetIntegerv(GL_MAX_LIGHTS, reinterpret_cast<GLint *>(&_lampsCountMax));
 
@@ -848,22 +981,238 @@ GLboolean VasnecovUniverse::designerRemoveThisAlienMatrix(const QMatrix4x4 *alie
     return res;
 }
 
+GLboolean VasnecovUniverse::designerRemoveAlienMatrices(const std::unordered_set<const QMatrix4x4 *>& alienMs)
+{
+    GLboolean res(false);
+    if(alienMs.empty())
+        return res;
+
+    for(const auto element : _elements.rawLamps())
+        res |= element->designerRemoveAlienMatrices(alienMs);
+
+    for(const auto element : _elements.rawProducts())
+        res |= element->designerRemoveAlienMatrices(alienMs);
+
+    for(const auto element : _elements.rawFigures())
+        res |= element->designerRemoveAlienMatrices(alienMs);
+
+    for(const auto element : _elements.rawTerrains())
+        res |= element->designerRemoveAlienMatrices(alienMs);
+
+    for(const auto element : _elements.rawLabels())
+        res |= element->designerRemoveAlienMatrices(alienMs);
+
+    return res;
+}
+
+GLuint VasnecovUniverse::designerRemoveProducts(const std::vector<VasnecovProduct *>& products)
+{
+    /* Тут необходимо:
+     * 1. Проверить используется ли материал продукта в других продуктах.
+     * Если нет - удалить материал тоже (при этом текстуру не удалять)
+     * 2. Удалить из списка родителя.
+     * 3. Удалить всех детей, если продукт является узлом.
+     * 4. Убить все чужие матрицы, которые были от этих (продукт + дети + внуки) продуктов.
+     * Каждый пункт выполняется одним проходом для всего набора.
+     */
+
+    // Изделия вместе с потомками, без повторов
+    std::unordered_set<const VasnecovProduct *> removed;
+    std::vector<VasnecovProduct *> delProd;
+    for(const auto product : products)
+    {
+        if(!product || removed.count(product) || !_elements.findRawElement(product))
+            continue;
+
+        removed.insert(product);
+        delProd.push_back(product);
+        for(const auto child : product->designerAllChildren())
+        {
+            if(removed.insert(child).second)
+                delProd.push_back(child);
+        }
+    }
+    if(delProd.empty())
+        return 0;
+
+    _batch.begin();
+    _hierarchy.detach(removed);
+    _elements.removeElements(delProd);
+
+    // Удаление материалов
+    std::unordered_set<const VasnecovMaterial *> unused;
+    std::vector<VasnecovMaterial *> delMat;
+    for(const auto product : delProd)
+    {
+        VasnecovMaterial *material(product->designerMaterial());
+        if(material && unused.insert(material).second)
+            delMat.push_back(material);
+    }
+    if(!delMat.empty())
+    {
+        // Если материал встречается где-то в других продуктах, то из списка претендентов он вычеркивается
+        for(const auto product : _elements.rawProducts())
+            unused.erase(product->designerMaterial());
+
+        delMat.erase(std::remove_if(delMat.begin(), delMat.end(),
+                                    [&unused](const VasnecovMaterial* material) {return unused.count(material) == 0;}),
+                     delMat.end());
+        // Непосредственное удаление больше не нужных материалов
+        _elements.removeElements(delMat);
+    }
+
+    // Прочие удаления
+    std::unordered_set<const QMatrix4x4 *> alienMs;
+    std::unordered_set<const VasnecovProduct *> parentsSet;
+    std::vector<VasnecovProduct *> parents;
+    for(const auto product : delProd)
+    {
+        // Удаление из мира
+        for(const auto world : _elements.rawWorlds())
+            world->designerRemoveElement(product);
+
+        // Родители, остающиеся в мире, очищают списки детей одним проходом
+        VasnecovProduct *parent(product->designerParent());
+        if(parent && !removed.count(parent) && parentsSet.insert(parent).second)
+            parents.push_back(parent);
+
+        alienMs.insert(product->designerExportingMatrix());
+    }
+    for(const auto parent : parents)
+        parent->designerRemoveChildren(removed);
+
+    // Удаление чужих матриц
+    designerRemoveAlienMatrices(alienMs);
+
+    _batch.commit();
+
+    return static_cast<GLuint>(delProd.size());
+}
+
+VasnecovMesh *VasnecovUniverse::designerLoadMesh(const QString& meshName)
+{
+    if(meshName.isEmpty())
+    {
+        Vasnecov::problem("Mesh is not set");
+        return nullptr;
+    }
+
+    QString corMeshName = VasnecovResourceManager::correctFileId(meshName, Vasnecov::cfg_meshFormat);
+    // Поиск меша в списке
+    VasnecovMesh *mesh = _resourceManager->designerFindMesh(corMeshName);
+
+    if(mesh == nullptr)
+        mesh = _resourceManager->designerFindMesh(meshName); // Full path
+
+    if(mesh == nullptr)
+    {
+        // Попытка загрузить насильно
+        // Метод загрузки сам управляет мьютексом
+        if(!_resourceManager->loadMeshFile(corMeshName))
+        {
+            Vasnecov::problem("Mesh can't be loaded: ", corMeshName);
+            return nullptr;
+        }
+
+        mesh = _resourceManager->designerFindMesh(corMeshName);
+
+        if(!mesh)
+        {
+            // Условие невозможное после попытки загрузки, но для надёжности оставим :)
+            Vasnecov::problem("Mesh is not found: ", corMeshName);
+            return nullptr;
+        }
+    }
+
+    return mesh;
+}
+
+VasnecovProduct *VasnecovUniverse::designerAddPart(const QString& name, VasnecovWorld *world, VasnecovMesh *mesh,
+                                                   VasnecovMaterial *material, VasnecovProduct *parent)
+{
+    GLuint level(0);
+
+    // Указан родитель
+    if(parent)
+    {
+        if(world->designerFindElement(parent))
+        {
+            level = parent->designerLevel() + 1;
+            if(level > Vasnecov::cfg_elementMaxLevel)
+            {
+                Vasnecov::problem("Maximum nesting level is exceeded");
+                return nullptr;
+            }
+        }
+        else
+        {
+            Vasnecov::problem("Parent node is not found");
+            return nullptr;
+        }
+    }
+
+    // world && mesh && (parent exists)
+    VasnecovProduct *part = _elements.createProduct(&_pipeline, name, mesh, material, parent, level);
+    part->designerSetUpdateQueue(&_updatedProducts);
+    part->designerSetPostQueue(&_posted);
+    part->designerSetBatch(&_batch);
+    part->designerSetHierarchy(&_hierarchy);
+
+    if(parent)
+    {
+        parent->designerAddChild(part);
+    }
+    _elements.addElement(part);
+    world->designerAddElement(part); // Здесь не требуется проверка на дубликаты, т.к. указатель part девственно чист
+
+    return part;
+}
+
 GLenum VasnecovUniverse::renderUpdateData()
 {
+    VASNECOV_TRACE("renderUpdateData", "render");
     GLenum wasUpdated(0);
 
+    // Открытый пакет забирается целиком после commit, до этого рисуется прежнее состояние
+    if(_batch.isOpen())
+        return wasUpdated;
+
     // Обновление настроек
     if(raw_data.wasUpdated)
     {
         if(_context.update())
         {
             _pipeline.setContext(_context.pure());
+            for(auto world : _elements.pureWorlds())
+            {
+                if(world)
+                    world->_cache.renderRelease(&_pipeline);
+            }
+            renderDamageAllWorlds();
         }
 
         _loading.update();
-        _backgroundColor.update();
+        if(_backgroundColor.update())
+        {
+            renderDamageAllWorlds();
+        }
+
+        if(_statisticsEnabled.update())
+        {
+            _pipeline.profiler().setEnabled(_statisticsEnabled.pure());
+        }
+        if(_captureParameters.update())
+        {
+            _capture.setParameters(_captureParameters.pure());
+        }
     }
 
+    // Применение состояний, опубликованных из других потоков. До синхронизации списков,
+    // т.к. при ней удаляются элементы
+    renderApplyPosted();
+    // Разрешение отложенных изменений иерархий сверху вниз
+    _batch.resolve();
+
     // Обновление содержимого списков
     wasUpdated |= _elements.synchronizeAll();
 
@@ -878,22 +1227,66 @@ GLenum VasnecovUniverse::renderUpdateData()
         }
     }
 
-    if(_resourceManager->renderUpdate())
+    GLboolean texturesUpdated(_resourceManager->renderUpdate());
+    if(texturesUpdated)
     {
         glBindTexture(GL_TEXTURE_2D, _pipeline.m_texture2D); // Возврат текущей текстуры
         wasUpdated = true;
+        renderDamageAllWorlds();
     }
 
-    // Обновление данных элементов
-    _elements.forEachPureWorld(renderUpdateElementData<VasnecovWorld>);
-    _elements.forEachPureMaterial(renderUpdateElementData<VasnecovMaterial>);
+    // Обновление данных только изменившихся объектов
+    auto updateAll = [](const Vasnecov::UpdateQueue& objects)
+    {
+        for(auto object : objects)
+            object->renderUpdateData();
+    };
+    renderUpdateQueue(_updatedWorlds, updateAll);
 
-    _elements.forEachPureLamp(renderUpdateElementData<VasnecovLamp>);
-    _elements.forEachPureProduct(renderUpdateElementData<VasnecovProduct>);
-    _elements.forEachPureFigure(renderUpdateElementData<VasnecovFigure>);
-    _elements.forEachPureTerrain(renderUpdateElementData<VasnecovTerrain>);
-    _elements.forEachPureLabel(renderUpdateElementData<VasnecovLabel>);
+    // Прозрачность изделий зависит от текстур материалов, поэтому при их смене проверяются все изделия
+    if(texturesUpdated || !_updatedMaterials.empty())
+    {
+        for(auto product : _elements.pureProducts())
+            product->updaterEnqueue();
+    }
+    renderUpdateQueue(_updatedMaterials, updateAll);
+    renderUpdateQueue(_updatedLamps, [this, &updateAll](const Vasnecov::UpdateQueue& objects)
+    {
+        updateAll(objects);
+        renderDamageWorlds<VasnecovLamp>(objects);
+    });
 
+    _changedBounds.clear();
+    renderUpdateQueue(_updatedProducts, [this](const Vasnecov::UpdateQueue& objects)
+    {
+        renderUpdateElementsData<VasnecovProduct>(objects);
+        renderDamageWorlds<VasnecovProduct>(objects);
+    });
+    renderUpdateQueue(_updatedFigures, [this](const Vasnecov::UpdateQueue& objects)
+    {
+        renderUpdateElementsData<VasnecovFigure>(objects);
+        renderDamageWorlds<VasnecovFigure>(objects);
+    });
+    renderUpdateQueue(_updatedTerrains, [this](const Vasnecov::UpdateQueue& objects)
+    {
+        renderUpdateElementsData<VasnecovTerrain>(objects);
+        renderDamageWorlds<VasnecovTerrain>(objects);
+    });
+    renderUpdateQueue(_updatedLabels, [this](const Vasnecov::UpdateQueue& objects)
+    {
+        renderUpdateElementsData<VasnecovLabel>(objects);
+        renderDamageWorlds<VasnecovLabel>(objects);
+    });
+
+    // Порядок изделий в мирах - по дереву, пространственные индексы - только по изменившимся элементам
+    for(auto world : _elements.pureWorlds())
+    {
+        if(world)
+        {
+            world->renderOrderProducts(_hierarchy);
+            world->renderUpdateSpatialIndex(_changedBounds);
+        }
+    }
 
     raw_data.wasUpdated = 0;
 
@@ -905,6 +1298,27 @@ GLenum VasnecovUniverse::renderUpdateData()
 
     return wasUpdated;
 }
+void VasnecovUniverse::renderApplyPosted()
+{
+    VasnecovElement* element(_posted.take());
+    if(!element)
+        return;
+
+    // Координаты и углы одного снимка дают один пересчёт матриц
+    _batch.begin();
+    while(element)
+    {
+        // Следующий берётся до применения: после него элемент может снова попасть в очередь
+        VasnecovElement* next(element->m_postNext);
+        element->updaterApplyPosted();
+        element = next;
+    }
+    _batch.commit();
+}
+GLboolean VasnecovUniverse::renderUpdateNeedsContext(const VasnecovLabel* label)
+{
+    return label->renderUpdateNeedsContext();
+}
 void VasnecovUniverse::renderDrawLoadingImage()
 {
     // Выводить сообщение о процессе загрузки
@@ -947,12 +1361,57 @@ void VasnecovUniverse::renderDrawLoadingImage()
         }
     }
 }
+void VasnecovUniverse::renderDamageAllWorlds()
+{
+    for(auto world : _elements.pureWorlds())
+    {
+        if(world)
+            world->renderDamage();
+    }
+}
+void VasnecovUniverse::renderDrawWorlds()
+{
+    // Снимок мира включает то, что под ним нарисовали предыдущие миры, поэтому
+    // повреждение мира распространяется на пересекающиеся с ним последующие
+    std::vector<QRect> damaged;
+    for(auto world : _elements.pureWorlds())
+    {
+        if(!world)
+            continue;
+
+        const QRect window(world->renderWindow());
+        if(!world->renderIsDamaged())
+        {
+            for(const auto& area : damaged)
+            {
+                if(area.intersects(window))
+                {
+                    world->renderDamage();
+                    break;
+                }
+            }
+        }
+
+        if(world->renderDrawCached())
+            damaged.push_back(window);
+    }
+}
 void VasnecovUniverse::renderDrawAll(GLsizei width, GLsizei height)
 {
+    VASNECOV_TRACE("renderDrawAll", "render");
+    Vasnecov::RenderProfiler& profiler(_pipeline.profiler());
+    profiler.startFrame();
+    _redrawRequested.store(false, std::memory_order_relaxed);
+
     // Обновление данных
     renderUpdateData();
+    profiler.stopUpdate();
 
     {
+        if(width != _width || height != _height)
+        {
+            renderDamageAllWorlds();
+        }
         _width = width;
         _height = height;
 
@@ -965,8 +1424,8 @@ void VasnecovUniverse::renderDrawAll(GLsizei width, GLsizei height)
         _pipeline.enableDepth(true);
 
 
-        // Прогонка миров по списку
-        _elements.forEachPureWorld(VasnecovWorld::renderDrawElement<VasnecovWorld>);
+        // Прогонка миров по списку. Неповреждённые выводятся из снимков
+        renderDrawWorlds();
 
         // Возврат для отрисовки интерфейса
         _pipeline.setDrawingType(Vasnecov::PolygonDrawingTypeNormal);
@@ -983,6 +1442,15 @@ void VasnecovUniverse::renderDrawAll(GLsizei width, GLsizei height)
     {
         renderDrawLoadingImage();
     }
+
+    _capture.renderCapture(_width, _height);
+
+    profiler.stopFrame();
+    if(profiler.hasNewStatistics())
+    {
+        _statistics.editableRaw() = profiler.statistics();
+        profiler.clearNewStatistics();
+    }
 }
 
 VasnecovUniverse::UniverseElementList::UniverseElementList() :
@@ -15,19 +15,45 @@
 #include <QString>
 #include <QImage>
 #include <bmcl/Rc.h>
+#include <atomic>
 #include <map>
+#include <unordered_set>
 #include "Configuration.h"
+#include "ElementPool.h"
+#include "FrameCapture.h"
+#include "ProductHierarchy.h"
 #include "VasnecovMaterial.h"
 #include "VasnecovWorld.h"
 #include "ElementList.h"
 
 class VasnecovFigure;
 class VasnecovLamp;
+class VasnecovMesh;
 class VasnecovProduct;
 class VasnecovResourceManager;
 class VasnecovTerrain;
 class VasnecovLabel;
 
+namespace Vasnecov
+{
+    // Описание детали для пакетного добавления
+    struct PartDescriptor
+    {
+        QString name;
+        QString meshName;
+        VasnecovProduct* parent; // Узел в том же мире или nullptr
+        VasnecovMaterial* material; // nullptr - материал по умолчанию
+
+        PartDescriptor() :
+            name(), meshName(), parent(nullptr), material(nullptr)
+        {}
+        PartDescriptor(const QString& partName, const QString& mesh,
+                       VasnecovProduct* parentNode = nullptr, VasnecovMaterial* partMaterial = nullptr) :
+            name(partName), meshName(mesh), parent(parentNode), material(partMaterial)
+        {}
+    };
+}
+
 class VasnecovUniverse
 {
     // Управление индикатором загрузки
@@ -49,7 +75,7 @@ class VasnecovUniverse
         Q_DISABLE_COPY(LoadingStatus)
     };
 
-    // Шаблон контейнера списков с возможностью удаления
+    // Шаблон контейнера списков с возможностью удаления. Элементы создаются и уничтожаются его пулом
     template <typename T>
     class ElementFullBox : public Vasnecov::ElementBox<T>
     {
@@ -57,11 +83,16 @@ class VasnecovUniverse
         ElementFullBox();
         ~ElementFullBox();
 
+        template <typename... Args>
+        T* create(Args&&... args) {return m_pool.create(std::forward<Args>(args)...);}
+        void destroy(T* element) {m_pool.destroy(element);} // Для не добавленного в список
+
         virtual GLboolean synchronize();
         GLboolean removeElement(T* element);
         const std::vector<T*>& deleting() const;
 
     protected:
+        Vasnecov::ElementPool<T> m_pool;
         std::vector<T*> m_deleting;
     };
 
@@ -75,10 +106,36 @@ class VasnecovUniverse
         VasnecovMaterial* findRawElement(VasnecovMaterial* material) const {return _materials.findElement(material);}
         using Vasnecov::ElementList<ElementFullBox>::findRawElement;
 
+        Vasnecov::ElementHandle handle(VasnecovWorld* world) const {return _worlds.handle(world);}
+        Vasnecov::ElementHandle handle(VasnecovMaterial* material) const {return _materials.handle(material);}
+        using Vasnecov::ElementList<ElementFullBox>::handle;
+
         GLboolean addElement(VasnecovWorld* world, GLboolean check = false) {return _worlds.addElement(world, check);}
         GLboolean addElement(VasnecovMaterial* material, GLboolean check = false) {return _materials.addElement(material, check);}
         using Vasnecov::ElementList<ElementFullBox>::addElement;
 
+        // Создание в пулах. Не добавленный в список элемент уничтожается destroyElement
+        template <typename... Args>
+        VasnecovWorld* createWorld(Args&&... args)       {return _worlds.create(std::forward<Args>(args)...);}
+        template <typename... Args>
+        VasnecovMaterial* createMaterial(Args&&... args) {return _materials.create(std::forward<Args>(args)...);}
+        template <typename... Args>
+        VasnecovLamp* createLamp(Args&&... args)         {return _lamps.create(std::forward<Args>(args)...);}
+        template <typename... Args>
+        VasnecovProduct* createProduct(Args&&... args)   {return _products.create(std::forward<Args>(args)...);}
+        template <typename... Args>
+        VasnecovFigure* createFigure(Args&&... args)     {return _figures.create(std::forward<Args>(args)...);}
+        template <typename... Args>
+        VasnecovTerrain* createTerrain(Args&&... args)   {return _terrains.create(std::forward<Args>(args)...);}
+        template <typename... Args>
+        VasnecovLabel* createLabel(Args&&... args)       {return _labels.create(std::forward<Args>(args)...);}
+
+        void destroyElement(VasnecovMaterial* material) {_materials.destroy(material);}
+        void destroyElement(VasnecovLamp* lamp)         {_lamps.destroy(lamp);}
+        void destroyElement(VasnecovFigure* figure)     {_figures.destroy(figure);}
+        void destroyElement(VasnecovTerrain* terrain)   {_terrains.destroy(terrain);}
+        void destroyElement(VasnecovLabel* label)       {_labels.destroy(label);}
+
         GLboolean removeElement(VasnecovWorld* world) {return _worlds.removeElement(world);}
         GLboolean removeElement(VasnecovMaterial* material) {return _materials.removeElement(material);}
         using Vasnecov::ElementList<ElementFullBox>::removeElement;
@@ -117,6 +174,12 @@ class VasnecovUniverse
 
             return res;
         }
+        virtual GLboolean wasUpdated() const
+        {
+            return _worlds.wasUpdated() ||
+                   _materials.wasUpdated() ||
+                   Vasnecov::ElementList<ElementFullBox>::wasUpdated();
+        }
 
         // Работа со списками удаления
         const std::vector<VasnecovWorld*>& deletingWorlds() const       {return _worlds.deleting();}
@@ -173,6 +236,14 @@ public:
     VasnecovProduct* referProductToWorld(VasnecovProduct* product, VasnecovWorld* world); // Сделать дубликат изделия в заданный мир
     GLboolean removeProduct(VasnecovProduct* product);
 
+    // Пакетные операции. Стоимость линейна по числу элементов, отрисовка получает результат за одну синхронизацию
+    GLuint addParts(VasnecovWorld* world,
+                    const Vasnecov::PartDescriptor* parts,
+                    GLuint count,
+                    VasnecovProduct** result = nullptr); // result - count указателей, nullptr для неудавшихся
+    GLuint removeProducts(const std::vector<VasnecovProduct*>& products); // Вместе с потомками
+    GLuint clearWorld(VasnecovWorld* world); // Элементы, входящие в другие миры, остаются в них
+
     VasnecovFigure* addFigure(const QString& name,
                               VasnecovWorld* world);
     GLboolean removeFigure(VasnecovFigure* figure);
@@ -198,12 +269,31 @@ public:
     VasnecovMaterial* addMaterial();
     VasnecovTexture* textureByName(const QString& textureName, Vasnecov::TextureTypes type = Vasnecov::TextureTypeDiffuse);
 
+    // Пакет изменений: пересчёт матриц элементов откладывается до commit (по разу на элемент),
+    // а отрисовка до commit показывает состояние до пакета. Пакеты могут быть вложенными
+    void beginBatch();
+    GLboolean commit(); // false, если пакет не был открыт
+    GLboolean isBatchOpen() const;
+
+    // Установка положений набора элементов одним вызовом. Матрицы поворота считаются векторно
+    // по непрерывным массивам компонент. Углы элементов после этого вычисляются по требованию
+    GLboolean setPoses(VasnecovAbstractElement* const* elements,
+                       const QVector3D* positions,
+                       const QQuaternion* orientations,
+                       GLuint count);
 
     // Настройки рендеринга
     void setContext(const QGLContext* context);
     void setBackgroundColor(const QColor& color);
     void setBackgroundColor(QRgb rgb);
 
+    // Отрисовка по требованию. true, если последний кадр устарел: изменились данные, камеры,
+    // настройки или идёт загрузка (индикатор анимирован). Иначе хост может не перерисовывать
+    // или вывести сохранённый кадр. С размером окна - ещё и при его смене
+    GLboolean needsRedraw() const;
+    GLboolean needsRedraw(GLsizei width, GLsizei height) const;
+    void requestRedraw(); // Перерисовка в ближайшем кадре без изменения данных
+
     // Загрузка ресурсов
     /*
      * Загрузка ресурсов происходит из директории ресурсов,
@@ -223,11 +313,33 @@ public:
 
     QString info(GLuint type = 0);
 
+    // Статистика времени отрисовки (CPU и GPU по мирам и проходам)
+    void setStatisticsEnabled(GLboolean enabled = true);
+    Vasnecov::FrameStatistics statistics();
+
+    // Захват кадров: чтение через кольцо PBO без остановки конвейера.
+    // Кадры приходят с задержкой в несколько кадров; если очередь полна, новые кадры отбрасываются.
+    void startCapture(const Vasnecov::CaptureParameters& parameters = Vasnecov::CaptureParameters());
+    void stopCapture(); // Кадры, ещё читаемые из буферов, выдаются при следующей отрисовке
+    GLboolean takeCapturedFrame(Vasnecov::CapturedFrame& frame);
+    quint64 droppedCapturedFrames() const;
+
 private:
     // Методы, вызываемые из внешних потоков (работают с сырыми данными)
     GLboolean designerRemoveThisAlienMatrix(const QMatrix4x4* alienMs);
+    GLboolean designerRemoveAlienMatrices(const std::unordered_set<const QMatrix4x4*>& alienMs);
     template <typename T>
     GLboolean designerRemoveSimpleElement(T* element);
+    template <typename T>
+    GLuint designerRemoveSimpleElements(const std::vector<T*>& elements, std::unordered_set<const QMatrix4x4*>& alienMs);
+    GLuint designerRemoveProducts(const std::vector<VasnecovProduct*>& products);
+    // Убирает из мира элементы, входящие в другие миры, и возвращает остальные
+    template <typename T>
+    std::vector<T*> designerDetachFromWorld(VasnecovWorld* world, const std::vector<T*>& elements);
+
+    VasnecovMesh* designerLoadMesh(const QString& meshName); // С загрузкой при необходимости
+    VasnecovProduct* designerAddPart(const QString& name, VasnecovWorld* world, VasnecovMesh* mesh,
+                                     VasnecovMaterial* material, VasnecovProduct* parent);
 
 private:
     GLenum renderUpdateData(); // Единственный метод, который лочит мьютекс из основного потока (потока отрисовки)
@@ -237,12 +349,96 @@ private:
     void renderInitialize();
     void renderDrawAll(GLsizei width, GLsizei height);
     void renderDrawLoadingImage();
+    void renderDrawWorlds();
+    void renderDamageAllWorlds();
+    // Повреждение миров, содержащих обновлённые элементы
+    template <typename T>
+    void renderDamageWorlds(const Vasnecov::UpdateQueue& elements)
+    {
+        if(elements.empty())
+            return;
+
+        for(auto world : _elements.pureWorlds())
+        {
+            if(!world || world->renderIsDamaged())
+                continue;
+
+            for(auto element : elements)
+            {
+                if(world->renderContains(static_cast<T*>(element)))
+                {
+                    world->renderDamage();
+                    break;
+                }
+            }
+        }
+    }
+    void renderApplyPosted();
 
+    // Обращается ли обновление элемента к OpenGL
     template <typename T>
-    static void renderUpdateElementData(T* element)
+    static GLboolean renderUpdateNeedsContext(const T*)
     {
-        if(element != nullptr)
-            element->renderUpdateData();
+        return false;
+    }
+    static GLboolean renderUpdateNeedsContext(const VasnecovLabel* label);
+
+    // Обработка очереди изменённых объектов. Объекты, чьи флаги не сбросились, остаются в очереди.
+    // Места удалённых объектов пустые
+    template <typename F>
+    void renderUpdateQueue(Vasnecov::UpdateQueue& queue, F fun)
+    {
+        _updating.clear();
+        _updating.swap(queue);
+        _updating.erase(std::remove(_updating.begin(), _updating.end(), nullptr), _updating.end());
+
+        fun(_updating);
+
+        for(auto object : _updating)
+            object->updaterReleaseQueue();
+    }
+    // С запоминанием элементов, чьи границы изменились (для пространственных индексов миров).
+    // Элементы обновляются параллельно, а обновления, которым нужен контекст OpenGL, идут последовательно после
+    template <typename T>
+    void renderUpdateElementsData(const Vasnecov::UpdateQueue& elements)
+    {
+        enum States : GLubyte
+        {
+            StateNone = 0,
+            StateBoundsChanged,
+            StateDeferred
+        };
+
+        const GLint amount(static_cast<GLint>(elements.size()));
+        _updateStates.assign(elements.size(), StateNone);
+        GLubyte* states(_updateStates.data());
+
+#pragma omp parallel for schedule(static, Vasnecov::cfg_parallelUpdateChunk) if(amount >= Vasnecov::cfg_parallelUpdateMin)
+        for(GLint i = 0; i < amount; ++i)
+        {
+            T* element(static_cast<T*>(elements[i]));
+            if(renderUpdateNeedsContext(element))
+            {
+                states[i] = StateDeferred;
+                continue;
+            }
+
+            GLenum updated = element->renderUpdateData();
+            if(static_cast<VasnecovElement*>(element)->renderBoundsChanged(updated))
+                states[i] = StateBoundsChanged;
+        }
+
+        for(GLint i = 0; i < amount; ++i)
+        {
+            T* element(static_cast<T*>(elements[i]));
+            if(states[i] == StateDeferred)
+            {
+                GLenum updated = element->renderUpdateData();
+                states[i] = static_cast<VasnecovElement*>(element)->renderBoundsChanged(updated) ? StateBoundsChanged : StateNone;
+            }
+            if(states[i] == StateBoundsChanged)
+                _changedBounds.push_back(element);
+        }
     }
 
 private:
@@ -252,10 +448,14 @@ private:
     // Размеры окна вывода
     GLsizei                                 _width;
     GLsizei                                 _height;
+    std::atomic<bool>                       _redrawRequested;
     // Картинка для индикации загрузки
     Vasnecov::MutualData<GLboolean>         _loading;
     QImage                                  _loadingImage0, _loadingImage1;
     timespec                                _loadingImageTimer;
+    Vasnecov::MutualData<GLboolean>         _statisticsEnabled;
+    Vasnecov::MutualData<Vasnecov::CaptureParameters> _captureParameters;
+    Vasnecov::FrameCapture                  _capture;
 
     GLuint                                  _lampsCountMax;
 
@@ -263,7 +463,23 @@ private:
     // Списки общих (между мирами) данных
     Vasnecov::Attributes                    raw_data;
     bmcl::Rc<VasnecovResourceManager>       _resourceManager;
+    // Объекты с изменёнными данными. Объявлены до списков, т.к. удаляемые объекты убирают себя из очередей
+    Vasnecov::UpdateQueue                   _updatedWorlds;
+    Vasnecov::UpdateQueue                   _updatedMaterials;
+    Vasnecov::UpdateQueue                   _updatedLamps;
+    Vasnecov::UpdateQueue                   _updatedProducts;
+    Vasnecov::UpdateQueue                   _updatedFigures;
+    Vasnecov::UpdateQueue                   _updatedTerrains;
+    Vasnecov::UpdateQueue                   _updatedLabels;
+    Vasnecov::UpdateQueue                   _updating; // Обрабатываемая очередь
+    Vasnecov::PostQueue                     _posted; // Элементы с публикациями из других потоков
+    Vasnecov::ProductHierarchy              _hierarchy; // Изделия всех миров в порядке обхода
+    Vasnecov::UpdateBatch                   _batch;
+    Vasnecov::PoseArrays                    _poses; // Для setPoses
+    std::unordered_set<const VasnecovAbstractElement*> _posed; // Элементы вызова setPoses
     UniverseElementList                     _elements;
+    std::vector<VasnecovElement*>           _changedBounds; // Заполняется в renderUpdateData
+    std::vector<GLubyte>                    _updateStates; // Для renderUpdateElementsData
 
     enum Updated
     {
@@ -277,6 +493,8 @@ private:
         Flags			= 0x0001000,
         Loading			= 0x0002000,
         BackColor		= 0x0004000,
+        Statistics		= 0x0008000,
+        Capture			= 0x0010000,
 
         Context			= 0x0080000,
         Tech01			= 0x0100000,
@@ -291,8 +509,13 @@ private:
     Vasnecov::MutualData<QString>           _techSL;
     Vasnecov::MutualData<QString>           _techExtensions;
 
+    // Статистика последнего полностью измеренного кадра (raw - из потока рендеринга)
+    Vasnecov::UpdateFlags                   _statisticsUpdated;
+    Vasnecov::MutualData<Vasnecov::FrameStatistics> _statistics;
+
     friend class VasnecovScene;
     friend class VasnecovWidget;
+    friend class VasnecovOffscreenRenderer;
 
 private:
     Q_DISABLE_COPY(VasnecovUniverse)
@@ -308,6 +531,7 @@ inline void VasnecovUniverse::setContext(const QGLContext *context)
 
 template <typename T>
 VasnecovUniverse::ElementFullBox<T>::ElementFullBox() :
+    m_pool(),
     m_deleting()
 {}
 template <typename T>
@@ -316,31 +540,28 @@ VasnecovUniverse::ElementFullBox<T>::~ElementFullBox()
     for(typename std::vector<T *>::iterator eit = this->_raw.begin();
         eit != this->_raw.end(); ++eit)
     {
-        delete (*eit);
+        m_pool.destroy(*eit);
         (*eit) = 0;
     }
 
     for(typename std::vector<T *>::iterator eit = this->m_deleting.begin();
         eit != this->m_deleting.end(); ++eit)
     {
-        delete (*eit);
+        m_pool.destroy(*eit);
         (*eit) = 0;
     }
 }
 template <typename T>
 GLboolean VasnecovUniverse::ElementFullBox<T>::synchronize()
 {
-    if(this->_wasUpdated)
+    if(Vasnecov::ElementBox<T>::synchronize())
     {
-        this->_pure.swap(this->_buffer);
-        this->_wasUpdated = false;
-
         if(!m_deleting.empty())
         {
             for(typename std::vector<T *>::iterator eit = m_deleting.begin();
                 eit != m_deleting.end(); ++eit)
             {
-                delete (*eit);
+                m_pool.destroy(*eit);
                 (*eit) = nullptr;
             }
             m_deleting.clear();
@@ -353,22 +574,10 @@ GLboolean VasnecovUniverse::ElementFullBox<T>::synchronize()
 template <typename T>
 GLboolean VasnecovUniverse::ElementFullBox<T>::removeElement(T *element)
 {
-    if(element)
+    if(Vasnecov::ElementBox<T>::removeElement(element))
     {
-        for(typename std::vector<T *>::iterator eit = this->_raw.begin();
-            eit != this->_raw.end(); ++eit)
-        {
-            if((*eit) == element)
-            {
-                m_deleting.push_back(*eit);
-
-                this->_raw.erase(eit);
-                this->_buffer = this->_raw;
-
-                this->_wasUpdated = true;
-                return true;
-            }
-        }
+        m_deleting.push_back(element);
+        return true;
     }
 
     return false;
@@ -403,3 +612,53 @@ GLboolean VasnecovUniverse::designerRemoveSimpleElement(T* element)
 
     return false;
 }
+
+template <typename T>
+GLuint VasnecovUniverse::designerRemoveSimpleElements(const std::vector<T*>& elements, std::unordered_set<const QMatrix4x4*>& alienMs)
+{
+    GLuint count(0);
+
+    for(const auto element : elements)
+    {
+        if(element && _elements.removeElement(element))
+        {
+            for(const auto world : _elements.rawWorlds())
+                world->designerRemoveElement(element);
+
+            alienMs.insert(element->designerExportingMatrix());
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+template <typename T>
+std::vector<T*> VasnecovUniverse::designerDetachFromWorld(VasnecovWorld* world, const std::vector<T*>& elements)
+{
+    std::vector<T*> orphans, shared;
+
+    for(const auto element : elements)
+    {
+        GLboolean elsewhere(false);
+        for(const auto other : _elements.rawWorlds())
+        {
+            if(other != world && other->designerFindElement(element))
+            {
+                elsewhere = true;
+                break;
+            }
+        }
+
+        if(elsewhere)
+            shared.push_back(element);
+        else
+            orphans.push_back(element);
+    }
+
+    // elements - список самого мира, поэтому удаление после обхода
+    for(const auto element : shared)
+        world->designerRemoveElement(element);
+
+    return orphans;
+}
@@ -8,7 +8,9 @@
  */
 
 #include "Configuration.h"
+#include "ProductHierarchy.h"
 #include "Technologist.h"
+#include "Tracer.h"
 #include "VasnecovFigure.h"
 #include "VasnecovLabel.h"
 #include "VasnecovLamp.h"
@@ -17,9 +19,44 @@
 #include "VasnecovTerrain.h"
 #include "VasnecovWorld.h"
 
+#include <algorithm>
+#include <unordered_set>
+#include <QPolygonF>
 #include <QSize>
 #include <QRect>
 
+namespace
+{
+    // Пересечение отрезка с прямоугольником (отсечение Лианга-Барски)
+    GLboolean segmentIntersectsRect(const QPointF& a, const QPointF& b, const QRectF& rect)
+    {
+        qreal t0(0.0), t1(1.0);
+        const qreal dx(b.x() - a.x());
+        const qreal dy(b.y() - a.y());
+        const qreal p[4] = {-dx, dx, -dy, dy};
+        const qreal q[4] = {a.x() - rect.left(), rect.right() - a.x(), a.y() - rect.top(), rect.bottom() - a.y()};
+
+        for(int i = 0; i < 4; ++i)
+        {
+            if(p[i] == 0.0)
+            {
+                if(q[i] < 0.0)
+                    return false;
+                continue;
+            }
+
+            qreal t(q[i] / p[i]);
+            if(p[i] < 0.0)
+                t0 = std::max(t0, t);
+            else
+                t1 = std::min(t1, t);
+            if(t0 > t1)
+                return false;
+        }
+        return true;
+    }
+}
+
 VasnecovWorld::VasnecovWorld(VasnecovPipeline* pipeline,
                              GLint mx, GLint my,
                              GLsizei width, GLsizei height,
@@ -30,9 +67,24 @@ VasnecovWorld::VasnecovWorld(VasnecovPipeline* pipeline,
     _ortho(raw_wasUpdated, Ortho),
     _camera(raw_wasUpdated, Cameras),
     _projectionMatrix(raw_wasUpdated, Matrix),
+    _pureName(name),
+    _traceName(Vasnecov::Tracer::intern(name)),
+    _frustum(),
+    _culledAmount(0),
     _lightModel(),
 
-    _elements()
+    _elements(),
+    _spatialIndex(),
+    _spatialAttached(),
+    _spatialMembershipChanged(true),
+    _orderedProducts(),
+    _orderedVersion(0),
+    _orderOutdated(true),
+    _transProductsOrder(),
+    _transFiguresOrder(),
+    _transMoved(true),
+    _damaged(true),
+    _cache()
 {
     _parameters.editableRaw().setX(mx);
     _parameters.editableRaw().setY(my);
@@ -284,6 +336,15 @@ GLenum VasnecovWorld::renderUpdateData()
 
     // Обновление своих данных
     updated |= _elements.synchronizeAll();
+    if(updated)
+    {
+        _spatialMembershipChanged = true;
+        _orderOutdated = true;
+    }
+
+    // Возврат матрицы проекции во внешний поток изображение не меняет
+    if(updated || (raw_wasUpdated & ~static_cast<GLenum>(Matrix)))
+        _damaged = true;
 
     if(raw_wasUpdated)
     {
@@ -297,15 +358,114 @@ GLenum VasnecovWorld::renderUpdateData()
         // Matrix is only one object edited by renderer and readed by designer
         _projectionMatrix.synchronizeRaw();
 
+        if(raw_wasUpdated & Name)
+        {
+            _pureName = raw_name;
+            _traceName = Vasnecov::Tracer::intern(_pureName);
+        }
+
         Vasnecov::CoreObject::renderUpdateData();
     }
     return updated;
 }
+void VasnecovWorld::renderOrderProducts(const Vasnecov::ProductHierarchy& hierarchy)
+{
+    if(!_orderOutdated && _orderedVersion == hierarchy.version())
+        return;
+
+    _orderOutdated = false;
+    _orderedVersion = hierarchy.version();
+
+    // Список мира не переупорядочивается (его синхронизация повторяет изменения по индексам),
+    // поэтому порядок обхода хранится отдельно. Дерево при синхронизации не меняется
+    _orderedProducts.clear();
+    _orderedProducts.reserve(_elements.pureProducts().size());
+    for(auto product : _elements.pureProducts())
+    {
+        if(product)
+            _orderedProducts.push_back(product);
+    }
+    std::sort(_orderedProducts.begin(), _orderedProducts.end(),
+              [&hierarchy](const VasnecovProduct* a, const VasnecovProduct* b)
+    {
+        return hierarchy.node(a) < hierarchy.node(b);
+    });
+}
+void VasnecovWorld::renderUpdateSpatialIndex(const std::vector<VasnecovElement*>& changed)
+{
+    VASNECOV_TRACE("spatialIndex", "render");
+
+    if(_spatialMembershipChanged)
+    {
+        _spatialMembershipChanged = false;
+        _transMoved = true;
+
+        std::vector<std::pair<VasnecovElement*, GLuint>> present;
+        present.reserve(_elements.pureProducts().size() + _elements.pureFigures().size() +
+                        _elements.pureTerrains().size() + _elements.pureLabels().size());
+        renderCollectElements(_elements.pureProducts(), Vasnecov::SpatialTypeProduct, present);
+        renderCollectElements(_elements.pureFigures(), Vasnecov::SpatialTypeFigure, present);
+        renderCollectElements(_elements.pureTerrains(), Vasnecov::SpatialTypeTerrain, present);
+        renderCollectElements(_elements.pureLabels(), Vasnecov::SpatialTypeLabel, present);
+
+        std::unordered_map<VasnecovElement*, GLuint> types(present.begin(), present.end());
+
+        // Удалённые из мира. По адресу удалённого мог быть создан новый элемент другого типа
+        std::vector<VasnecovElement*> indexed(_spatialIndex.elements());
+        for(auto element : indexed)
+        {
+            auto found = types.find(element);
+            if(found == types.end() || found->second != _spatialIndex.type(element))
+                _spatialIndex.remove(element);
+        }
+
+        _spatialAttached.clear();
+        for(const auto& element : present)
+        {
+            if(!_spatialIndex.update(element.first, element.first->renderWorldBoundingBox()))
+                _spatialIndex.insert(element.first, element.second, element.first->renderWorldBoundingBox());
+
+            if(element.first->m_alienMs.pure())
+                _spatialAttached.insert(element.first);
+        }
+    }
+
+    for(auto element : changed)
+    {
+        if(!_spatialIndex.contains(element))
+            continue;
+
+        _spatialIndex.update(element, element->renderWorldBoundingBox());
+        _transMoved = true;
+
+        if(element->m_alienMs.pure())
+            _spatialAttached.insert(element);
+        else
+            _spatialAttached.erase(element);
+    }
+
+    // Чужая матрица меняется без уведомления этого элемента
+    for(auto element : _spatialAttached)
+        _spatialIndex.update(element, element->renderWorldBoundingBox());
+    if(!_spatialAttached.empty())
+    {
+        _transMoved = true;
+        // Хозяин чужой матрицы мог сдвинуться, в том числе в другом мире
+        if(!changed.empty())
+            _damaged = true;
+    }
+
+    _spatialIndex.commit();
+}
+
 void VasnecovWorld::renderDraw()
 {
-    if(m_isHidden.pure())
+    if(renderIsHidden())
         return;
 
+    Vasnecov::RenderProfiler& profiler(pure_pipeline->profiler());
+    profiler.startWorld(_pureName, _traceName);
+
     pure_pipeline->clearZBuffer();
 
     // Задание характеристик мира
@@ -325,7 +485,26 @@ void VasnecovWorld::renderDraw()
         pure_pipeline->setOrtho(_ortho.pure(), renderCalculateCamera());
     }
 
-    _projectionMatrix.editablePure() = pure_pipeline->matrixP();
+    // Возврат во внешний поток только изменившейся матрицы, иначе мир обновлялся бы каждый кадр
+    if(_projectionMatrix.pure() != pure_pipeline->matrixP())
+        _projectionMatrix.editablePure() = pure_pipeline->matrixP();
+
+    // Отсечение по пирамиде видимости. Матрица P включает и положение камеры
+    const GLboolean culling(_parameters.pure().culling());
+    if(culling)
+        _frustum.set(_projectionMatrix.pure());
+
+    GLuint culledAmount(0);
+    auto isVisible = [this, culling, &culledAmount](const VasnecovElement* element) -> GLboolean
+    {
+        if(element->renderIsHidden())
+            return false;
+        if(!culling || element->renderIsVisible(_frustum))
+            return true;
+
+        ++culledAmount;
+        return false;
+    };
 
     // Моделирование
     // Обработка источников света
@@ -345,6 +524,7 @@ void VasnecovWorld::renderDraw()
     // Draw terrains
     if(_elements.hasPureTerrains())
     {
+        profiler.startPass(Vasnecov::RenderPassTerrains);
         pure_pipeline->enableDepth();
 
         // Задание материала по умолчанию
@@ -352,7 +532,10 @@ void VasnecovWorld::renderDraw()
         mat.renderDraw();
 
         for(auto terrain : _elements.pureTerrains())
-            terrain->renderDraw();
+        {
+            if(isVisible(terrain))
+                terrain->renderDraw();
+        }
     }
 
     // Рисование фигур (непрозрачных)
@@ -386,18 +569,22 @@ void VasnecovWorld::renderDraw()
     };
 
     std::vector<VasnecovFigure *> transFigures;
-    size_t withoutDepthAmount(0);
+    std::vector<VasnecovFigure *> depthlessFigures;
 
     if(_elements.hasPureFigures())
     {
+        profiler.startPass(Vasnecov::RenderPassOpaqueFigures);
         startDrawFigures();
 
         transFigures.reserve(_elements.pureFigures().size());
         for(auto figure : _elements.pureFigures())
         {
+            if(!isVisible(figure))
+                continue;
+
             if(!figure->renderHasDepth())
             {
-                ++withoutDepthAmount;
+                depthlessFigures.push_back(figure);
                 continue;
             }
 
@@ -418,14 +605,14 @@ void VasnecovWorld::renderDraw()
     // Отрисовка непрозрачных изделий (деталей)
     std::vector<VasnecovProduct *> transProducts;
 
-    if(_elements.hasPureProducts())
+    if(!_orderedProducts.empty())
     {
-        transProducts.reserve(_elements.pureProducts().size());
-        for(std::vector<VasnecovProduct *>::const_iterator pit = _elements.pureProducts().begin();
-            pit != _elements.pureProducts().end(); ++pit)
+        profiler.startPass(Vasnecov::RenderPassProducts);
+        transProducts.reserve(_orderedProducts.size());
+        // В порядке дерева: соседние изделия обычно делят материалы и лежат рядом в его массивах
+        for(auto prod : _orderedProducts)
         {
-            VasnecovProduct *prod(*pit);
-            if(prod)
+            if(isVisible(prod))
             {
                 if(prod->renderIsTransparency())
                 {
@@ -440,24 +627,27 @@ void VasnecovWorld::renderDraw()
     }
 
     // Прозрачные и полупрозрачные изделия (детали)
+    if(!transProducts.empty() || !transFigures.empty() || !depthlessFigures.empty())
+        profiler.startPass(Vasnecov::RenderPassTransparent);
+
+    // Взвешенное смешивание не зависит от порядка. Без поддержки контекстом - сортировка
+    const GLboolean weighted(_parameters.pure().transparency() == Vasnecov::TransparencyWeighted &&
+                             (!transProducts.empty() || !transFigures.empty()) &&
+                             pure_pipeline->beginWeightedTransparency());
+
+    // Сортировка от дальних к ближним продолжает порядок прошлого кадра
+    const QVector3D viewVector((_camera.pure().target() - _camera.pure().position()).normalized());
+    const QVector3D viewPoint(_camera.pure().position());
+    // Без сортировки признак движения копится до возврата к ней
+    const GLboolean transMoved(_transMoved);
+    if(!weighted)
+        _transMoved = false;
+
     if(!transProducts.empty())
     {
-        if(Vasnecov::cfg_sortTransparency)
+        if(Vasnecov::cfg_sortTransparency && !weighted)
         {
-            QVector3D viewVector = (_camera.pure().target() - _camera.pure().position()).normalized();
-            QVector3D viewPoint = _camera.pure().position();
-
-            for(std::vector<VasnecovProduct *>::const_iterator pit = transProducts.begin();
-                pit != transProducts.end(); ++pit)
-            {
-                VasnecovProduct *prod(*pit);
-                if(prod)
-                {
-                    prod->renderCalculateDistanceToPlane(viewPoint, viewVector);
-                }
-            }
-
-            std::sort(transProducts.begin(), transProducts.end(), VasnecovElement::renderCompareByReverseDistance);
+            _transProductsOrder.sort(transProducts, viewPoint, viewVector, transMoved);
         }
 
         for(std::vector<VasnecovProduct *>::const_iterator pit = transProducts.begin();
@@ -474,22 +664,9 @@ void VasnecovWorld::renderDraw()
     // Рисование фигур (прозрачных)
     if(!transFigures.empty())
     {
-        if(Vasnecov::cfg_sortTransparency)
+        if(Vasnecov::cfg_sortTransparency && !weighted)
         {
-            QVector3D viewVector = (_camera.pure().target() - _camera.pure().position()).normalized();
-            QVector3D viewPoint = _camera.pure().position();
-
-            for(std::vector<VasnecovFigure *>::iterator fit = transFigures.begin();
-                fit != transFigures.end(); ++fit)
-            {
-                VasnecovFigure *fig(*fit);
-                if(fig)
-                {
-                    fig->renderCalculateDistanceToPlane(viewPoint, viewVector);
-                }
-            }
-
-            std::sort(transFigures.begin(), transFigures.end(), VasnecovElement::renderCompareByReverseDistance);
+            _transFiguresOrder.sort(transFigures, viewPoint, viewVector, transMoved);
         }
 
         startDrawFigures();
@@ -502,16 +679,16 @@ void VasnecovWorld::renderDraw()
         stopDrawFigures();
     }
 
+    if(weighted)
+        pure_pipeline->endWeightedTransparency();
+
     // Draw figures without depth
-    if(withoutDepthAmount)
+    if(!depthlessFigures.empty())
     {
         startDrawFigures();
 
-        for(auto figure : _elements.pureFigures())
+        for(auto figure : depthlessFigures)
         {
-            if(figure->renderHasDepth())
-                continue;
-
             checkLighting(figure);
             figure->renderDraw();
         }
@@ -522,15 +699,60 @@ void VasnecovWorld::renderDraw()
     // Отрисовка меток
     if(_elements.hasPureLabels())
     {
+        profiler.startPass(Vasnecov::RenderPassLabels);
         pure_pipeline->disableDepth();
         pure_pipeline->clearZBuffer();
         pure_pipeline->disableLamps();
         pure_pipeline->disableBackFaces();
 
         pure_pipeline->setOrtho2D();
-            _elements.forEachPureLabel(renderDrawElement<VasnecovLabel>);
+        for(auto label : _elements.pureLabels())
+        {
+            if(label && isVisible(label))
+                label->renderDraw();
+        }
         pure_pipeline->unsetOrtho2D();
     }
+
+    _culledAmount.store(culledAmount, std::memory_order_relaxed);
+    profiler.setWorldCulled(culledAmount);
+    profiler.stopWorld();
+}
+GLboolean VasnecovWorld::renderDrawCached()
+{
+    const Vasnecov::WorldParameters& parameters(_parameters.pure());
+    const GLboolean damaged(_damaged);
+    _damaged = false;
+
+    if(!parameters.caching() || renderIsHidden())
+    {
+        _cache.renderRelease(pure_pipeline);
+        renderDraw();
+        return damaged;
+    }
+
+    if(!damaged && _cache.isValid(parameters.x(), parameters.y(), parameters.width(), parameters.height()))
+    {
+        _cache.renderRestore(pure_pipeline);
+        return false;
+    }
+
+    renderDraw();
+
+    // Снимок только после кадра без изменений, чтобы не копировать постоянно меняющийся мир
+    if(damaged)
+        _cache.invalidate();
+    else
+        _cache.renderStore(pure_pipeline, parameters.x(), parameters.y(), parameters.width(), parameters.height());
+
+    return damaged;
+}
+QRect VasnecovWorld::renderWindow() const
+{
+    return QRect(_parameters.pure().x(),
+                 _parameters.pure().y(),
+                 _parameters.pure().width(),
+                 _parameters.pure().height());
 }
 Vasnecov::WorldParameters VasnecovWorld::worldParameters() const
 {
@@ -663,6 +885,257 @@ Vasnecov::Line VasnecovWorld::unprojectPointToLine(GLfloat x, GLfloat y)
     return Vasnecov::Line();
 }
 
+std::vector<VasnecovElement*> VasnecovWorld::elementsInFrustum(GLuint types) const
+{
+    std::vector<VasnecovElement*> res;
+    _spatialIndex.queryFrustum(Vasnecov::Frustum(_projectionMatrix.raw()), res, types);
+    return res;
+}
+
+std::vector<VasnecovElement*> VasnecovWorld::elementsInBox(const Vasnecov::BoundingBox& box, GLuint types) const
+{
+    std::vector<VasnecovElement*> res;
+    _spatialIndex.queryBox(box, res, types);
+    return res;
+}
+
+std::vector<VasnecovElement*> VasnecovWorld::elementsInSphere(const QVector3D& center, GLfloat radius, GLuint types) const
+{
+    std::vector<VasnecovElement*> res;
+    _spatialIndex.querySphere(center, radius, res, types);
+    return res;
+}
+
+std::vector<Vasnecov::BoundingVolumeHierarchy::RayHit> VasnecovWorld::elementsOnLine(const Vasnecov::Line& line, GLuint types) const
+{
+    std::vector<Vasnecov::BoundingVolumeHierarchy::RayHit> res;
+    if(!line.isNull())
+        _spatialIndex.queryRay(line.p1(), line.p2() - line.p1(), 1.0f, res, types);
+    return res;
+}
+
+Vasnecov::PickResult VasnecovWorld::pick(const QPointF& point, GLuint types)
+{
+    return pick(point.x(), point.y(), types);
+}
+
+Vasnecov::PickResult VasnecovWorld::pick(GLfloat x, GLfloat y, GLuint types)
+{
+    VASNECOV_TRACE("pick", "designer");
+
+    Vasnecov::PickResult res;
+
+    Vasnecov::Line line(unprojectPointToLine(x, y));
+    if(line.isNull())
+        return res;
+
+    const QVector3D origin(line.p1());
+    const QVector3D direction(line.p2() - line.p1());
+    GLfloat best(1.0f);
+    GLboolean approached(false); // Найдена линия или точка, точка попадания уже известна
+
+    // Поверхности: широкая фаза по дереву мира, узкая - по треугольникам элемента
+    _spatialIndex.traverseRay(origin, direction, best, types & ~Vasnecov::SpatialTypeLabel,
+                              [&](VasnecovElement* element, GLuint type, GLfloat) -> GLfloat
+    {
+        if(element->renderIsHidden())
+            return best;
+        if(type == Vasnecov::SpatialTypeFigure && !static_cast<VasnecovFigure*>(element)->renderIsSolid())
+            return best;
+
+        GLfloat distance(0.0f);
+        QVector3D normal;
+        if(element->renderIntersectRay(origin, direction, best, distance, normal))
+        {
+            best = distance;
+            res.type = type;
+            res.element = element;
+            res.normal = normal;
+        }
+        return best;
+    });
+
+    // Линии и точки фигур ищутся с пиксельным допуском, который линейно растёт вдоль луча
+    if(types & Vasnecov::SpatialTypeFigure)
+    {
+        Vasnecov::Line side(unprojectPointToLine(x + Vasnecov::cfg_pickTolerance, y));
+        if(side.isNull())
+            side = unprojectPointToLine(x - Vasnecov::cfg_pickTolerance, y);
+
+        GLfloat tolerance(0.0f), toleranceSlope(0.0f);
+        if(!side.isNull())
+        {
+            tolerance = line.p1().distanceToPoint(side.p1());
+            toleranceSlope = line.p2().distanceToPoint(side.p2()) - tolerance;
+        }
+
+        _spatialIndex.traverseRay(origin, direction, best, Vasnecov::SpatialTypeFigure,
+                                  [&](VasnecovElement* element, GLuint type, GLfloat) -> GLfloat
+        {
+            if(element->renderIsHidden())
+                return best;
+
+            GLfloat distance(0.0f);
+            QVector3D point;
+            if(static_cast<VasnecovFigure*>(element)->renderApproachRay(origin, direction, best,
+                                                                        tolerance, toleranceSlope,
+                                                                        distance, point))
+            {
+                best = distance;
+                res.type = type;
+                res.element = element;
+                res.point = point;
+                res.normal = -direction.normalized();
+                approached = true;
+            }
+            return best;
+        }, tolerance + best * toleranceSlope);
+    }
+
+    if(res.isValid())
+    {
+        if(!approached)
+            res.point = origin + direction * best;
+        res.distance = origin.distanceToPoint(res.point);
+    }
+    return res;
+}
+
+std::vector<VasnecovProduct*> VasnecovWorld::selectInRect(const QRectF& rect, GLboolean contained, GLboolean collapse)
+{
+    const QRectF area(rect.normalized());
+    return designerSelect(area, [&area, contained](const QRectF& bounds) -> GLboolean
+    {
+        if(contained)
+            return bounds.left() >= area.left() && bounds.right() <= area.right() &&
+                   bounds.top() >= area.top() && bounds.bottom() <= area.bottom();
+
+        return bounds.left() <= area.right() && bounds.right() >= area.left() &&
+               bounds.top() <= area.bottom() && bounds.bottom() >= area.top();
+    }, contained, collapse);
+}
+
+std::vector<VasnecovProduct*> VasnecovWorld::selectInPolygon(const std::vector<QPointF>& points, GLboolean contained, GLboolean collapse)
+{
+    if(points.size() < 3)
+        return std::vector<VasnecovProduct*>();
+
+    QPolygonF polygon;
+    polygon.reserve(static_cast<int>(points.size()));
+    for(const auto& point : points)
+        polygon.append(point);
+
+    return designerSelect(polygon.boundingRect(), [&points, &polygon, contained](const QRectF& bounds) -> GLboolean
+    {
+        // Если ни одно ребро контура не задевает прямоугольник, он либо целиком внутри, либо снаружи
+        GLboolean crossed(false);
+        for(size_t i = 0; i < points.size() && !crossed; ++i)
+            crossed = segmentIntersectsRect(points[i], points[(i + 1) % points.size()], bounds);
+
+        if(crossed)
+            return !contained;
+        return polygon.containsPoint(bounds.topLeft(), Qt::OddEvenFill);
+    }, contained, collapse);
+}
+
+template <typename F>
+std::vector<VasnecovProduct*> VasnecovWorld::designerSelect(const QRectF& area, F test, GLboolean contained, GLboolean collapse) const
+{
+    VASNECOV_TRACE("select", "designer");
+
+    std::vector<VasnecovProduct*> res;
+    const Vasnecov::WorldParameters& parameters(_parameters.raw());
+    if(parameters.width() <= 0 || parameters.height() <= 0)
+        return res;
+
+    const GLfloat width(parameters.width());
+    const GLfloat height(parameters.height());
+    const QMatrix4x4& matrix(_projectionMatrix.raw());
+
+    // Пирамида области: масштабирование части окна на всё пространство отсечения.
+    // Область расширена на пиксель, чтобы не вырождаться для щелчка
+    const GLfloat left((area.left() - parameters.x() - 1.0f) * 2.0f / width - 1.0f);
+    const GLfloat right((area.right() - parameters.x() + 1.0f) * 2.0f / width - 1.0f);
+    const GLfloat bottom((area.top() - parameters.y() - 1.0f) * 2.0f / height - 1.0f);
+    const GLfloat top((area.bottom() - parameters.y() + 1.0f) * 2.0f / height - 1.0f);
+    const GLfloat sx(2.0f / (right - left));
+    const GLfloat sy(2.0f / (top - bottom));
+    const QMatrix4x4 zoom(sx,   0.0f, 0.0f, -sx * (left + right) * 0.5f,
+                          0.0f, sy,   0.0f, -sy * (bottom + top) * 0.5f,
+                          0.0f, 0.0f, 1.0f, 0.0f,
+                          0.0f, 0.0f, 0.0f, 1.0f);
+
+    std::vector<VasnecovElement*> candidates;
+    _spatialIndex.queryFrustum(Vasnecov::Frustum(zoom * matrix), candidates, Vasnecov::SpatialTypeProduct);
+    if(candidates.empty())
+        return res;
+
+    std::vector<Vasnecov::BoundingBox> boxes;
+    boxes.reserve(candidates.size());
+    for(auto element : candidates)
+        boxes.push_back(_spatialIndex.box(element));
+
+    std::vector<Vasnecov::ProjectedBounds> projected;
+    Vasnecov::projectBoxes(matrix, boxes, projected);
+
+    std::unordered_set<VasnecovProduct*> collapsed;
+    for(size_t i = 0; i < candidates.size(); ++i)
+    {
+        if(candidates[i]->renderIsHidden())
+            continue;
+
+        // Бокс, пересекающий плоскость камеры, уже прошёл пирамиду, но целиком в области быть не может
+        const Vasnecov::ProjectedBounds& bounds(projected[i]);
+        if(bounds.clipped)
+        {
+            if(contained)
+                continue;
+        }
+        else if(!test(QRectF(QPointF((bounds.minX + 1.0f) * width * 0.5f + parameters.x(),
+                                     (bounds.minY + 1.0f) * height * 0.5f + parameters.y()),
+                             QPointF((bounds.maxX + 1.0f) * width * 0.5f + parameters.x(),
+                                     (bounds.maxY + 1.0f) * height * 0.5f + parameters.y()))))
+        {
+            continue;
+        }
+
+        VasnecovProduct* product(static_cast<VasnecovProduct*>(candidates[i]));
+        if(collapse)
+        {
+            while(product->parent())
+                product = product->parent();
+            if(!collapsed.insert(product).second)
+                continue;
+        }
+        res.push_back(product);
+    }
+
+    return res;
+}
+
+VasnecovProduct* Vasnecov::PickResult::product() const
+{
+    return type == SpatialTypeProduct ? static_cast<VasnecovProduct*>(element) : nullptr;
+}
+
+VasnecovProduct* Vasnecov::PickResult::assembly() const
+{
+    VasnecovProduct* res(product());
+    while(res && res->parent())
+        res = res->parent();
+    return res;
+}
+
+VasnecovFigure* Vasnecov::PickResult::figure() const
+{
+    return type == SpatialTypeFigure ? static_cast<VasnecovFigure*>(element) : nullptr;
+}
+
+VasnecovTerrain* Vasnecov::PickResult::terrain() const
+{
+    return type == SpatialTypeTerrain ? static_cast<VasnecovTerrain*>(element) : nullptr;
+}
+
 QVector2D VasnecovWorld::projectVectorToPoint(const QVector3D& vector)
 {
     if(_parameters.raw().width() <= 0.0f || _parameters.raw().height() <= 0.0f)
@@ -847,6 +1320,53 @@ void VasnecovWorld::switchLight()
 {
     _parameters.editableRaw().setLight(!_parameters.raw().light());
 }
+void VasnecovWorld::setCulling()
+{
+    if(!_parameters.raw().culling())
+        _parameters.editableRaw().setCulling(true);
+}
+void VasnecovWorld::unsetCulling()
+{
+    if(_parameters.raw().culling())
+        _parameters.editableRaw().setCulling(false);
+}
+
+GLboolean VasnecovWorld::culling() const
+{
+    return _parameters.raw().culling();
+}
+
+GLuint VasnecovWorld::culledAmount() const
+{
+    return _culledAmount.load(std::memory_order_relaxed);
+}
+
+void VasnecovWorld::setTransparencyMode(Vasnecov::TransparencyModes mode)
+{
+    if(_parameters.raw().transparency() != mode)
+        _parameters.editableRaw().setTransparency(mode);
+}
+
+Vasnecov::TransparencyModes VasnecovWorld::transparencyMode() const
+{
+    return _parameters.raw().transparency();
+}
+
+void VasnecovWorld::setCaching()
+{
+    if(!_parameters.raw().caching())
+        _parameters.editableRaw().setCaching(true);
+}
+void VasnecovWorld::unsetCaching()
+{
+    if(_parameters.raw().caching())
+        _parameters.editableRaw().setCaching(false);
+}
+
+GLboolean VasnecovWorld::caching() const
+{
+    return _parameters.raw().caching();
+}
 
 VasnecovPipeline::CameraAttributes VasnecovWorld::renderCalculateCamera() const
 {
@@ -14,21 +14,51 @@
 #include "ElementList.h"
 #include "LightModel.h"
 #include "CoreObject.h"
+#include "BoundingVolumeHierarchy.h"
+#include "Geometry.h"
+#include "TransparencyOrder.h"
+#include "WorldCache.h"
+#include <atomic>
+#include <unordered_set>
 
 class VasnecovLamp;
 class VasnecovProduct;
 class VasnecovLabel;
 class VasnecovFigure;
+class VasnecovTerrain;
 
 class QSize;
 class QRect;
+class QRectF;
+class QPointF;
 
 namespace Vasnecov
 {
+    class ProductHierarchy;
+
     const GLsizei cfg_worldWidthMin = 16;
     const GLsizei cfg_worldHeightMin = 16;
     const GLsizei cfg_worldWidthMax = 4096;
     const GLsizei cfg_worldHeightMax = 4096;
+    const GLfloat cfg_pickTolerance = 3.0f; // Допуск выбора линий и точек, пикселей
+
+    // Результат выбора элемента по точке экрана
+    struct PickResult
+    {
+        GLuint type; // Из SpatialTypes, 0 - ничего не найдено
+        VasnecovElement* element;
+        QVector3D point; // Точка попадания в координатах мира
+        QVector3D normal; // Нормаль поверхности (для линий и точек - направление на камеру)
+        GLfloat distance; // От ближней плоскости отсечения
+
+        PickResult() : type(0), element(nullptr), point(), normal(), distance(0.0f) {}
+        GLboolean isValid() const {return element != nullptr;}
+
+        VasnecovProduct* product() const; // Деталь, nullptr для других типов
+        VasnecovProduct* assembly() const; // Корневой узел детали (сама деталь без родителя)
+        VasnecovFigure* figure() const;
+        VasnecovTerrain* terrain() const;
+    };
 }
 
 class VasnecovWorld : public Vasnecov::CoreObject
@@ -70,6 +100,23 @@ public:
     GLboolean light() const;
     void switchLight();
 
+    // Отсечение элементов вне пирамиды видимости (включено по умолчанию)
+    void setCulling();
+    void unsetCulling();
+    GLboolean culling() const;
+    GLuint culledAmount() const; // Отсечено в последнем кадре
+
+    // Способ отрисовки прозрачных элементов. Взвешенный режим без поддержки контекстом
+    // (нет нескольких целей отрисовки или шейдеров) заменяется сортировкой
+    void setTransparencyMode(Vasnecov::TransparencyModes mode);
+    Vasnecov::TransparencyModes transparencyMode() const;
+
+    // Вывод мира без изменений из снимка прошлого кадра (включено по умолчанию).
+    // Снимок делается, когда мир не менялся хотя бы кадр
+    void setCaching();
+    void unsetCaching();
+    GLboolean caching() const;
+
     GLboolean setPerspective(GLfloat angle, GLfloat frontBorder, GLfloat backBorder); // Задать характеристики перспективной проекции
     Vasnecov::Perspective perspective() const;
     Vasnecov::Ortho ortho() const;
@@ -108,6 +155,30 @@ public:
     Vasnecov::Line unprojectPointToLine(GLfloat x, GLfloat y);
     QVector2D projectVectorToPoint(const QVector3D& vector); // Vector from 3D to screen position
 
+    // Пространственные запросы по элементам мира (состояние на последний кадр).
+    // Читают данные рендера (дерево мира, матрицы), которые переписывает VasnecovUniverse::renderUpdateData.
+    // Поэтому запросы, pick и выбор рамкой вызываются только под блокировкой хоста, исключающей синхронизацию,
+    // на всё время запроса. Сама библиотека их не защищает.
+    // types - маска из Vasnecov::SpatialTypes
+    std::vector<VasnecovElement*> elementsInFrustum(GLuint types = Vasnecov::SpatialTypeAll) const; // Видимые камерой
+    std::vector<VasnecovElement*> elementsInBox(const Vasnecov::BoundingBox& box, GLuint types = Vasnecov::SpatialTypeAll) const;
+    std::vector<VasnecovElement*> elementsInSphere(const QVector3D& center, GLfloat radius, GLuint types = Vasnecov::SpatialTypeAll) const;
+    // Расстояния в долях длины отрезка
+    std::vector<Vasnecov::BoundingVolumeHierarchy::RayHit> elementsOnLine(const Vasnecov::Line& line, GLuint types = Vasnecov::SpatialTypeAll) const;
+    const Vasnecov::BoundingVolumeHierarchy& spatialIndex() const;
+
+    // Ближайший элемент под точкой окна (координаты как в unprojectPointToLine). Проверяются треугольники
+    // деталей, рельефов и залитых фигур, линии и точки фигур - с допуском cfg_pickTolerance
+    Vasnecov::PickResult pick(GLfloat x, GLfloat y,
+                              GLuint types = Vasnecov::SpatialTypeProduct | Vasnecov::SpatialTypeFigure | Vasnecov::SpatialTypeTerrain);
+    Vasnecov::PickResult pick(const QPointF& point,
+                              GLuint types = Vasnecov::SpatialTypeProduct | Vasnecov::SpatialTypeFigure | Vasnecov::SpatialTypeTerrain);
+
+    // Выбор деталей рамкой или контуром в координатах окна. Деталь выбирается, если прямоугольник проекции
+    // её бокса пересекает область (contained - лежит целиком внутри). collapse - вместо деталей их корневые узлы
+    std::vector<VasnecovProduct*> selectInRect(const QRectF& rect, GLboolean contained = false, GLboolean collapse = false);
+    std::vector<VasnecovProduct*> selectInPolygon(const std::vector<QPointF>& points, GLboolean contained = false, GLboolean collapse = false);
+
 protected:
     // Списки содержимого
     template<typename T>
@@ -119,13 +190,33 @@ protected:
 
     template<typename T>
     GLboolean designerRemoveElement(T* element);
+    const WorldElementList& designerElements() const;
 
     void designerUpdateOrtho();
 
+    // Отбор деталей по дереву пирамидой области area и проверка test прямоугольников проекций
+    template <typename F>
+    std::vector<VasnecovProduct*> designerSelect(const QRectF& area, F test, GLboolean contained, GLboolean collapse) const;
+
 protected:
     // Вызовы из рендерера
     GLenum renderUpdateData();
+    void renderUpdateSpatialIndex(const std::vector<VasnecovElement*>& changed); // После обновления всех элементов
+    void renderOrderProducts(const Vasnecov::ProductHierarchy& hierarchy); // После синхронизации списков
     void renderDraw();
+    // Отрисовка или вывод снимка, если мир не повреждён. Возвращает, был ли мир повреждён
+    GLboolean renderDrawCached();
+
+    // Повреждение - изменение того, что видно в окне мира
+    void renderDamage();
+    GLboolean renderIsDamaged() const;
+    QRect renderWindow() const;
+    // Содержит ли мир элемент. Списки мира к этому моменту синхронизированы
+    template <typename T>
+    GLboolean renderContains(T* element) const
+    {
+        return _elements.findRawElement(element) != nullptr;
+    }
 
     void renderSwitchLamps() const;
     VasnecovPipeline::CameraAttributes renderCalculateCamera() const;
@@ -135,6 +226,17 @@ protected:
     const Vasnecov::Ortho& renderOrtho() const;
     const Vasnecov::Camera& renderCamera() const;
 
+    template <typename T>
+    static void renderCollectElements(const std::vector<T*>& elements, GLuint type,
+                                      std::vector<std::pair<VasnecovElement*, GLuint>>& result)
+    {
+        for(auto element : elements)
+        {
+            if(element)
+                result.push_back(std::make_pair(element, type));
+        }
+    }
+
     template <typename T>
     static void renderDrawElement(T* element)
     {
@@ -150,10 +252,29 @@ private:
     Vasnecov::MutualData<Vasnecov::Ortho>           _ortho; // Характеристики вида при ортогональной проекции
     Vasnecov::MutualData<Vasnecov::Camera>          _camera; // камера мира
     Vasnecov::MutualData<QMatrix4x4>                _projectionMatrix;
+    QString                                         _pureName; // Имя для профилировщика рендера
+    const char*                                     _traceName; // То же для трассировки (Tracer::intern)
+    Vasnecov::Frustum                               _frustum;
+    std::atomic<GLuint>                             _culledAmount;
 
     Vasnecov::LightModel                            _lightModel;
     WorldElementList                                _elements;
 
+    Vasnecov::BoundingVolumeHierarchy               _spatialIndex;
+    std::unordered_set<VasnecovElement*>            _spatialAttached; // С чужой матрицей, обновляются каждый кадр
+    GLboolean                                       _spatialMembershipChanged;
+
+    std::vector<VasnecovProduct*>                   _orderedProducts; // Изделия мира в порядке обхода дерева
+    GLuint                                          _orderedVersion; // Версия дерева при упорядочивании
+    GLboolean                                       _orderOutdated; // Изменился состав изделий
+
+    Vasnecov::TransparencyOrder                     _transProductsOrder;
+    Vasnecov::TransparencyOrder                     _transFiguresOrder;
+    GLboolean                                       _transMoved; // Элементы мира двигались после прошлой сортировки
+
+    GLboolean                                       _damaged; // Изменилось видимое с прошлого кадра
+    Vasnecov::WorldCache                            _cache;
+
     friend class VasnecovUniverse;
 
     enum Updated
@@ -183,13 +304,35 @@ T* VasnecovWorld::designerFindElement(T* element) const
 template<typename T>
 GLboolean VasnecovWorld::designerAddElement(T* element, GLboolean check)
 {
-    return _elements.addElement(element, check);
+    if(!_elements.addElement(element, check))
+        return false;
+
+    updaterEnqueue(); // Списки синхронизируются в renderUpdateData
+    return true;
 }
 
 template<typename T>
 GLboolean VasnecovWorld::designerRemoveElement(T* element)
 {
-    return _elements.removeElement(element);
+    if(!_elements.removeElement(element))
+        return false;
+
+    updaterEnqueue();
+    return true;
+}
+
+inline const VasnecovWorld::WorldElementList& VasnecovWorld::designerElements() const
+{
+    return _elements;
+}
+
+inline void VasnecovWorld::renderDamage()
+{
+    _damaged = true;
+}
+inline GLboolean VasnecovWorld::renderIsDamaged() const
+{
+    return _damaged;
 }
 
 inline void VasnecovWorld::renderSwitchLamps() const
@@ -223,3 +366,8 @@ inline const Vasnecov::Camera& VasnecovWorld::renderCamera() const
 {
     return _camera.pure();
 }
+
+inline const Vasnecov::BoundingVolumeHierarchy& VasnecovWorld::spatialIndex() const
+{
+    return _spatialIndex;
+}
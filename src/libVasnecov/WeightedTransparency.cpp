@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "WeightedTransparency.h"
+#include <algorithm>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QVector2D>
+#include "Technologist.h"
+
+namespace
+{
+    // Цвет с освещением фиксированного конвейера. Вес убывает с глубиной и растёт с непрозрачностью
+    const char* const accumulationSource =
+        "#version 110\n"
+        "uniform sampler2D texture0;\n"
+        "uniform bool textured;\n"
+        "void main()\n"
+        "{\n"
+        "    vec4 color = gl_Color;\n"
+        "    if(textured)\n"
+        "        color *= texture2D(texture0, gl_TexCoord[0].st);\n"
+        "    color.rgb += gl_SecondaryColor.rgb;\n"
+        "    float weight = clamp(pow(min(1.0, color.a * 10.0) + 0.01, 3.0) * 1.0e8 *\n"
+        "                         pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1.0e-2, 3.0e3);\n"
+        "    gl_FragData[0] = vec4(color.rgb * color.a * weight, color.a);\n"
+        "    gl_FragData[1] = vec4(color.a * weight);\n"
+        "}\n";
+
+    // Средний цвет и итоговое пропускание. Смешивание: сцена * пропускание + цвет * (1 - пропускание)
+    const char* const compositionSource =
+        "#version 110\n"
+        "uniform sampler2D accumulation;\n"
+        "uniform sampler2D weights;\n"
+        "uniform vec2 scale;\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 position = gl_FragCoord.xy * scale;\n"
+        "    vec4 sum = texture2D(accumulation, position);\n"
+        "    if(sum.a >= 1.0)\n"
+        "        discard;\n"
+        "    float weight = texture2D(weights, position).r;\n"
+        "    gl_FragColor = vec4(sum.rgb / clamp(weight, 1.0e-4, 5.0e4), sum.a);\n"
+        "}\n";
+
+    const GLfloat quad[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+}
+
+Vasnecov::WeightedTransparency::WeightedTransparency() :
+    m_accumulation(),
+    m_composition(),
+    m_targets(),
+    m_texturedLocation(-1),
+    m_scaleLocation(-1),
+    m_previous(0),
+    m_clearColor(),
+    m_initialized(false),
+    m_supported(true),
+    m_active(false)
+{}
+
+Vasnecov::WeightedTransparency::~WeightedTransparency()
+{
+}
+
+GLboolean Vasnecov::WeightedTransparency::renderBegin(GLint x, GLint y, GLsizei width, GLsizei height, GLboolean textured)
+{
+    if(!m_supported || m_active || width <= 0 || height <= 0)
+        return false;
+    if(!m_initialized && !renderInitialize())
+        return false;
+
+    // Цели совпадают с буфером кадра по координатам, иначе копирование глубины из
+    // мультисэмплового буфера невозможно
+    if(!m_targets || m_targets->width() < x + width || m_targets->height() < y + height)
+    {
+        GLsizei targetWidth(x + width);
+        GLsizei targetHeight(y + height);
+        if(m_targets)
+        {
+            targetWidth = std::max(targetWidth, m_targets->width());
+            targetHeight = std::max(targetHeight, m_targets->height());
+        }
+        if(!renderAllocate(targetWidth, targetHeight))
+        {
+            renderFail("Can't create render targets for weighted transparency");
+            return false;
+        }
+    }
+
+    QOpenGLExtraFunctions* functions(QOpenGLContext::currentContext()->extraFunctions());
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_previous);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, m_clearColor);
+
+    // Глубина непрозрачной сцены. Форматы глубины могут не совпасть, это выясняется только здесь
+    for(GLuint i = 0; i < 8 && glGetError() != GL_NO_ERROR; ++i)
+    {}
+    functions->glBindFramebuffer(GL_READ_FRAMEBUFFER, m_previous);
+    functions->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_targets->handle());
+    functions->glBlitFramebuffer(x, y, x + width, y + height,
+                                 x, y, x + width, y + height,
+                                 GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    if(glGetError() != GL_NO_ERROR)
+    {
+        functions->glBindFramebuffer(GL_FRAMEBUFFER, m_previous);
+        renderFail("Can't copy depth buffer for weighted transparency");
+        return false;
+    }
+
+    functions->glBindFramebuffer(GL_FRAMEBUFFER, m_targets->handle());
+    static const GLenum buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    functions->glDrawBuffers(2, buffers);
+
+    // Сумма цветов и весов - 0, пропускание - 1
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    functions->glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+
+    m_accumulation->bind();
+    m_accumulation->setUniformValue(m_texturedLocation, static_cast<GLint>(textured));
+    m_active = true;
+    return true;
+}
+
+void Vasnecov::WeightedTransparency::renderSetTextured(GLboolean textured)
+{
+    if(m_active)
+        m_accumulation->setUniformValue(m_texturedLocation, static_cast<GLint>(textured));
+}
+
+void Vasnecov::WeightedTransparency::renderEnd()
+{
+    if(!m_active)
+        return;
+    m_active = false;
+
+    QOpenGLFunctions* functions(QOpenGLContext::currentContext()->functions());
+
+    m_accumulation->release();
+    glDepthMask(GL_TRUE);
+    functions->glBindFramebuffer(GL_FRAMEBUFFER, m_previous);
+    glClearColor(m_clearColor[0], m_clearColor[1], m_clearColor[2], m_clearColor[3]);
+
+    // Наложение на сцену в пределах окна мира (его задаёт текущая область вывода)
+    const auto textures(m_targets->textures());
+    functions->glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, textures[1]);
+    functions->glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textures[0]);
+
+    glDisable(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    functions->glBlendFuncSeparate(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ZERO, GL_ONE);
+
+    m_composition->bind();
+    m_composition->setUniformValue(m_scaleLocation, QVector2D(1.0f / m_targets->width(), 1.0f / m_targets->height()));
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, quad);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    m_composition->release();
+
+    functions->glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    functions->glActiveTexture(GL_TEXTURE0);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+GLboolean Vasnecov::WeightedTransparency::renderInitialize()
+{
+    m_initialized = true;
+
+    // Несколько целей отрисовки, текстуры с плавающей точкой и копирование между буферами кадра
+    QOpenGLContext* context(QOpenGLContext::currentContext());
+    if(!context || context->isOpenGLES())
+    {
+        renderFail("Weighted transparency needs desktop OpenGL context");
+        return false;
+    }
+
+    GLboolean capable(context->format().majorVersion() >= 3 ||
+                      (context->hasExtension("GL_ARB_framebuffer_object") &&
+                       context->hasExtension("GL_ARB_texture_float")));
+    if(capable)
+    {
+        GLint drawBuffers(0);
+        glGetIntegerv(GL_MAX_DRAW_BUFFERS, &drawBuffers);
+        capable = drawBuffers >= 2;
+    }
+    if(!capable ||
+       !QOpenGLShaderProgram::hasOpenGLShaderPrograms(context) ||
+       !QOpenGLFramebufferObject::hasOpenGLFramebufferObjects() ||
+       !QOpenGLFramebufferObject::hasOpenGLFramebufferBlit())
+    {
+        renderFail("Weighted transparency isn't supported by the context");
+        return false;
+    }
+
+    m_accumulation.reset(new QOpenGLShaderProgram());
+    m_composition.reset(new QOpenGLShaderProgram());
+    if(!m_accumulation->addShaderFromSourceCode(QOpenGLShader::Fragment, accumulationSource) ||
+       !m_accumulation->link())
+    {
+        renderFail("Can't build weighted transparency accumulation shader: " + m_accumulation->log());
+        return false;
+    }
+    if(!m_composition->addShaderFromSourceCode(QOpenGLShader::Fragment, compositionSource) ||
+       !m_composition->link())
+    {
+        renderFail("Can't build weighted transparency composition shader: " + m_composition->log());
+        return false;
+    }
+
+    m_texturedLocation = m_accumulation->uniformLocation("textured");
+    m_scaleLocation = m_composition->uniformLocation("scale");
+
+    m_accumulation->bind();
+    m_accumulation->setUniformValue("texture0", static_cast<GLint>(0));
+    m_accumulation->release();
+
+    m_composition->bind();
+    m_composition->setUniformValue("accumulation", static_cast<GLint>(0));
+    m_composition->setUniformValue("weights", static_cast<GLint>(1));
+    m_composition->release();
+
+    return true;
+}
+
+GLboolean Vasnecov::WeightedTransparency::renderAllocate(GLsizei width, GLsizei height)
+{
+    const QSize size(width, height);
+
+    // Упакованные глубина и трафарет - как у буфера окна, иначе копирование глубины не пройдёт
+    QOpenGLFramebufferObjectFormat format;
+    format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    format.setInternalTextureFormat(GL_RGBA16F);
+
+    m_targets.reset(new QOpenGLFramebufferObject(size, format));
+    if(!m_targets->isValid())
+    {
+        m_targets.reset();
+        return false;
+    }
+    m_targets->addColorAttachment(size, GL_RGBA16F);
+    return true;
+}
+
+void Vasnecov::WeightedTransparency::renderFail(const QString& message)
+{
+    Vasnecov::problem(message, "sorting is used instead");
+    m_supported = false;
+    m_accumulation.reset();
+    m_composition.reset();
+    m_targets.reset();
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Прозрачность без сортировки: взвешенное смешивание (weighted blended OIT, McGuire & Bavoil)
+#pragma once
+
+#include <memory>
+#include "Types.h"
+
+class QOpenGLFramebufferObject;
+class QOpenGLShaderProgram;
+
+namespace Vasnecov
+{
+    // Прозрачные элементы рисуются в любом порядке в две цели: взвешенную сумму цветов
+    // (с произведением пропусканий в альфе) и сумму весов. Затем результат одним проходом
+    // накладывается на сцену. Глубина непрозрачной сцены копируется в свой буфер, поэтому
+    // закрытое непрозрачным отбрасывается. Вершины обрабатываются фиксированным конвейером,
+    // шейдер только фрагментный.
+    class WeightedTransparency
+    {
+    public:
+        WeightedTransparency();
+        ~WeightedTransparency();
+
+        GLboolean isSupported() const; // false после неудачной проверки контекста
+        GLboolean isActive() const; // Идёт накопление
+
+        // Вызываются конвейером. Область - окно мира в координатах текущего буфера кадра.
+        // false - режим недоступен, прозрачное рисуется сортировкой
+        GLboolean renderBegin(GLint x, GLint y, GLsizei width, GLsizei height, GLboolean textured);
+        void renderSetTextured(GLboolean textured);
+        // Наложение на сцену. Состояние конвейера (текстура, тест глубины, режим полигонов) восстанавливает вызывающий
+        void renderEnd();
+
+    private:
+        GLboolean renderInitialize();
+        GLboolean renderAllocate(GLsizei width, GLsizei height);
+        void renderFail(const QString& message);
+
+    private:
+        std::unique_ptr<QOpenGLShaderProgram> m_accumulation;
+        std::unique_ptr<QOpenGLShaderProgram> m_composition;
+        std::unique_ptr<QOpenGLFramebufferObject> m_targets; // Размер не меньше окна мира, только растёт
+        GLint m_texturedLocation;
+        GLint m_scaleLocation;
+
+        GLint m_previous; // Буфер кадра, в который шла отрисовка
+        GLfloat m_clearColor[4];
+        GLboolean m_initialized;
+        GLboolean m_supported;
+        GLboolean m_active;
+
+        Q_DISABLE_COPY(WeightedTransparency)
+    };
+
+    inline GLboolean WeightedTransparency::isSupported() const
+    {
+        return m_supported;
+    }
+    inline GLboolean WeightedTransparency::isActive() const
+    {
+        return m_active;
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "WorldCache.h"
+#include <algorithm>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include "Technologist.h"
+#include "VasnecovPipeline.h"
+
+Vasnecov::WorldCache::WorldCache() :
+    m_target(),
+    m_x(0),
+    m_y(0),
+    m_width(0),
+    m_height(0),
+    m_valid(false),
+    m_supported(true),
+    m_indices({0, 1, 2, 3}),
+    m_vertices({QVector3D(-1.0f, -1.0f, 0.0f), QVector3D(1.0f, -1.0f, 0.0f),
+                QVector3D(-1.0f, 1.0f, 0.0f), QVector3D(1.0f, 1.0f, 0.0f)}),
+    m_textures(4)
+{}
+
+Vasnecov::WorldCache::~WorldCache()
+{
+}
+
+void Vasnecov::WorldCache::renderRelease(VasnecovPipeline* pipeline)
+{
+    if(m_target)
+    {
+        // Удаление привязанной текстуры сбрасывает привязку
+        pipeline->forgetTexture2D(m_target->texture());
+        m_target.reset();
+    }
+    m_valid = false;
+}
+
+GLboolean Vasnecov::WorldCache::renderStore(VasnecovPipeline* pipeline, GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    m_valid = false;
+    if(!m_supported || width <= 0 || height <= 0)
+        return false;
+
+    QOpenGLContext* context(QOpenGLContext::currentContext());
+    if(!context || !QOpenGLFramebufferObject::hasOpenGLFramebufferBlit())
+    {
+        Vasnecov::problem("World caching isn't supported by the context");
+        m_supported = false;
+        return false;
+    }
+
+    if(!m_target || m_target->width() < x + width || m_target->height() < y + height)
+    {
+        GLsizei targetWidth(x + width);
+        GLsizei targetHeight(y + height);
+        if(m_target)
+        {
+            targetWidth = std::max(targetWidth, m_target->width());
+            targetHeight = std::max(targetHeight, m_target->height());
+        }
+        if(!renderAllocate(pipeline, targetWidth, targetHeight))
+        {
+            Vasnecov::problem("Can't create render target for world caching");
+            m_supported = false;
+            return false;
+        }
+    }
+
+    QOpenGLExtraFunctions* functions(context->extraFunctions());
+    GLint previous(0);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+
+    for(GLuint i = 0; i < 8 && glGetError() != GL_NO_ERROR; ++i)
+    {}
+    functions->glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+    functions->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_target->handle());
+    functions->glBlitFramebuffer(x, y, x + width, y + height,
+                                 x, y, x + width, y + height,
+                                 GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    const GLenum error(glGetError());
+    functions->glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+    if(error != GL_NO_ERROR)
+    {
+        Vasnecov::problem("Can't copy world image for caching: ", static_cast<GLint>(error));
+        renderRelease(pipeline);
+        m_supported = false;
+        return false;
+    }
+
+    m_x = x;
+    m_y = y;
+    m_width = width;
+    m_height = height;
+
+    const GLfloat left(static_cast<GLfloat>(x) / m_target->width());
+    const GLfloat right(static_cast<GLfloat>(x + width) / m_target->width());
+    const GLfloat bottom(static_cast<GLfloat>(y) / m_target->height());
+    const GLfloat top(static_cast<GLfloat>(y + height) / m_target->height());
+    m_textures[0] = QVector2D(left, bottom);
+    m_textures[1] = QVector2D(right, bottom);
+    m_textures[2] = QVector2D(left, top);
+    m_textures[3] = QVector2D(right, top);
+
+    m_valid = true;
+    return true;
+}
+
+void Vasnecov::WorldCache::renderRestore(VasnecovPipeline* pipeline)
+{
+    if(!m_valid)
+        return;
+
+    pipeline->setViewport(m_x, m_y, m_width, m_height);
+    pipeline->setIdentityMatrixP();
+    pipeline->setIdentityMatrixMV();
+    pipeline->disableLamps();
+    pipeline->disableDepth();
+    pipeline->disableBlending();
+    pipeline->setDrawingType(Vasnecov::PolygonDrawingTypeNormal);
+    pipeline->enableTexture2D(m_target->texture());
+
+    // Цвет и прозрачность берутся из снимка как есть
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    pipeline->drawElements(VasnecovPipeline::StripTriangle, &m_indices, &m_vertices, nullptr, &m_textures);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+    pipeline->disableTexture2D();
+    pipeline->enableBlending();
+}
+
+GLboolean Vasnecov::WorldCache::renderAllocate(VasnecovPipeline* pipeline, GLsizei width, GLsizei height)
+{
+    renderRelease(pipeline);
+
+    // Текстура буфера создаётся через привязку
+    m_target.reset(new QOpenGLFramebufferObject(QSize(width, height)));
+    if(!m_target->isValid())
+        m_target.reset();
+    pipeline->restoreTexture2D();
+
+    return m_target != nullptr;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2017 ACSL MIPT.
+ * See the COPYRIGHT file at the top-level directory.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Снимок окна мира для вывода без перерисовки
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QVector2D>
+#include <QVector3D>
+#include "Types.h"
+
+class QOpenGLFramebufferObject;
+class VasnecovPipeline;
+
+namespace Vasnecov
+{
+    // Цвет окна мира копируется в текстуру после отрисовки и выводится вместо следующей.
+    // Глубина не хранится: каждый мир начинается с очистки буфера глубины.
+    // Текстура покрывает буфер кадра от начала координат до окна мира, т.к. из мультисэмплового
+    // буфера копируется только область с теми же координатами
+    class WorldCache
+    {
+    public:
+        WorldCache();
+        ~WorldCache();
+
+        GLboolean isValid(GLint x, GLint y, GLsizei width, GLsizei height) const; // Есть снимок этой области
+        void invalidate();
+        // Освобождение ресурсов (например, при смене контекста). Конвейеру сообщается об удалении текстуры
+        void renderRelease(VasnecovPipeline* pipeline);
+
+        // Снимок области текущего буфера кадра. false - копирование не поддерживается.
+        // Создание буфера меняет привязку текстуры, после него привязка конвейера восстанавливается
+        GLboolean renderStore(VasnecovPipeline* pipeline, GLint x, GLint y, GLsizei width, GLsizei height);
+        // Вывод снимка. Меняет область вывода, матрицы, освещение, тест глубины и текстуру конвейера
+        void renderRestore(VasnecovPipeline* pipeline);
+
+    private:
+        GLboolean renderAllocate(VasnecovPipeline* pipeline, GLsizei width, GLsizei height);
+
+    private:
+        std::unique_ptr<QOpenGLFramebufferObject> m_target;
+        GLint m_x, m_y;
+        GLsizei m_width, m_height;
+        GLboolean m_valid;
+        GLboolean m_supported;
+
+        // Прямоугольник на всю область вывода
+        std::vector<GLuint> m_indices;
+        std::vector<QVector3D> m_vertices;
+        std::vector<QVector2D> m_textures;
+
+        Q_DISABLE_COPY(WorldCache)
+    };
+
+    inline GLboolean WorldCache::isValid(GLint x, GLint y, GLsizei width, GLsizei height) const
+    {
+        return m_valid && m_x == x && m_y == y && m_width == width && m_height == height;
+    }
+    inline void WorldCache::invalidate()
+    {
+        m_valid = false;
+    }
+}
@@ -0,0 +1,214 @@
+#include "SceneGenerator.h"
+#include <cmath>
+#include <random>
+#include <QImage>
+#include <QColor>
+
+#include <VasnecovUniverse>
+#include <VasnecovFigure>
+#include <VasnecovLabel>
+#include <VasnecovLamp>
+#include <VasnecovProduct>
+#include <VasnecovTerrain>
+
+SceneGenerator::SceneGenerator(VasnecovUniverse* universe) :
+    m_universe(universe),
+    m_world(nullptr),
+    m_bombers(),
+    m_propellers(),
+    m_productsAmount(0),
+    m_poseElements(),
+    m_positions(),
+    m_orientations()
+{}
+
+bool SceneGenerator::create(const SceneParameters& parameters)
+{
+    if(!m_universe)
+        return false;
+
+    m_world = m_universe->addWorld(0, 0, 1024, 768);
+    if(!m_world)
+        return false;
+
+    std::mt19937 random(parameters.seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // Сборки раскладываются квадратом с шагом в 1 м
+    const int side = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<float>(parameters.products)))));
+    const float half = side * 0.5f;
+
+    m_world->setName("Benchmark");
+    m_world->setPerspective(45.0f, 0.1f, 1000.0f);
+    m_world->setCameraPosition(half * 1.2f + 1.0f, half * 1.2f + 1.0f, half + 1.0f);
+    m_world->setCameraTarget(0.0f, 0.0f, 0.0f);
+
+    VasnecovLamp* sun = m_universe->addLamp("Sun", m_world);
+    if(sun)
+        sun->setCelestialDirection(0.0f, 0.4f, 1.0f);
+
+    for(int i = 0; i < parameters.products; ++i)
+        addBomber(i, (i % side) - half, (i / side) - half);
+
+    for(int i = 0; i < parameters.figures; ++i)
+    {
+        VasnecovFigure* figure = m_universe->addFigure("", m_world);
+        if(!figure)
+            continue;
+
+        std::vector<QVector3D> points;
+        points.reserve(parameters.figurePoints);
+        const float radius = 0.1f + unit(random) * 0.3f;
+        for(int p = 0; p < parameters.figurePoints; ++p)
+        {
+            float angle = 2.0f * M_PI * p / parameters.figurePoints;
+            points.push_back(QVector3D(radius * std::cos(angle), radius * std::sin(angle), 0.05f * std::sin(4.0f * angle)));
+        }
+
+        figure->setType(VasnecovFigure::TypePolylineLoop);
+        figure->setColor(QColor::fromRgbF(unit(random), unit(random), unit(random)));
+        figure->setPoints(points);
+        figure->setCoordinates((unit(random) - 0.5f) * side, (unit(random) - 0.5f) * side, unit(random));
+    }
+
+    if(parameters.terrainSize > 1)
+    {
+        VasnecovTerrain* terrain = m_universe->addTerrain("Terrain", m_world);
+        if(terrain)
+        {
+            const int size = parameters.terrainSize;
+            const float step = (side + 2.0f) / (size - 1);
+
+            std::vector<QVector3D> points;
+            std::vector<QVector3D> colors;
+            points.reserve(size * size);
+            colors.reserve(size * size);
+            for(int y = 0; y < size; ++y)
+            {
+                for(int x = 0; x < size; ++x)
+                {
+                    float h = 0.1f * std::sin(x * 0.3f) * std::cos(y * 0.2f) - 0.2f;
+                    points.push_back(QVector3D(x * step - half - 1.0f, y * step - half - 1.0f, h));
+                    colors.push_back(QVector3D(0.3f, 0.5f + h, 0.3f));
+                }
+            }
+
+            terrain->setType(VasnecovTerrain::TypeSurface);
+            terrain->setPoints(std::move(points), std::move(colors));
+        }
+    }
+
+    QImage labelImage(32, 16, QImage::Format_ARGB32);
+    labelImage.fill(QColor(255, 255, 255, 200));
+    for(int i = 0; i < parameters.labels; ++i)
+    {
+        VasnecovLabel* label = m_universe->addLabel(QString("Label %1").arg(i), m_world, 32, 16);
+        if(!label)
+            continue;
+
+        label->setImage(labelImage);
+        label->setCoordinates((unit(random) - 0.5f) * side, (unit(random) - 0.5f) * side, 0.5f);
+    }
+
+    return true;
+}
+
+void SceneGenerator::animate(int frame, bool bulk)
+{
+    if(bulk)
+    {
+        m_poseElements.clear();
+        m_positions.clear();
+        m_orientations.clear();
+
+        for(size_t i = 0; i < m_propellers.size(); ++i)
+        {
+            m_poseElements.push_back(m_propellers[i]);
+            m_positions.push_back(m_propellers[i]->coordinates());
+            m_orientations.push_back(QQuaternion::fromAxisAndAngle(0.0f, 0.0f, 1.0f, frame * ((i % 2) ? 10.0f : -10.0f)));
+        }
+
+        const float shift = 0.05f * std::sin(frame * 0.1f);
+        for(auto bomber : m_bombers)
+        {
+            QVector3D position = bomber->coordinates();
+            position.setZ(0.5f + shift);
+            m_poseElements.push_back(bomber);
+            m_positions.push_back(position);
+            m_orientations.push_back(QQuaternion());
+        }
+
+        m_universe->setPoses(m_poseElements.data(), m_positions.data(), m_orientations.data(),
+                             static_cast<GLuint>(m_poseElements.size()));
+        return;
+    }
+
+    for(size_t i = 0; i < m_propellers.size(); ++i)
+        m_propellers[i]->incrementAngles(QVector3D(0.0f, 0.0f, (i % 2) ? 10.0f : -10.0f));
+
+    const float shift = 0.05f * std::sin(frame * 0.1f);
+    for(auto bomber : m_bombers)
+    {
+        QVector3D position = bomber->coordinates();
+        position.setZ(0.5f + shift);
+        bomber->setCoordinates(position);
+    }
+}
+
+VasnecovProduct* SceneGenerator::addBomber(int index, float x, float y)
+{
+    VasnecovProduct* bomber = m_universe->addAssembly(QString("Bomber %1").arg(index), m_world);
+    if(!bomber)
+        return nullptr;
+
+    ++m_productsAmount;
+    m_bombers.push_back(bomber);
+
+    struct Part
+    {
+        const char* mesh;
+        QColor color;
+    };
+    const Part parts[] =
+    {
+        {"bomber_beams", QColor(50, 50, 60)},
+        {"bomber_body", QColor(190, 190, 190)},
+        {"bomber_hat", QColor(255, 255, 0)},
+        {"bomber_battery", QColor(0, 0, 255)}
+    };
+    for(const auto& part : parts)
+    {
+        VasnecovProduct* product = m_universe->addPart(part.mesh, m_world, part.mesh, bomber);
+        if(product)
+        {
+            product->setColor(part.color);
+            ++m_productsAmount;
+        }
+    }
+
+    for(int i = 0; i < 4; ++i)
+    {
+        float xS = (i % 2) ? -1.0f : 1.0f;
+        float yS = (i > 1) ? -1.0f : 1.0f;
+
+        VasnecovProduct* propeller = m_universe->addPart("Propeller", m_world, "bomber_propeller", bomber);
+        if(propeller)
+        {
+            propeller->setColor(QColor(0, 155, 155));
+            propeller->setCoordinates(QVector3D(0.135f * xS, 0.135f * yS, 0.04f));
+            m_propellers.push_back(propeller);
+            ++m_productsAmount;
+        }
+
+        VasnecovProduct* motor = m_universe->addPart("Motor", m_world, "bomber_motor", bomber);
+        if(motor)
+        {
+            motor->setColor(QColor(30, 30, 30));
+            motor->setCoordinates(QVector3D(0.135f * xS, 0.135f * yS, 0.005f));
+            ++m_productsAmount;
+        }
+    }
+
+    bomber->setCoordinates(x, y, 0.5f);
+    return bomber;
+}
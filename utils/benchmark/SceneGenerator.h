@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <QQuaternion>
+#include <QString>
+#include <QVector3D>
+
+class VasnecovAbstractElement;
+class VasnecovUniverse;
+class VasnecovWorld;
+class VasnecovProduct;
+
+// Параметры синтетической сцены
+struct SceneParameters
+{
+    int products = 16; // Количество сборок-бомберов
+    int figures = 16;
+    int figurePoints = 64;
+    int terrainSize = 64; // Сторона квадратной сетки рельефа
+    int labels = 16;
+    unsigned seed = 1;
+};
+
+// Синтетическая сцена: сборки бомберов сеткой, фигуры, рельеф и метки
+class SceneGenerator
+{
+public:
+    explicit SceneGenerator(VasnecovUniverse* universe);
+
+    bool create(const SceneParameters& parameters);
+    // Изменение положений (имитация работы внешнего потока). bulk - одним вызовом setPoses
+    void animate(int frame, bool bulk = false);
+
+    VasnecovWorld* world() const {return m_world;}
+    size_t productsAmount() const {return m_productsAmount;}
+    const std::vector<VasnecovProduct*>& bombers() const {return m_bombers;}
+
+private:
+    VasnecovProduct* addBomber(int index, float x, float y);
+
+    VasnecovUniverse* m_universe;
+    VasnecovWorld* m_world;
+
+    std::vector<VasnecovProduct*> m_bombers;
+    std::vector<VasnecovProduct*> m_propellers;
+    size_t m_productsAmount;
+
+    std::vector<VasnecovAbstractElement*> m_poseElements;
+    std::vector<QVector3D> m_positions;
+    std::vector<QQuaternion> m_orientations;
+};
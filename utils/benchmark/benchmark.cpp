@@ -0,0 +1,632 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <VasnecovUniverse>
+#include <VasnecovFigure>
+#include <VasnecovLabel>
+#include <VasnecovLamp>
+#include <VasnecovOffscreenRenderer>
+#include <VasnecovProduct>
+#include <libVasnecov/Transform.h>
+#include "SceneGenerator.h"
+
+namespace
+{
+    QJsonObject percentiles(std::vector<double> values)
+    {
+        QJsonObject res;
+        if(values.empty())
+            return res;
+
+        std::sort(values.begin(), values.end());
+        auto rank = [&values](double p) -> double
+        {
+            size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+            return values[std::min(index, values.size() - 1)];
+        };
+
+        double sum(0.0);
+        for(double value : values)
+            sum += value;
+
+        res["mean"] = sum / values.size();
+        res["min"] = values.front();
+        res["p50"] = rank(0.50);
+        res["p90"] = rank(0.90);
+        res["p99"] = rank(0.99);
+        res["max"] = values.back();
+        return res;
+    }
+
+    // Память процесса из /proc (только Linux), кБ
+    QJsonObject memoryUsage()
+    {
+        QJsonObject res;
+        QFile status("/proc/self/status");
+        if(!status.open(QIODevice::ReadOnly | QIODevice::Text))
+            return res;
+
+        while(!status.atEnd())
+        {
+            QByteArray line = status.readLine();
+            if(line.startsWith("VmRSS:") || line.startsWith("VmHWM:"))
+            {
+                QList<QByteArray> parts = line.simplified().split(' ');
+                if(parts.size() >= 2)
+                    res[QString(parts[0]).remove(':')] = parts[1].toLongLong();
+            }
+        }
+        return res;
+    }
+
+    // Наибольшее отклонение элементов матрицы, отнесённое к их величине
+    double matrixError(const float* values, const QMatrix4x4& reference)
+    {
+        double error(0.0);
+        const float* expected(reference.constData());
+        for(int i = 0; i < 16; ++i)
+            error = std::max(error, std::fabs(values[i] - expected[i]) / (1.0 + std::fabs(expected[i])));
+        return error;
+    }
+
+    // Матрицы элементов (сдвиг * поворот Z-X-Y * масштаб, с родителем и без) через QMatrix4x4
+    // и через Vasnecov::composeTransform: отклонения и время на одну матрицу, нс
+    QJsonObject compareTransforms(int amount, bool& passed)
+    {
+        const double tolerance(1.0e-4);
+        const int rounds(std::max(1, 2000000 / amount));
+
+        std::vector<QVector3D> positions, angles;
+        std::vector<QQuaternion> orientations;
+        std::vector<float> scales;
+        std::vector<QMatrix4x4> parents;
+        for(int i = 0; i < amount; ++i)
+        {
+            const float phase(i * 0.618034f);
+            positions.push_back(QVector3D(std::sin(phase) * 1000.0f, std::cos(phase * 3.0f) * 1000.0f, phase));
+            angles.push_back(QVector3D(std::fmod(phase * 37.0f, 360.0f) - 180.0f,
+                                       std::fmod(phase * 53.0f, 360.0f) - 180.0f,
+                                       std::fmod(phase * 71.0f, 360.0f) - 180.0f));
+            orientations.push_back(QQuaternion::fromAxisAndAngle(0.0f, 0.0f, 1.0f, angles.back().z()) *
+                                   QQuaternion::fromAxisAndAngle(1.0f, 0.0f, 0.0f, angles.back().x()) *
+                                   QQuaternion::fromAxisAndAngle(0.0f, 1.0f, 0.0f, angles.back().y()));
+            scales.push_back(0.1f + std::fmod(phase, 10.0f));
+
+            QMatrix4x4 parent;
+            parent.translate(positions.back() * -0.5f);
+            parent.rotate(orientations.back().conjugated());
+            parent.scale(2.0f);
+            parents.push_back(parent);
+        }
+
+        double errorQuaternion(0.0), errorAngles(0.0), errorParent(0.0), errorMultiply(0.0);
+        for(int i = 0; i < amount; ++i)
+        {
+            const float scale(scales[i]);
+            QMatrix4x4 local;
+            local.translate(positions[i]);
+            local.rotate(orientations[i]);
+            local.scale(scale, scale, scale);
+            QMatrix4x4 child(parents[i]);
+            child.translate(positions[i]);
+            child.rotate(orientations[i]);
+            child.scale(scale, scale, scale);
+
+            float result[16];
+            Vasnecov::composeTransform(positions[i], orientations[i], scale, result);
+            errorQuaternion = std::max(errorQuaternion, matrixError(result, local));
+            Vasnecov::composeTransformFromAngles(positions[i], angles[i], scale, result);
+            errorAngles = std::max(errorAngles, matrixError(result, local));
+            Vasnecov::composeTransform(positions[i], orientations[i], scale, result, parents[i].constData());
+            errorParent = std::max(errorParent, matrixError(result, child));
+            Vasnecov::multiplyAffine(parents[i].constData(), local.constData(), result);
+            errorMultiply = std::max(errorMultiply, matrixError(result, parents[i] * local));
+        }
+
+        // Сумма элементов сдвига не даёт компилятору выбросить вычисления
+        QElapsedTimer timer;
+        double checksum(0.0);
+        auto measure = [&](const std::function<QMatrix4x4(int)>& build) -> double
+        {
+            timer.start();
+            for(int round = 0; round < rounds; ++round)
+            {
+                for(int i = 0; i < amount; ++i)
+                {
+                    const QMatrix4x4 matrix(build(i));
+                    checksum += matrix(0, 3) + matrix(1, 3) + matrix(2, 3);
+                }
+            }
+            return static_cast<double>(timer.nsecsElapsed()) / (static_cast<double>(rounds) * amount);
+        };
+
+        const double qtTime = measure([&](int i)
+        {
+            QMatrix4x4 matrix;
+            matrix.translate(positions[i]);
+            matrix.rotate(orientations[i]);
+            matrix.scale(scales[i], scales[i], scales[i]);
+            return matrix;
+        });
+        const double qtParentTime = measure([&](int i)
+        {
+            QMatrix4x4 matrix(parents[i]);
+            matrix.translate(positions[i]);
+            matrix.rotate(orientations[i]);
+            matrix.scale(scales[i], scales[i], scales[i]);
+            return matrix;
+        });
+        const double kernelTime = measure([&](int i)
+        {
+            return Vasnecov::transformMatrix(positions[i], orientations[i], scales[i]);
+        });
+        const double kernelAnglesTime = measure([&](int i)
+        {
+            QMatrix4x4 matrix;
+            Vasnecov::composeTransformFromAngles(positions[i], angles[i], scales[i], matrix.data());
+            return matrix;
+        });
+        const double kernelParentTime = measure([&](int i)
+        {
+            return Vasnecov::transformMatrix(parents[i], positions[i], orientations[i], scales[i]);
+        });
+
+        passed = errorQuaternion <= tolerance && errorAngles <= tolerance &&
+                 errorParent <= tolerance && errorMultiply <= tolerance;
+
+        QJsonObject errors;
+        errors["quaternion"] = errorQuaternion;
+        errors["angles"] = errorAngles;
+        errors["parent"] = errorParent;
+        errors["multiply"] = errorMultiply;
+
+        QJsonObject times;
+        times["qt"] = qtTime;
+        times["qtParent"] = qtParentTime;
+        times["kernel"] = kernelTime;
+        times["kernelAngles"] = kernelAnglesTime;
+        times["kernelParent"] = kernelParentTime;
+
+        QJsonObject res;
+        res["amount"] = amount;
+        res["tolerance"] = tolerance;
+        res["passed"] = passed;
+        res["errors"] = errors;
+        res["timePerMatrix"] = times;
+        res["speedup"] = qtTime / kernelTime;
+        res["speedupParent"] = qtParentTime / kernelParentTime;
+        res["checksum"] = checksum;
+        return res;
+    }
+
+    // Отрисовка до состояния, в котором needsRedraw() даёт false. Число кадров, -1 - не устоялось
+    int settle(VasnecovUniverse& universe, VasnecovOffscreenRenderer& renderer)
+    {
+        const int limit(16);
+        for(int frame = 0; frame < limit; ++frame)
+        {
+            if(!universe.needsRedraw())
+                return frame;
+            renderer.renderFrame();
+            renderer.finish();
+        }
+        return universe.needsRedraw() ? -1 : limit;
+    }
+
+    // Перемещения изделий (сдвиг, поворот, setPoses, в пакете и без, корневое и вложенное)
+    // после устоявшегося кадра должны требовать перерисовки
+    QJsonObject checkRedraw(VasnecovUniverse& universe, VasnecovOffscreenRenderer& renderer, bool& passed)
+    {
+        passed = false;
+        QJsonObject res;
+
+        VasnecovWorld* world(universe.addWorld(0, 0, renderer.size().width(), renderer.size().height()));
+        VasnecovProduct* root(universe.addAssembly("root", world));
+        VasnecovProduct* child(universe.addAssembly("child", world, root));
+        if(!world || !root || !child)
+        {
+            res["error"] = QString("Can't create scene");
+            return res;
+        }
+
+        const std::vector<std::pair<QString, std::function<void(int)>>> moves =
+        {
+            {"rootCoordinates", [&](int step) { root->setCoordinates(QVector3D(step, 0.0f, 0.0f)); }},
+            {"childCoordinates", [&](int step) { child->setCoordinates(QVector3D(0.0f, step, 0.0f)); }},
+            {"childAngles", [&](int step) { child->setAngles(QVector3D(0.0f, 0.0f, step * 10.0f)); }},
+            {"batchCoordinates", [&](int step)
+                {
+                    universe.beginBatch();
+                    child->setCoordinates(QVector3D(0.0f, 0.0f, step));
+                    universe.commit();
+                }},
+            {"rootPoses", [&](int step)
+                {
+                    VasnecovAbstractElement* element(root);
+                    const QVector3D position(step, step, 0.0f);
+                    const QQuaternion orientation(QQuaternion::fromAxisAndAngle(0.0f, 0.0f, 1.0f, step * 10.0f));
+                    universe.setPoses(&element, &position, &orientation, 1);
+                }},
+            {"childPoses", [&](int step)
+                {
+                    VasnecovAbstractElement* element(child);
+                    const QVector3D position(0.0f, step, step);
+                    const QQuaternion orientation(QQuaternion::fromAxisAndAngle(1.0f, 0.0f, 0.0f, step * 10.0f));
+                    universe.setPoses(&element, &position, &orientation, 1);
+                }},
+        };
+
+        bool failed(settle(universe, renderer) < 0);
+        int step(1);
+        QJsonObject results;
+        for(const auto& move : moves)
+        {
+            move.second(step++);
+            const bool redraw(universe.needsRedraw());
+            const int frames(settle(universe, renderer));
+            QJsonObject result;
+            result["needsRedraw"] = redraw;
+            result["settleFrames"] = frames;
+            results[move.first] = result;
+            failed = failed || !redraw || frames < 0;
+        }
+
+        passed = !failed;
+        res["passed"] = passed;
+        res["moves"] = results;
+        return res;
+    }
+
+    bool writeReport(const QJsonObject& report, const QString& fileName)
+    {
+        QByteArray json = QJsonDocument(report).toJson();
+        if(!fileName.isEmpty())
+        {
+            QFile file(fileName);
+            if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            {
+                qCritical("Can't write %s", qPrintable(fileName));
+                return false;
+            }
+            file.write(json);
+        }
+        else
+        {
+            fwrite(json.constData(), 1, json.size(), stdout);
+        }
+        return true;
+    }
+
+    // Размеры объектов элементов (без сетки, точек, текстур), байт
+    QJsonObject elementBytes()
+    {
+        QJsonObject res;
+        res["product"] = static_cast<int>(sizeof(VasnecovProduct));
+        res["figure"] = static_cast<int>(sizeof(VasnecovFigure));
+        res["label"] = static_cast<int>(sizeof(VasnecovLabel));
+        res["lamp"] = static_cast<int>(sizeof(VasnecovLamp));
+        res["renderState"] = static_cast<int>(sizeof(Vasnecov::RenderState));
+        return res;
+    }
+
+    QSize parseSize(const QString& text)
+    {
+        QStringList parts = text.split('x');
+        if(parts.size() != 2)
+            return QSize();
+        return QSize(parts[0].toInt(), parts[1].toInt());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // Без дисплея по умолчанию (например, llvmpipe на сервере)
+    if(qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Vasnecov rendering benchmark");
+    parser.addHelpOption();
+
+    QCommandLineOption productsOption("products", "Bomber assemblies amount.", "N", "16");
+    QCommandLineOption figuresOption("figures", "Figures amount.", "M", "16");
+    QCommandLineOption pointsOption("points", "Points per figure.", "K", "64");
+    QCommandLineOption terrainOption("terrain", "Terrain grid side.", "S", "64");
+    QCommandLineOption labelsOption("labels", "Labels amount.", "L", "16");
+    QCommandLineOption sizesOption("sizes", "Comma separated resolutions.", "WxH,...", "640x480,1920x1080");
+    QCommandLineOption framesOption("frames", "Measured frames per resolution.", "F", "300");
+    QCommandLineOption warmupOption("warmup", "Warm-up frames per resolution.", "W", "20");
+    QCommandLineOption staticOption("static", "Do not move elements between frames.");
+    QCommandLineOption bulkOption("bulk", "Move elements with one setPoses call per frame.");
+    QCommandLineOption meshesOption("meshes", "Directory with bomber meshes.", "dir", BENCHMARK_MESHES_DIR);
+    QCommandLineOption outputOption("output", "JSON report file (stdout by default).", "file");
+    QCommandLineOption writersOption("writers", "Comma separated amounts of threads posting bomber poses "
+                                     "(measured after resolutions, at the first one).", "T,...");
+    QCommandLineOption transformsOption("transforms", "Only compare element matrices built by the library "
+                                        "kernels with QMatrix4x4 on N poses, fail on mismatch.", "N");
+    QCommandLineOption redrawOption("redraw", "Only check that moved and re-posed products "
+                                    "(root and nested) make needsRedraw() true, fail otherwise.");
+
+    parser.addOptions({productsOption, figuresOption, pointsOption, terrainOption, labelsOption,
+                       sizesOption, framesOption, warmupOption, staticOption, bulkOption, meshesOption,
+                       outputOption, writersOption, transformsOption, redrawOption});
+    parser.process(app);
+
+    if(parser.isSet(transformsOption))
+    {
+        const int amount = parser.value(transformsOption).toInt();
+        if(amount < 1)
+        {
+            qCritical("Wrong poses amount: %s", qPrintable(parser.value(transformsOption)));
+            return 1;
+        }
+
+        bool passed(false);
+        QJsonObject report;
+        report["transforms"] = compareTransforms(amount, passed);
+        if(!writeReport(report, parser.value(outputOption)))
+            return 1;
+        return passed ? 0 : 1;
+    }
+
+    if(parser.isSet(redrawOption))
+    {
+        VasnecovUniverse universe;
+        VasnecovOffscreenRenderer renderer(QSize(64, 64));
+        if(!renderer.isValid() || !renderer.setUniverse(&universe))
+        {
+            qCritical("Can't create offscreen renderer");
+            return 1;
+        }
+
+        bool passed(false);
+        QJsonObject report;
+        report["redraw"] = checkRedraw(universe, renderer, passed);
+        if(!writeReport(report, parser.value(outputOption)))
+            return 1;
+        return passed ? 0 : 1;
+    }
+
+    SceneParameters parameters;
+    parameters.products = parser.value(productsOption).toInt();
+    parameters.figures = parser.value(figuresOption).toInt();
+    parameters.figurePoints = parser.value(pointsOption).toInt();
+    parameters.terrainSize = parser.value(terrainOption).toInt();
+    parameters.labels = parser.value(labelsOption).toInt();
+
+    const int frames = std::max(1, parser.value(framesOption).toInt());
+    const int warmup = std::max(0, parser.value(warmupOption).toInt());
+    const bool animated = !parser.isSet(staticOption);
+    const bool bulk = parser.isSet(bulkOption);
+
+    std::vector<QSize> sizes;
+    for(const auto& text : parser.value(sizesOption).split(','))
+    {
+        QSize size = parseSize(text);
+        if(size.isEmpty())
+        {
+            qCritical("Wrong size: %s", qPrintable(text));
+            return 1;
+        }
+        sizes.push_back(size);
+    }
+
+    std::vector<int> writers;
+    if(parser.isSet(writersOption))
+    {
+        for(const auto& text : parser.value(writersOption).split(','))
+        {
+            int amount = text.toInt();
+            if(amount < 1)
+            {
+                qCritical("Wrong writers amount: %s", qPrintable(text));
+                return 1;
+            }
+            writers.push_back(amount);
+        }
+    }
+
+    VasnecovUniverse universe;
+    VasnecovOffscreenRenderer renderer(sizes.front());
+    if(!renderer.isValid() || !renderer.setUniverse(&universe))
+    {
+        qCritical("Can't create offscreen renderer");
+        return 1;
+    }
+
+    QJsonObject report;
+    report["renderer"] = universe.info(GL_RENDERER);
+    report["version"] = universe.info(GL_VERSION);
+    report["memoryStart"] = memoryUsage();
+    report["elementBytes"] = elementBytes();
+
+    universe.setMeshesDir(parser.value(meshesOption));
+    if(!universe.loadMeshes())
+    {
+        qCritical("Can't load meshes from %s", qPrintable(parser.value(meshesOption)));
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    SceneGenerator generator(&universe);
+    if(!generator.create(parameters))
+    {
+        qCritical("Can't create scene");
+        return 1;
+    }
+
+    QJsonObject scene;
+    scene["assemblies"] = parameters.products;
+    scene["products"] = static_cast<int>(generator.productsAmount());
+    scene["figures"] = parameters.figures;
+    scene["figurePoints"] = parameters.figurePoints;
+    scene["terrainSize"] = parameters.terrainSize;
+    scene["labels"] = parameters.labels;
+    scene["creationTime"] = timer.nsecsElapsed() * 1e-6;
+    report["scene"] = scene;
+    report["bulkPoses"] = bulk;
+
+    universe.setStatisticsEnabled(true);
+
+    int frame(0);
+    QJsonArray results;
+    for(const auto& size : sizes)
+    {
+        if(!renderer.setSize(size))
+            return 1;
+
+        for(int i = 0; i < warmup; ++i, ++frame)
+        {
+            if(animated)
+                generator.animate(frame, bulk);
+            renderer.renderFrame();
+            renderer.finish();
+        }
+
+        std::vector<double> frameTimes, designerTimes, updateTimes, drawTimes, gpuTimes, culled;
+        frameTimes.reserve(frames);
+        designerTimes.reserve(frames);
+        GLuint lastStatistics(universe.statistics().frame);
+
+        for(int i = 0; i < frames; ++i, ++frame)
+        {
+            timer.start();
+            if(animated)
+                generator.animate(frame, bulk);
+            designerTimes.push_back(timer.nsecsElapsed() * 1e-6);
+
+            timer.start();
+            renderer.renderFrame();
+            renderer.finish();
+            frameTimes.push_back(timer.nsecsElapsed() * 1e-6);
+
+            // Статистика рендера приходит с задержкой в несколько кадров
+            Vasnecov::FrameStatistics statistics(universe.statistics());
+            if(statistics.frame != lastStatistics)
+            {
+                lastStatistics = statistics.frame;
+                updateTimes.push_back(statistics.updateTime);
+                drawTimes.push_back(statistics.drawTime);
+
+                double gpu(0.0);
+                GLuint culledAmount(0);
+                for(const auto& world : statistics.worlds)
+                {
+                    gpu += std::max(0.0f, world.gpuTotal());
+                    culledAmount += world.culled;
+                }
+                culled.push_back(culledAmount);
+                if(statistics.gpuTimersAvailable)
+                    gpuTimes.push_back(gpu);
+            }
+        }
+
+        QJsonObject result;
+        result["width"] = size.width();
+        result["height"] = size.height();
+        result["frames"] = frames;
+        result["frameTime"] = percentiles(frameTimes);
+        result["designerUpdateTime"] = percentiles(designerTimes);
+        result["renderUpdateTime"] = percentiles(updateTimes);
+        result["renderDrawTime"] = percentiles(drawTimes);
+        result["gpuTime"] = percentiles(gpuTimes);
+        result["culled"] = percentiles(culled);
+        result["memory"] = memoryUsage();
+        results.append(result);
+    }
+    report["results"] = results;
+
+    // Потоки телеметрии публикуют положения бомберов без блокировок, пока рендер рисует кадры.
+    // У каждого бомбера один публикующий поток
+    QJsonArray handoff;
+    if(!writers.empty())
+    {
+        if(!renderer.setSize(sizes.front()))
+            return 1;
+
+        const std::vector<VasnecovProduct*>& bombers(generator.bombers());
+        std::vector<QVector3D> origins;
+        for(auto bomber : bombers)
+            origins.push_back(bomber->coordinates());
+
+        for(int amount : writers)
+        {
+            std::atomic<bool> running(true);
+            std::vector<std::atomic<quint64>> posts(amount);
+            for(auto& counter : posts)
+                counter.store(0);
+
+            std::vector<std::thread> threads;
+            for(int t = 0; t < amount; ++t)
+            {
+                threads.emplace_back([&, t]()
+                {
+                    quint64 count(0);
+                    while(running.load(std::memory_order_relaxed))
+                    {
+                        for(size_t i = t; i < bombers.size(); i += amount)
+                        {
+                            const float phase = (count + i) * 0.01f;
+                            QVector3D position(origins[i]);
+                            position.setZ(0.5f + 0.05f * std::sin(phase));
+                            bombers[i]->postPose(position, QVector3D(0.0f, 0.0f, std::fmod(phase * 10.0f, 360.0f)));
+                            ++count;
+                        }
+                        if(bombers.size() <= static_cast<size_t>(t))
+                            std::this_thread::yield();
+                        posts[t].store(count, std::memory_order_relaxed);
+                    }
+                });
+            }
+
+            std::vector<double> frameTimes;
+            frameTimes.reserve(frames);
+            QElapsedTimer total;
+            total.start();
+            for(int i = 0; i < frames; ++i)
+            {
+                timer.start();
+                renderer.renderFrame();
+                renderer.finish();
+                frameTimes.push_back(timer.nsecsElapsed() * 1e-6);
+            }
+            const double elapsed = total.nsecsElapsed() * 1e-9;
+
+            running = false;
+            for(auto& thread : threads)
+                thread.join();
+
+            quint64 postsTotal(0);
+            for(const auto& counter : posts)
+                postsTotal += counter.load();
+
+            QJsonObject result;
+            result["writers"] = amount;
+            result["frames"] = frames;
+            result["frameTime"] = percentiles(frameTimes);
+            result["postsPerSecond"] = postsTotal / elapsed;
+            result["framesPerSecond"] = frames / elapsed;
+            handoff.append(result);
+        }
+    }
+    report["handoff"] = handoff;
+    report["memoryEnd"] = memoryUsage();
+
+    return writeReport(report, parser.value(outputOption)) ? 0 : 1;
+}